@@ -0,0 +1,89 @@
+#include <dirwatcher.h>
+
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+    Probes a watched directory with the worker in its default settings and
+    then in low-latency mode, and prints the latency percentiles of each.
+
+    Usage: bench_latency [directory] [probe count] [cpu] [spin us]
+*/
+
+typedef struct bench_case
+{
+    const char* title;
+    bool        low_latency;
+} bench_case_t;
+
+static const bench_case_t cases[] = {
+    { "default",     false },
+    { "low latency", true  },
+};
+
+static void callback(const dirwatcher_event_info_t* event_info, void* user_data)
+{
+    (void)event_info;
+    (void)user_data;
+}
+
+int main(int argc, char** argv)
+{
+    const char*   dir     = argc > 1 ? argv[1] : ".";
+    unsigned long count   = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000;
+    long          cpu     = argc > 3 ? strtol(argv[3], NULL, 0) : 1;
+    unsigned long spin_us = argc > 4 ? strtoul(argv[4], NULL, 0) : 200;
+
+    if (count < 1)
+    {
+        fputs("Usage: bench_latency [directory] [probe count] [cpu] [spin us]\n", stderr);
+        return -1;
+    }
+
+    dirwatcher_target_t target = dirwatcher_open_target_with_backend(dir, DIRWATCHER_BACKEND_NATIVE);
+
+    if (!target)
+    {
+        fputs("ERROR: Failed to open the target.\n", stderr);
+        return -1;
+    }
+
+    dirwatcher_set_target_callback(target, callback, NULL);
+    dirwatcher_start_watch_target(target);
+
+    printf("%-12s %8s %8s %8s %8s %8s %8s %6s\n", "case", "min us", "p50", "p90", "p99", "p99.9", "max", "lost");
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const bench_case_t*             c         = &cases[i];
+        dirwatcher_latency_histogram_t  histogram = { 0 };
+        dirwatcher_low_latency_config_t config    = { (int32_t)cpu, true, (uint32_t)spin_us };
+
+        if (!dirwatcher_set_target_low_latency(target, c->low_latency ? &config : NULL))
+        {
+            fputs("ERROR: Failed to apply the worker settings.\n", stderr);
+            return -1;
+        }
+
+        if (!dirwatcher_probe_target_latency(target, (uint32_t)count, &histogram))
+        {
+            fprintf(stderr, "ERROR: Probing failed with %lu.\n", GetLastError());
+            return -1;
+        }
+
+        printf("%-12s %8llu %8llu %8llu %8llu %8llu %8llu %6llu\n",
+               c->title,
+               (unsigned long long)histogram.min_us,
+               (unsigned long long)dirwatcher_get_latency_percentile(&histogram, 50.0),
+               (unsigned long long)dirwatcher_get_latency_percentile(&histogram, 90.0),
+               (unsigned long long)dirwatcher_get_latency_percentile(&histogram, 99.0),
+               (unsigned long long)dirwatcher_get_latency_percentile(&histogram, 99.9),
+               (unsigned long long)histogram.max_us,
+               (unsigned long long)histogram.lost);
+    }
+
+    dirwatcher_close_target(target);
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dirwatcher_path_table.h"
+
+/*
+    Builds a synthetic directory tree and reports the memory the path table
+    needs per directory, next to what a table of full path strings would need.
+
+    Usage: bench_path_table [directory count] [fan-out]
+*/
+
+#define MY_MAX_PATH 4096
+
+static const char* common_names[] = {
+    "src", "include", "test", "build", "docs", "lib", "bin", "obj",
+    "Debug", "Release", "x64", "node_modules", "dist", "assets", "internal", "vendor"
+};
+
+static double now_seconds(void)
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long count  = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+    unsigned long fanout = argc > 2 ? strtoul(argv[2], NULL, 0) : 16;
+    char          name[64];
+    char          path[MY_MAX_PATH];
+    size_t        naive_bytes = 0;
+
+    if (count < 1 || fanout < 1)
+    {
+        fputs("Usage: bench_path_table [directory count] [fan-out]\n", stderr);
+        return -1;
+    }
+
+    _dirwatcher_path_table_t* table = _dirwatcher_path_table_create(false);
+    uint32_t*                 nodes = malloc(count * sizeof(uint32_t));
+
+    if (!table || !nodes)
+    {
+        fputs("ERROR: Out of memory.\n", stderr);
+        return -1;
+    }
+
+    //
+    // Breadth-first tree: node i is the child of node (i - 1) / fanout.
+    // Half of the names repeat across the tree (src, build, ...), half are unique.
+    //
+
+    double begin = now_seconds();
+
+    for (unsigned long i = 0; i < count; i++)
+    {
+        uint32_t parent = i ? nodes[(i - 1) / fanout] : DIRWATCHER_PATH_ROOT;
+
+        if (i % 2)
+        {
+            snprintf(name, sizeof(name), "%s", common_names[(i / 2) % (sizeof(common_names) / sizeof(common_names[0]))]);
+
+            if (_dirwatcher_path_table_lookup(table, parent, name, strlen(name)) != DIRWATCHER_PATH_NONE)
+            {
+                snprintf(name, sizeof(name), "%s_%lu", common_names[(i / 2) % 16], i % fanout);
+            }
+        }
+        else
+        {
+            snprintf(name, sizeof(name), "dir_%08lx", i * 2654435761ul & 0xFFFFFFFFul);
+        }
+
+        nodes[i] = _dirwatcher_path_table_insert(table, parent, name, strlen(name));
+
+        if (nodes[i] == DIRWATCHER_PATH_NONE)
+        {
+            fputs("ERROR: Insert failed.\n", stderr);
+            return -1;
+        }
+    }
+
+    double insert_seconds = now_seconds() - begin;
+
+    //
+    // What a table of full path strings would hold (string + pointer)
+    //
+
+    begin = now_seconds();
+
+    for (unsigned long i = 0; i < count; i++)
+    {
+        size_t len = _dirwatcher_path_table_build_path(table, nodes[i], path, sizeof(path));
+        naive_bytes += len + sizeof(char*);
+    }
+
+    double build_seconds = now_seconds() - begin;
+
+    //
+    // Relink the first subtree under the last directory, then back
+    //
+
+    uint32_t subtree = nodes[1];
+    uint32_t first   = _dirwatcher_path_table_parent(table, subtree);
+    char     subtree_name[64];
+
+    snprintf(subtree_name, sizeof(subtree_name), "%s", _dirwatcher_path_table_name(table, subtree));
+
+    begin = now_seconds();
+    int moved = _dirwatcher_path_table_move(table, subtree, nodes[count - 1], "moved", 5) &&
+                _dirwatcher_path_table_move(table, subtree, first, subtree_name, strlen(subtree_name));
+    double move_seconds = now_seconds() - begin;
+
+    size_t table_bytes = _dirwatcher_path_table_memory_usage(table);
+
+    printf("directories:        %lu (fan-out %lu)\n", count, fanout);
+    printf("path table:         %zu bytes, %.1f bytes/directory\n", table_bytes, (double)table_bytes / (double)count);
+    printf("full path strings:  %zu bytes, %.1f bytes/directory\n", naive_bytes, (double)naive_bytes / (double)count);
+    printf("insert:             %.1f ns/directory\n", insert_seconds * 1e9 / (double)count);
+    printf("build path:         %.1f ns/directory\n", build_seconds * 1e9 / (double)count);
+    printf("subtree relink x2:  %s, %.1f us\n", moved ? "ok" : "FAILED", move_seconds * 1e6);
+
+    _dirwatcher_path_table_destroy(table);
+    free(nodes);
+
+    return moved ? 0 : -1;
+}
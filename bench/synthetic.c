@@ -0,0 +1,134 @@
+#include <dirwatcher.h>
+
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+    Drives synthetic targets through the library's decode and dispatch path
+    and reports its own cost per event, with no file system involved.
+
+    Usage: bench_synthetic [event count] [directory]
+*/
+
+typedef struct bench_state
+{
+    volatile LONG64 received;
+    LONG64          expected;
+    HANDLE          done_event;
+} bench_state_t;
+
+typedef struct bench_case
+{
+    const char* title;
+    uint32_t    rate;
+    uint32_t    burst_size;
+    uint32_t    name_min_len;
+    uint32_t    name_max_len;
+    uint32_t    renamed_weight;    /* 0 = default mix, otherwise renames only */
+} bench_case_t;
+
+static const bench_case_t cases[] = {
+    { "default mix, names 8-32",    0,       0,    0,   0,   0 },
+    { "default mix, names 4-8",     0,       0,    4,   8,   0 },
+    { "default mix, names 128-256", 0,       0,    128, 256, 0 },
+    { "renames only, names 8-32",   0,       0,    0,   0,   1 },
+    { "paced 1M/s, bursts of 4096", 1000000, 4096, 0,   0,   0 },
+};
+
+static void callback(const dirwatcher_event_info_t* event_info, void* user_data)
+{
+    bench_state_t* state = user_data;
+
+    if (!event_info)
+    {
+        SetEvent(state->done_event);
+        return;
+    }
+
+    if (InterlockedIncrement64(&state->received) == state->expected)
+    {
+        SetEvent(state->done_event);
+    }
+}
+
+static double now_seconds(void)
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER        counter;
+
+    if (!frequency.QuadPart)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long long count = argc > 1 ? strtoull(argv[1], NULL, 0) : 10000000;
+    const char*        dir   = argc > 2 ? argv[2] : ".";
+
+    if (count < 1)
+    {
+        fputs("Usage: bench_synthetic [event count] [directory]\n", stderr);
+        return -1;
+    }
+
+    printf("%-30s %12s %14s %10s\n", "case", "events", "events/s", "ns/event");
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const bench_case_t*           c      = &cases[i];
+        dirwatcher_synthetic_config_t config = { 0 };
+        bench_state_t                 state  = { 0 };
+
+        config.rate         = c->rate;
+        config.burst_size   = c->burst_size;
+        config.name_min_len = c->name_min_len;
+        config.name_max_len = c->name_max_len;
+        config.limit        = c->rate ? min(count, (unsigned long long)c->rate * 2) : count;
+        config.seed         = (uint32_t)i + 1;
+
+        config.weights[DIRWATCHER_EVENT_RENAMED] = c->renamed_weight;
+
+        state.expected   = (LONG64)config.limit;
+        state.done_event = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+        dirwatcher_target_t target = dirwatcher_open_synthetic_target(dir, &config);
+
+        if (!target || !state.done_event)
+        {
+            fputs("ERROR: Failed to open a synthetic target.\n", stderr);
+            return -1;
+        }
+
+        dirwatcher_set_target_callback(target, callback, &state);
+
+        double begin = now_seconds();
+
+        dirwatcher_start_watch_target(target);
+        WaitForSingleObject(state.done_event, INFINITE);
+
+        double elapsed = now_seconds() - begin;
+
+        if (dirwatcher_get_target_error(target) != DIRWATCHER_SUCCESS)
+        {
+            fprintf(stderr, "ERROR: Worker failed with %ld.\n", dirwatcher_get_target_win32_error(target));
+            return -1;
+        }
+
+        printf("%-30s %12lld %14.0f %10.1f\n",
+               c->title,
+               (long long)state.received,
+               (double)state.received / elapsed,
+               elapsed * 1e9 / (double)state.received);
+
+        dirwatcher_close_target(target);
+        CloseHandle(state.done_event);
+    }
+
+    return 0;
+}
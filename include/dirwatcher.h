@@ -56,6 +56,16 @@
     *
     * - After event_info == NULL is delivered, the worker thread terminates and
     *   no further callbacks will be invoked.
+    *
+    * - A rename arrives as DIRWATCHER_EVENT_RENAMED_FROM followed by
+    *   DIRWATCHER_EVENT_RENAMED_TO, and a move between directories as
+    *   DIRWATCHER_EVENT_REMOVED + DIRWATCHER_EVENT_ADDED, unless the event
+    *   mask holds DIRWATCHER_EVENT_RENAMED (see Event Mask). Then both are
+    *   delivered as one DIRWATCHER_EVENT_RENAMED event with both
+    *   event_info->old_name and event_info->name. Moves are paired by file
+    *   id, which needs Windows 10 1709 and a file system with extended
+    *   notifications (NTFS, ReFS). Halves that cannot be paired within one
+    *   notification buffer keep the events above.
     * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
     
     * * * * * * * * * * * * * * * * * * *
@@ -91,6 +101,272 @@
     *
     * - Once an error is reported, the target must be closed and recreated.
     * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+
+    * * * * * * * * * * * * *
+    * Shared-memory Fan-out *
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+    * - One process owns the target and publishes its events into a named ring:
+    *
+    *      dirwatcher_publish_target(target, "Local\\my-ring", 0);
+    *
+    * - Any number of processes attach a reader, each with its own cursor:
+    *
+    *      dirwatcher_reader_t reader = dirwatcher_open_reader("Local\\my-ring");
+    *
+    *      while (dirwatcher_wait_reader(reader, INFINITE))
+    *      {
+    *          while (dirwatcher_read_event(reader, &event, name, sizeof(name), NULL, 0, &lost)
+    *                 != DIRWATCHER_READ_EMPTY) { ... }
+    *      }
+    *
+    * - Reading does not enter the kernel; only dirwatcher_wait_reader() may
+    *   sleep when the ring is empty. Sleeping readers are woken through the
+    *   "<name>-wake" semaphore once per published batch.
+    *
+    * - Readers map the ring read-only. A slot the publisher is still writing
+    *   reads as DIRWATCHER_READ_EMPTY; the next call tries it again.
+    *
+    * - A reader that falls behind by more than the ring capacity gets
+    *   DIRWATCHER_READ_OVERRUN once, with the number of lost events, and
+    *   continues from the oldest event still in the ring.
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+
+    * * * * * * * * *
+    * Event Journal *
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+    * - A target can append every event to memory-mapped segment files in a
+    *   directory. Segments roll when they reach the configured size:
+    *
+    *      dirwatcher_set_target_journal(target, "PATH/TO/JOURNAL", 0);
+    *
+    * - Each event is stored with a sequence number, its timestamp, its type and
+    *   an interned name. Sequence numbers continue across restarts.
+    *
+    * - A journal can be replayed through a regular callback, optionally limited
+    *   to a sequence or time range:
+    *
+    *      dirwatcher_replay_journal("PATH/TO/JOURNAL", NULL, target, my_callback, NULL, NULL);
+    *
+    * - Records reach the file system cache immediately and survive a crash of
+    *   the process; segments are flushed to disk when they roll or close.
+    *
+    * - A failed append (disk full, a segment that cannot roll) stops the
+    *   journal but not the watch: events keep reaching readers and the
+    *   callback. The error is kept until the next dirwatcher_set_target_journal():
+    *
+    *      dirwatcher_get_target_journal_win32_error()
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+
+    * * * * * * * * * *
+    * Polling Backend *
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+    * - File systems without change notifications (many network and FUSE
+    *   file systems) can be watched by rescanning:
+    *
+    *      dirwatcher_open_target_with_backend("PATH/TO/DIR", DIRWATCHER_BACKEND_POLLING);
+    *
+    * - dirwatcher_open_target() uses DIRWATCHER_BACKEND_AUTO, which switches
+    *   to polling by itself when the file system rejects notifications.
+    *   Use polling explicitly where notifications are accepted but never
+    *   arrive.
+    *
+    * - Each pass lists only directories whose last write time changed; every
+    *   8th pass lists all of them to catch in-place writes. The interval drops
+    *   to the minimum after a change and doubles up to the maximum while the
+    *   tree is idle.
+    *
+    * - Changes are reported relative to the previous pass. A file created and
+    *   deleted between two passes is not reported; moves are paired by file id.
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+
+    * * * * * * * * * * *
+    * Synthetic Events  *
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+    * - For benchmarking, a target can generate its own notify buffers instead
+    *   of reading them from the kernel. They go through the same decoding,
+    *   shared memory, journal and callback path as real events:
+    *
+    *      dirwatcher_synthetic_config_t config = { 0 };
+    *      config.rate  = 1000000;
+    *      config.limit = 10000000;
+    *
+    *      dirwatcher_target_t target = dirwatcher_open_synthetic_target("PATH/TO/DIR", &config);
+    *
+    * - The directory is only used to resolve full paths; nothing is read from it.
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+
+    * * * * * * * * *
+    * Watch Budget  *
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+    * - Every target reading native notifications holds a directory handle, a
+    *   blocked worker thread and a kernel notify buffer. The process can cap
+    *   how many targets do so at once:
+    *
+    *      dirwatcher_set_watch_budget(64, 0);
+    *
+    * - Past the budget, the least recently active DIRWATCHER_BACKEND_AUTO
+    *   target is moved to a low-frequency poll. It moves back, displacing the
+    *   next least recently active one, as soon as a poll sees a change.
+    *   Targets opened with DIRWATCHER_BACKEND_NATIVE are counted but never moved.
+    *
+    * - Changes made while a target switches may go unreported.
+    *
+    * - dirwatcher_get_target_watch_stats() shows what a target currently uses.
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+
+    * * * * * * * * *
+    * Low Latency   *
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+    * - When the time from a change to the callback matters more than
+    *   throughput, the worker can be pinned to a processor, raised to
+    *   THREAD_PRIORITY_TIME_CRITICAL and made to spin briefly on each read
+    *   before it blocks:
+    *
+    *      dirwatcher_low_latency_config_t config = { 2, true, 200 };
+    *
+    *      dirwatcher_set_target_low_latency(target, &config);
+    *
+    * - The thread priority is relative to the process priority class, which
+    *   the library leaves alone.
+    *
+    * - dirwatcher_probe_target_latency() renames a probe file in the root of
+    *   a running target and measures the time until the worker dispatches the
+    *   rename, into a histogram with power-of-two microsecond buckets:
+    *
+    *      dirwatcher_latency_histogram_t histogram = { 0 };
+    *
+    *      dirwatcher_probe_target_latency(target, 1000, &histogram);
+    *      p99 = dirwatcher_get_latency_percentile(&histogram, 99.0);
+    *
+    * - Probe files are named .dirwatcher-probe-* and are not reported.
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+
+    * * * * * * * * * *
+    * Changes Since   *
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+    * - A target can keep a logical clock and the last clock each path
+    *   changed at, and answer "what changed since I last asked" in time
+    *   proportional to the number of changed paths:
+    *
+    *      dirwatcher_set_target_change_index(target, DIRWATCHER_CHANGES_DEFAULT_MAX_PATHS);
+    *      dirwatcher_start_watch_target(target);
+    *
+    *      uint64_t token = dirwatcher_get_target_change_token(target);
+    *      ...
+    *      if (dirwatcher_changes_since(target, token, on_path, ctx, &token)
+    *              == DIRWATCHER_CHANGES_EXPIRED) { walk the whole tree }
+    *
+    * - Each changed path is reported once, newest first. Both names of a
+    *   rename are reported; a path that names a directory stands for its
+    *   whole subtree (for example, a renamed directory).
+    *
+    * - Paths that differ only in the case of ASCII letters are one path,
+    *   reported in the case first seen; other letters compare exactly.
+    *
+    * - DIRWATCHER_CHANGES_EXPIRED means changes after the token may have
+    *   been lost: a kernel buffer overflow, a switch between native
+    *   notifications and polling, more distinct paths than max_paths, or a
+    *   token from another target or process. The new token is still valid.
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+
+    * * * * * * * * * *
+    * Ignore Files    *
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+    * - dirwatcher_set_target_ignore_files(target, true) drops changes to
+    *   paths that the .gitignore / .ignore files of the watched tree
+    *   exclude, with git's pattern syntax. .ignore takes precedence over
+    *   .gitignore of the same directory, and deeper files over shallower
+    *   ones. Matching is case-insensitive.
+    *
+    * - Rules are compiled per directory on first use and cached; a change
+    *   to an ignore file reloads its directory's rules.
+    *
+    * - Windows watches the tree with one recursive kernel watch, so an
+    *   ignored subtree still produces kernel records; they are dropped
+    *   before their names are converted. The polling backend does not list
+    *   ignored subtrees at all.
+    *
+    * - A rename across the boundary is reported as an addition (moved out
+    *   of an ignored path) or a removal (moved into one).
+    *
+    * - Directory-only rules ("build/") need to know that an entry is a
+    *   directory; without extended notifications (ReadDirectoryChangesExW)
+    *   they apply to the entries below the directory, not to itself.
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+
+    * * * * * * * * * *
+    * Target Paths    *
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+    * - What a running target covers can change without reopening it; the
+    *   worker keeps running and only the affected paths are touched:
+    *
+    *      dirwatcher_remove_target_path(target, "C:\\repo\\node_modules");
+    *      dirwatcher_add_target_path(target, "D:\\shared\\config");
+    *
+    * - A path below the root is already covered by the root's recursive
+    *   watch, so removing it only excludes it: its events are dropped
+    *   before their names are converted, and polling no longer lists it.
+    *   Adding it back lifts the exclusion.
+    *
+    * - A path outside the root gets a watch of its own (at most
+    *   DIRWATCHER_MAX_TARGET_PATHS), served by the same worker. Its events
+    *   are named by their full path, everywhere a name is delivered: the
+    *   callback, readers, the journal and dirwatcher_changes_since(). Names
+    *   below the root stay relative. Removing it cancels that watch; an
+    *   extra directory that can no longer be read (for example, deleted) is
+    *   dropped from the target. A directory that contains the root cannot
+    *   be added, since it would report the root's changes twice.
+    *
+    * - The events of an extra directory are filtered like the root's: by
+    *   the ignore files inside it, while ignore files are enabled, and with
+    *   moves paired by file id. Exclusions only apply below the root.
+    *
+    * - While a target polls, the events of its extra directories are
+    *   delivered after each pass.
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+
+    * * * * * * * * * *
+    * Event Mask      *
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+    * - A save arrives as a burst of DIRWATCHER_EVENT_MODIFIED, one per
+    *   write. A consumer that only cares about finished files can take
+    *   DIRWATCHER_EVENT_CLOSED_WRITE instead, once per file, after its
+    *   writer closed it:
+    *
+    *      dirwatcher_set_target_event_mask(target,
+    *          DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_ADDED) |
+    *          DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_REMOVED) |
+    *          DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_CLOSED_WRITE));
+    *
+    * - The mask narrows the kernel's notify filter too. Name changes are
+    *   read only if the mask holds a rename, ADDED, REMOVED or CLOSED_WRITE
+    *   (which must follow renames of tracked files). Writes are read only
+    *   for MODIFIED or CLOSED_WRITE. Events outside the mask are dropped
+    *   before the change index, journal, readers and callback see them.
+    *   Ignore files are reloaded from the changes read, so a mask without
+    *   writes also misses edits to them.
+    *
+    * - The kernel fixes the notify filter of a directory handle at its
+    *   first read, so a mask that changes the filter reopens the target's
+    *   handles. Changes made meanwhile are lost, and change tokens expire.
+    *
+    * - Windows does not report closes. Files that were added or modified
+    *   are tracked, and every DIRWATCHER_CLOSED_WRITE_PROBE_INTERVAL ms
+    *   the worker tries to open them without sharing write access, which
+    *   fails while a writer still holds them. A file is reported once
+    *   that open succeeds, so a writer that reopens it within the interval
+    *   is seen as one write, and the probe holds the file for a moment: a
+    *   writer opening it just then gets a sharing violation. When the
+    *   kernel buffer overflows, the files being tracked are forgotten and
+    *   get no CLOSED_WRITE; the expired change token tells of the loss.
+    *
+    * - DIRWATCHER_EVENT_MASK_DEFAULT is every event but CLOSED_WRITE and
+    *   RENAMED, the events of targets that predate the mask; no file is
+    *   probed unless CLOSED_WRITE is asked for. Adding RENAMED turns on the
+    *   pairing of renames and moves; the halves that stay unpaired still
+    *   arrive as RENAMED_FROM / RENAMED_TO, so a mask with renames should
+    *   hold all three rename events.
+    * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
 */
 
 #ifndef DIRWATCHER_H
@@ -104,15 +380,44 @@ extern "c"
 #endif
 
 typedef void* dirwatcher_target_t;
+typedef void* dirwatcher_reader_t;
+
+#define DIRWATCHER_READER_NAME_MAX         1024 /* byte-size of a ring slot's name, including null-terminator */
+#define DIRWATCHER_READER_DEFAULT_CAPACITY 4096 /* slots */
+
+#define DIRWATCHER_JOURNAL_DEFAULT_SEGMENT_SIZE (64 * 1024 * 1024) /* bytes */
+
+#define DIRWATCHER_POLL_DEFAULT_MIN_INTERVAL 250  /* ms */
+#define DIRWATCHER_POLL_DEFAULT_MAX_INTERVAL 8000 /* ms */
+#define DIRWATCHER_POLL_DEFAULT_COLD_INTERVAL 30000 /* ms, targets moved to polling by the watch budget */
+
+#define DIRWATCHER_LOW_LATENCY_MAX_SPIN 10000 /* us */
+#define DIRWATCHER_LATENCY_BUCKETS      32    /* bucket i counts [2^i, 2^(i+1)) us; bucket 0 also counts < 1 us */
+#define DIRWATCHER_PROBE_TIMEOUT        1000  /* ms a probe may take before it is counted as lost */
+
+#define DIRWATCHER_CHANGES_DEFAULT_MAX_PATHS 65536 /* changed paths a change index keeps */
+
+#define DIRWATCHER_MAX_TARGET_PATHS 32 /* extra directories a target can watch besides its root */
+
+#define DIRWATCHER_SYNTHETIC_WEIGHT_SLOTS 16 /* entries of dirwatcher_synthetic_config_t.weights; fixed, so new events keep its layout */
+
+#define DIRWATCHER_CLOSED_WRITE_PROBE_INTERVAL 100 /* ms between checks of files being written */
+
+#define DIRWATCHER_EVENT_MASK(event)   (1u << (event))
+#define DIRWATCHER_EVENT_MASK_ALL      (DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_COUNT) - 1)
+#define DIRWATCHER_EVENT_MASK_DEFAULT  (DIRWATCHER_EVENT_MASK_ALL & ~(DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_CLOSED_WRITE) | \
+                                                                DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_RENAMED)))
 
 typedef enum dirwatcher_event
 {
-    DIRWATCHER_EVENT_NULL, /* Internal / no-op event (not an error) */
+    DIRWATCHER_EVENT_NULL,         /* Internal / no-op event (not an error) */
     DIRWATCHER_EVENT_ADDED,
     DIRWATCHER_EVENT_REMOVED,
     DIRWATCHER_EVENT_MODIFIED,
     DIRWATCHER_EVENT_RENAMED_FROM,
     DIRWATCHER_EVENT_RENAMED_TO,
+    DIRWATCHER_EVENT_RENAMED,      /* both halves of a rename or move, if in the event mask; see old_name */
+    DIRWATCHER_EVENT_CLOSED_WRITE, /* a written file is no longer open for writing; see Event Mask */
     DIRWATCHER_EVENT_COUNT
 } dirwatcher_event_t;
 
@@ -127,13 +432,105 @@ typedef enum dirwatcher_error
     DIRWATCHER_UNKNOWN_OS_ERROR
 } dirwatcher_error_t;
 
+typedef enum dirwatcher_backend
+{
+    DIRWATCHER_BACKEND_INVALID = -1,
+    DIRWATCHER_BACKEND_AUTO,      /* native, switching to polling if the file system is not supported */
+    DIRWATCHER_BACKEND_NATIVE,    /* change notifications only */
+    DIRWATCHER_BACKEND_POLLING,   /* periodic rescans */
+    DIRWATCHER_BACKEND_SYNTHETIC  /* generated events, see dirwatcher_synthetic_config_t */
+} dirwatcher_backend_t;
+
+typedef enum dirwatcher_read_result
+{
+    DIRWATCHER_READ_INVALID = -1,
+    DIRWATCHER_READ_OK,
+    DIRWATCHER_READ_EMPTY,   /* no new events */
+    DIRWATCHER_READ_OVERRUN  /* reader fell behind by more than the ring capacity */
+} dirwatcher_read_result_t;
+
 typedef struct dirwatcher_event_info
 {
-    dirwatcher_target_t target; /* target that the event occured */
-    char*               name;   /* read-only, owned by library, UTF - 8 Encoding */
+    dirwatcher_target_t target;    /* target that the event occured */
+    char*               name;      /* read-only, owned by library, UTF - 8 Encoding */
     dirwatcher_event_t  event;
+    uint64_t            timestamp; /* FILETIME (100ns since 1601-01-01 UTC) when the event was observed */
+    char*               old_name;  /* DIRWATCHER_EVENT_RENAMED only, otherwise NULL; read-only, owned by library */
 } dirwatcher_event_info_t;
 
+/*
+    Event stream of a synthetic target. Zero fields use the defaults.
+*/
+typedef struct dirwatcher_synthetic_config
+{
+    uint32_t rate;                                       /* average events per second, 0 = as fast as possible */
+    uint32_t burst_size;                                 /* events delivered back to back, bursts are spaced to keep rate (default 1) */
+    uint32_t name_min_len;                               /* name length range in characters, both 0 = 8 to 32, at most 512 */
+    uint32_t name_max_len;                               /* */
+    uint32_t weights[DIRWATCHER_SYNTHETIC_WEIGHT_SLOTS]; /* relative frequency by dirwatcher_event_t, slots past the last event are reserved; all 0 = ADDED 1, REMOVED 1, MODIFIED 2, RENAMED 1 */
+    uint64_t limit;                                      /* events to generate, 0 = unbounded */
+    uint32_t seed;                                       /* same seed, same stream */
+} dirwatcher_synthetic_config_t;
+
+/*
+    What a target currently uses to watch its tree.
+*/
+typedef struct dirwatcher_watch_stats
+{
+    uint32_t native_watches;     /* native notification handles in use (0 or 1, covering the whole tree) */
+    uint32_t polled_directories; /* directories covered by polling, including the root */
+    uint64_t demotions;          /* times the watch budget moved the target to polling */
+    uint64_t promotions;         /* times it moved back to native notifications */
+} dirwatcher_watch_stats_t;
+
+typedef enum dirwatcher_changes_result
+{
+    DIRWATCHER_CHANGES_INVALID = -1,
+    DIRWATCHER_CHANGES_OK,
+    DIRWATCHER_CHANGES_EXPIRED   /* changes may have been lost since the token; rescan */
+} dirwatcher_changes_result_t;
+
+/*
+    Receives one changed path, relative to the target, or full below an
+    extra directory (see Target Paths) (UTF-8).
+    path is only valid during the call.
+*/
+typedef void (*dirwatcher_path_callback_t)(const char* path, void* user_data);
+
+/*
+    Worker settings for dirwatcher_set_target_low_latency().
+*/
+typedef struct dirwatcher_low_latency_config
+{
+    int32_t  cpu;            /* logical processor (0-63) of the process' group to pin the worker to, -1: not pinned */
+    bool     time_critical;  /* run the worker at THREAD_PRIORITY_TIME_CRITICAL */
+    uint32_t spin_us;        /* busy-wait up to this long for each read before blocking, 0: never spin */
+} dirwatcher_low_latency_config_t;
+
+/*
+    Probe latencies; see dirwatcher_probe_target_latency().
+*/
+typedef struct dirwatcher_latency_histogram
+{
+    uint64_t count;                               /* probes seen */
+    uint64_t lost;                                /* probes not seen within DIRWATCHER_PROBE_TIMEOUT */
+    uint64_t min_us;                              /* valid if count is non-zero */
+    uint64_t max_us;
+    uint64_t buckets[DIRWATCHER_LATENCY_BUCKETS];
+} dirwatcher_latency_histogram_t;
+
+/*
+    Inclusive sequence and time (FILETIME) bounds of a journal replay.
+    Use { 0, UINT64_MAX, 0, UINT64_MAX } for everything.
+*/
+typedef struct dirwatcher_journal_range
+{
+    uint64_t first_seq;
+    uint64_t last_seq;
+    uint64_t first_time;
+    uint64_t last_time;
+} dirwatcher_journal_range_t;
+
 /*
     event_info is only valid during callback execution.
     If an error occurs in the worker thread, event_info will be NULL. 
@@ -146,6 +543,134 @@ typedef void (*dirwatcher_callback_t)(const dirwatcher_event_info_t* event_info,
 */
 dirwatcher_target_t dirwatcher_open_target(const char* name);
 
+/*
+    Opens a directory target with the given backend.
+    Returns NULL on failure.
+*/
+dirwatcher_target_t dirwatcher_open_target_with_backend(const char* name, dirwatcher_backend_t backend);
+
+/*
+    Opens a target that generates events as described by config instead of
+    watching name. config NULL uses the defaults.
+    Returns NULL on failure.
+*/
+dirwatcher_target_t dirwatcher_open_synthetic_target(const char* name, const dirwatcher_synthetic_config_t* config /* NULLABLE */);
+
+/*
+    Returns the backend in use: DIRWATCHER_BACKEND_NATIVE, DIRWATCHER_BACKEND_POLLING
+    or DIRWATCHER_BACKEND_SYNTHETIC. A target moved to polling by the watch
+    budget reports DIRWATCHER_BACKEND_POLLING until it moves back.
+    if target is invalid, returns DIRWATCHER_BACKEND_INVALID.
+*/
+dirwatcher_backend_t dirwatcher_get_target_backend(dirwatcher_target_t target);
+
+/*
+    Sets the bounds of the adaptive poll interval (polling backend only).
+    Returns false if the target is invalid or min_interval_ms is 0 or above max_interval_ms.
+*/
+bool dirwatcher_set_target_poll_interval(dirwatcher_target_t target, uint32_t min_interval_ms, uint32_t max_interval_ms);
+
+/*
+    Limits how many targets of the process read native notifications at once.
+    max_native_targets 0 removes the limit (the default).
+    cold_interval_ms 0 uses DIRWATCHER_POLL_DEFAULT_COLD_INTERVAL.
+
+    Lowering the budget moves targets to polling immediately.
+*/
+bool dirwatcher_set_watch_budget(uint32_t max_native_targets, uint32_t cold_interval_ms);
+
+/*
+    Gets the number of targets reading native notifications and the budget (0: unlimited).
+*/
+void dirwatcher_get_watch_budget_usage(uint32_t* native_targets, uint32_t* max_native_targets);
+
+/*
+    Gets the target's watch counters.
+    Returns false if the target is invalid.
+*/
+bool dirwatcher_get_target_watch_stats(dirwatcher_target_t target, dirwatcher_watch_stats_t* stats);
+
+/*
+    Pins, prioritizes and sets the read spin of the target's worker.
+    config NULL restores the defaults (not pinned, normal priority, no spin).
+    Returns false if the target is invalid, the processor is not available to
+    the process or spin_us exceeds DIRWATCHER_LOW_LATENCY_MAX_SPIN.
+*/
+bool dirwatcher_set_target_low_latency(dirwatcher_target_t target, const dirwatcher_low_latency_config_t* config /* NULLABLE */);
+
+/*
+    Renames a probe file in the target's root count times, one at a time, and
+    adds the time from each rename to its dispatch by the worker to histogram.
+    The target must be watching. Blocks the caller until done.
+    Returns false if the target is invalid or the probe file cannot be written.
+*/
+bool dirwatcher_probe_target_latency(dirwatcher_target_t target, uint32_t count, dirwatcher_latency_histogram_t* histogram);
+
+/*
+    Returns an upper bound, in microseconds, of the given percentile (0-100)
+    of histogram, or 0 if it is empty.
+*/
+uint64_t dirwatcher_get_latency_percentile(const dirwatcher_latency_histogram_t* histogram, double percentile);
+
+/*
+    Honours the .gitignore / .ignore files of the target's tree (see Ignore
+    Files). Takes effect from the next batch of changes.
+    Returns false if the target is invalid.
+*/
+bool dirwatcher_set_target_ignore_files(dirwatcher_target_t target, bool enable);
+
+/*
+    Adds path to the target's coverage (see Target Paths): lifts exclusions
+    at or below it, or watches it as an extra directory.
+    Returns false if the target is invalid or synthetic, path lies below an
+    exclusion that stays, path contains the root, or path cannot be watched.
+*/
+bool dirwatcher_add_target_path(dirwatcher_target_t target, const char* path);
+
+/*
+    Removes path from the target's coverage (see Target Paths): excludes it
+    if it lies below the root, or stops watching the extra directory path.
+    Returns false if the target is invalid or synthetic, path is the root,
+    or path is neither below the root nor an extra directory.
+*/
+bool dirwatcher_remove_target_path(dirwatcher_target_t target, const char* path);
+
+/*
+    Delivers only the events whose DIRWATCHER_EVENT_MASK bits are set in
+    mask (see Event Mask). Takes effect from the next batch of changes.
+    Returns false if the target is invalid or mask selects no event.
+*/
+bool dirwatcher_set_target_event_mask(dirwatcher_target_t target, uint32_t mask);
+
+/*
+    Starts keeping a change index of at most max_paths paths (see Changes Since).
+    Replaces an existing index, which refuses every earlier token.
+    max_paths 0 drops the index.
+
+    Returns false if the target is invalid or the index cannot be created.
+*/
+bool dirwatcher_set_target_change_index(dirwatcher_target_t target, uint32_t max_paths);
+
+/*
+    Returns the token for the target's current clock, or 0 if the target is
+    invalid or keeps no change index. Token 0 is always expired.
+*/
+uint64_t dirwatcher_get_target_change_token(dirwatcher_target_t target);
+
+/*
+    Calls callback, from the calling thread, once for every path changed after
+    token. new_token receives the token to pass next time, also when the
+    result is DIRWATCHER_CHANGES_EXPIRED.
+
+    callback must not call back into the target.
+    Returns DIRWATCHER_CHANGES_INVALID if the target is invalid or keeps no change index.
+*/
+dirwatcher_changes_result_t dirwatcher_changes_since(dirwatcher_target_t        target,
+                                                     uint64_t                   token,
+                                                     dirwatcher_path_callback_t callback,
+                                                     void*                      user_data,
+                                                     uint64_t*                  new_token /* NULLABLE */);
+
 /*
     Opens a directory target and set callback and start watch
     Returns NULL on failure.
@@ -195,12 +720,95 @@ size_t dirwatcher_get_full_path_from_event_info(const dirwatcher_event_info_t* e
 */
 dirwatcher_error_t dirwatcher_get_target_error(dirwatcher_target_t target);
 
+/*
+    Publishes the target's events into a named shared-memory ring.
+    capacity is rounded up to a power of two; 0 uses DIRWATCHER_READER_DEFAULT_CAPACITY.
+    If name is NULL, stops publishing.
+
+    Returns false if the target is invalid or the ring already exists.
+*/
+bool dirwatcher_publish_target(dirwatcher_target_t target, const char* name /* NULLABLE */, uint32_t capacity);
+
+/*
+    Attaches to a ring published by another (or the same) process.
+    The reader starts at the ring's current head.
+    Returns NULL on failure.
+*/
+dirwatcher_reader_t dirwatcher_open_reader(const char* name);
+
+/*
+    Detaches a reader.
+    Returns false if the reader is invalid.
+*/
+bool dirwatcher_close_reader(dirwatcher_reader_t reader);
+
+/*
+    Reads the next event without blocking.
+    name_buf receives the name relative to the target, or full below an extra
+    directory (see Target Paths) (UTF-8), truncated to buf_len.
+    old_name_buf receives the previous name of a DIRWATCHER_EVENT_RENAMED event
+    and an empty string otherwise.
+
+    On DIRWATCHER_READ_OVERRUN, lost receives the count of skipped events and
+    the cursor is moved to the oldest event still in the ring.
+*/
+dirwatcher_read_result_t dirwatcher_read_event(dirwatcher_reader_t reader,
+                                               dirwatcher_event_t* event,
+                                               char*               name_buf,
+                                               size_t              buf_len,
+                                               char*               old_name_buf /* NULLABLE */,
+                                               size_t              old_buf_len,
+                                               uint64_t*           lost /* NULLABLE */);
+
+/*
+    Waits until an unread event is available or timeout_ms elapses.
+    Returns false on timeout or if the reader is invalid.
+*/
+bool dirwatcher_wait_reader(dirwatcher_reader_t reader, uint32_t timeout_ms);
+
+/*
+    Gets the full path of the publishing target.
+    If buf is NULL, returns required buffer length.
+*/
+size_t dirwatcher_get_reader_root_path(dirwatcher_reader_t reader, char* buf /* NULLABLE */, size_t buf_len);
+
+/*
+    Appends the target's events to segment files in dir (created if missing).
+    segment_size 0 uses DIRWATCHER_JOURNAL_DEFAULT_SEGMENT_SIZE.
+    If dir is NULL, closes the journal.
+
+    A journal write failure stops the journal only (see Event Journal).
+    Returns false if the target is invalid or the journal cannot be opened.
+*/
+bool dirwatcher_set_target_journal(dirwatcher_target_t target, const char* dir /* NULLABLE */, size_t segment_size);
+
+/*
+    Replays journaled events in sequence order through callback, from the
+    calling thread. event_info->target is set to target (which may be NULL),
+    and event_info->timestamp holds the recorded time.
+
+    If range is NULL, replays everything.
+    Returns false if dir cannot be read or a segment is corrupt.
+*/
+bool dirwatcher_replay_journal(const char*                       dir,
+                               const dirwatcher_journal_range_t* range    /* NULLABLE */,
+                               dirwatcher_target_t               target   /* NULLABLE */,
+                               dirwatcher_callback_t             callback,
+                               void*                             user_data,
+                               uint64_t*                         replayed /* NULLABLE */);
+
 #ifdef _WIN32
 /*
     Returns target's error code.
     if target is invalid, returns -1. 
 */
 long dirwatcher_get_target_win32_error(dirwatcher_target_t target);
+
+/*
+    Returns the Win32 error that stopped the target's journal, 0 if none.
+    if target is invalid, returns -1.
+*/
+long dirwatcher_get_target_journal_win32_error(dirwatcher_target_t target);
 #else
 #error DIRWATCHER: Platform not supported.
 #endif
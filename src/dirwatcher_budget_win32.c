@@ -0,0 +1,233 @@
+/* Includes *******************************************/
+
+#include <dirwatcher.h>
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dirwatcher_budget_win32.h"
+
+/* Defines ********************************************/
+
+#define DIRWATCHER_BUDGET_TOUCH_INTERVAL 1000 // ms an entry stays in place before activity moves it again
+
+/* Globals ********************************************/
+
+/*
+    Entries form one list ordered by activity, most recent at the head.
+    All state is guarded by _budget_lock; _dirwatcher_budget_touch() reads
+    _budget_head and _budget_limited without it, as hints.
+*/
+
+static SRWLOCK                              _budget_lock          = SRWLOCK_INIT;
+static _dirwatcher_budget_entry_t* volatile _budget_head          = NULL;
+static _dirwatcher_budget_entry_t*          _budget_tail          = NULL;
+static uint32_t                             _budget_native        = 0;
+static uint32_t                             _budget_max_native    = 0;   // 0: unlimited
+static volatile LONG                        _budget_cold_interval = DIRWATCHER_POLL_DEFAULT_COLD_INTERVAL;
+static volatile LONG                        _budget_limited       = 0;   // Non-zero while a budget is set
+
+/* Private functions **********************************/
+
+static void _unlink(_dirwatcher_budget_entry_t* entry)
+{
+    if (entry->prev)
+    {
+        entry->prev->next = entry->next;
+    }
+    else
+    {
+        _budget_head = entry->next;
+    }
+
+    if (entry->next)
+    {
+        entry->next->prev = entry->prev;
+    }
+    else
+    {
+        _budget_tail = entry->prev;
+    }
+
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+static void _link_head(_dirwatcher_budget_entry_t* entry)
+{
+    entry->prev = NULL;
+    entry->next = _budget_head;
+
+    if (_budget_head)
+    {
+        _budget_head->prev = entry;
+    }
+    else
+    {
+        _budget_tail = entry;
+    }
+
+    _budget_head = entry;
+}
+
+static bool _is_full(void)
+{
+    return _budget_max_native && _budget_native >= _budget_max_native;
+}
+
+/*
+    Demotes the least recently active native entry other than except.
+    Returns false if there is none.
+*/
+static bool _demote_coldest(const _dirwatcher_budget_entry_t* except)
+{
+    for (_dirwatcher_budget_entry_t* entry = _budget_tail; entry; entry = entry->prev)
+    {
+        if (entry != except && entry->native && entry->demotable)
+        {
+            entry->native = false;
+            _budget_native--;
+            entry->demote(entry->owner);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Public functions ***********************************/
+
+bool _dirwatcher_budget_register(_dirwatcher_budget_entry_t* entry, _dirwatcher_budget_demote_t demote, void* owner, bool demotable)
+{
+    AcquireSRWLockExclusive(&_budget_lock);
+
+    entry->demote     = demote;
+    entry->owner      = owner;
+    entry->demotable  = demotable;
+    entry->registered = true;
+    entry->native     = !_is_full() || _demote_coldest(entry) || !demotable;
+
+    if (entry->native)
+    {
+        _budget_native++;
+    }
+    else
+    {
+        demote(owner);
+    }
+
+    _link_head(entry);
+
+    ReleaseSRWLockExclusive(&_budget_lock);
+
+    return entry->native;
+}
+
+void _dirwatcher_budget_unregister(_dirwatcher_budget_entry_t* entry)
+{
+    AcquireSRWLockExclusive(&_budget_lock);
+
+    if (entry->registered)
+    {
+        if (entry->native)
+        {
+            _budget_native--;
+        }
+
+        _unlink(entry);
+
+        entry->native     = false;
+        entry->registered = false;
+    }
+
+    ReleaseSRWLockExclusive(&_budget_lock);
+}
+
+void _dirwatcher_budget_touch(_dirwatcher_budget_entry_t* entry)
+{
+    //
+    // Called for every dispatched batch: keep the process-wide lock off that path
+    // unless the order matters and has not been refreshed lately
+    //
+
+    if (!InterlockedCompareExchange(&_budget_limited, 0, 0) || _budget_head == entry)
+    {
+        return;
+    }
+
+    ULONGLONG now = GetTickCount64();
+
+    if (now - entry->touch_tick < DIRWATCHER_BUDGET_TOUCH_INTERVAL)
+    {
+        return;
+    }
+
+    entry->touch_tick = now;
+
+    AcquireSRWLockExclusive(&_budget_lock);
+
+    if (entry->registered && _budget_head != entry)
+    {
+        _unlink(entry);
+        _link_head(entry);
+    }
+
+    ReleaseSRWLockExclusive(&_budget_lock);
+}
+
+bool _dirwatcher_budget_promote(_dirwatcher_budget_entry_t* entry)
+{
+    bool promoted = false;
+
+    AcquireSRWLockExclusive(&_budget_lock);
+
+    if (entry->registered && !entry->native)
+    {
+        promoted = !_is_full() || _demote_coldest(entry);
+
+        if (promoted)
+        {
+            entry->native = true;
+            _budget_native++;
+        }
+
+        _unlink(entry);
+        _link_head(entry);
+    }
+
+    ReleaseSRWLockExclusive(&_budget_lock);
+
+    return promoted;
+}
+
+void _dirwatcher_budget_set(uint32_t max_native, uint32_t cold_interval_ms)
+{
+    AcquireSRWLockExclusive(&_budget_lock);
+
+    _budget_max_native = max_native;
+    InterlockedExchange(&_budget_cold_interval, (LONG)cold_interval_ms);
+    InterlockedExchange(&_budget_limited, max_native != 0);
+
+    while (_budget_max_native && _budget_native > _budget_max_native && _demote_coldest(NULL))
+    {
+        ;
+    }
+
+    ReleaseSRWLockExclusive(&_budget_lock);
+}
+
+DWORD _dirwatcher_budget_get_cold_interval(void)
+{
+    return (DWORD)InterlockedCompareExchange(&_budget_cold_interval, 0, 0);
+}
+
+void _dirwatcher_budget_get_usage(uint32_t* p_native, uint32_t* p_max_native)
+{
+    AcquireSRWLockShared(&_budget_lock);
+
+    *p_native     = _budget_native;
+    *p_max_native = _budget_max_native;
+
+    ReleaseSRWLockShared(&_budget_lock);
+}
@@ -0,0 +1,85 @@
+/*
+    DIRWATCHER_BUDGET_WIN32.H
+      Private interface of the process-wide watch budget
+
+    Every target that reads native notifications holds a directory handle,
+    a worker blocked in the kernel and a kernel notify buffer. The budget
+    caps how many targets do so at once. Targets are kept in least-recently-
+    active order; when the budget is exceeded, the least recently active
+    demotable target is told to switch to a low-frequency poll, and a
+    demoted target asks to be promoted back once its polls see activity.
+    A demoted target closes its notify handle, which frees the buffer.
+*/
+
+#ifndef DIRWATCHER_BUDGET_WIN32_H
+#define DIRWATCHER_BUDGET_WIN32_H
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct _dirwatcher_budget_entry _dirwatcher_budget_entry_t;
+
+/*
+    Called under the budget lock; must only set flags and cancel I/O.
+*/
+typedef void (*_dirwatcher_budget_demote_t)(void* owner);
+
+struct _dirwatcher_budget_entry
+{
+    _dirwatcher_budget_entry_t* prev;           // Towards the most recently active
+    _dirwatcher_budget_entry_t* next;           // Towards the least recently active
+    _dirwatcher_budget_demote_t demote;
+    void*                       owner;
+    bool                        demotable;      // False for targets that must stay native
+    bool                        native;         // Counted against the budget
+    bool                        registered;
+    ULONGLONG                   touch_tick;     // Of the last move by activity; owned by the caller of _dirwatcher_budget_touch
+};
+
+/*
+    Adds an entry as the most recently active. If the budget is full, the
+    least recently active demotable entry is demoted to make room; if there
+    is none, a demotable newcomer starts demoted: its demote callback is
+    called before this returns, under the same lock as later demotions.
+
+    Returns whether the entry may read native notifications.
+*/
+bool _dirwatcher_budget_register(_dirwatcher_budget_entry_t* entry, _dirwatcher_budget_demote_t demote, void* owner, bool demotable);
+
+/*
+    Removes an entry; safe to call more than once.
+*/
+void _dirwatcher_budget_unregister(_dirwatcher_budget_entry_t* entry);
+
+/*
+    Marks an entry as the most recently active. Cheap to call often: it
+    does nothing while no budget is set, and moves an entry at most once
+    per second.
+*/
+void _dirwatcher_budget_touch(_dirwatcher_budget_entry_t* entry);
+
+/*
+    Asks to read native notifications again, demoting the least recently
+    active other entry if the budget is full.
+    Returns false if no room could be made.
+*/
+bool _dirwatcher_budget_promote(_dirwatcher_budget_entry_t* entry);
+
+/*
+    Sets the number of native entries allowed (0: unlimited) and the poll
+    interval of demoted entries. Lowering the budget demotes immediately.
+*/
+void _dirwatcher_budget_set(uint32_t max_native, uint32_t cold_interval_ms);
+
+/*
+    Returns the poll interval of demoted entries in milliseconds.
+*/
+DWORD _dirwatcher_budget_get_cold_interval(void);
+
+/*
+    Returns the number of native entries and the budget (0: unlimited).
+*/
+void _dirwatcher_budget_get_usage(uint32_t* p_native, uint32_t* p_max_native);
+
+#endif
@@ -0,0 +1,327 @@
+/* Includes *******************************************/
+
+#include <dirwatcher.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dirwatcher_path_table.h"
+#include "dirwatcher_change_index.h"
+
+/* Defines ********************************************/
+
+#define DIRWATCHER_CHANGE_CLOCK_BITS 40
+#define DIRWATCHER_CHANGE_CLOCK_MASK ((1ULL << DIRWATCHER_CHANGE_CLOCK_BITS) - 1)
+#define DIRWATCHER_CHANGE_MIN_NODES  64
+
+/*
+    Layout:
+
+    - Paths are nodes of a path table. Nodes that were only created as
+      parents of changed paths have clock 0 and are not listed; they are
+      removed together with the last changed path below them.
+
+    - Changed nodes form a doubly linked list through older/newer, oldest
+      first. A change moves its node to the newest end.
+*/
+
+struct _dirwatcher_change_index
+{
+    _dirwatcher_path_table_t* table;
+    uint64_t*                 clock;        // Per node; clock of the last change, 0 if not changed
+    uint32_t*                 older;        // Per node
+    uint32_t*                 newer;        // Per node
+    uint32_t                  capacity;     // Entries of the per-node arrays
+    uint32_t                  oldest;
+    uint32_t                  newest;
+    uint32_t                  changed_count;
+    uint32_t                  max_paths;
+    uint64_t                  tag;          // Already shifted into the upper bits
+    uint64_t                  now;          // Clock of the latest change or expiry
+    uint64_t                  horizon;      // Oldest clock a token may hold
+};
+
+/* Private functions **********************************/
+
+/*
+    Grows the per-node arrays to cover every node id of the table.
+*/
+static bool _reserve(_dirwatcher_change_index_t* index)
+{
+    uint32_t bound = _dirwatcher_path_table_id_bound(index->table);
+
+    if (bound <= index->capacity)
+    {
+        return true;
+    }
+
+    uint32_t capacity = index->capacity;
+
+    while (capacity < bound)
+    {
+        capacity *= 2;
+    }
+
+    uint64_t* clock = realloc(index->clock, (size_t)capacity * sizeof(uint64_t));
+
+    if (!clock)
+    {
+        return false;
+    }
+
+    index->clock = clock;
+    memset(clock + index->capacity, 0, (size_t)(capacity - index->capacity) * sizeof(uint64_t));
+
+    uint32_t* older = realloc(index->older, (size_t)capacity * sizeof(uint32_t));
+
+    if (!older)
+    {
+        return false;
+    }
+
+    index->older = older;
+
+    uint32_t* newer = realloc(index->newer, (size_t)capacity * sizeof(uint32_t));
+
+    if (!newer)
+    {
+        return false;
+    }
+
+    index->newer    = newer;
+    index->capacity = capacity;
+
+    return true;
+}
+
+static void _unlink(_dirwatcher_change_index_t* index, uint32_t node)
+{
+    uint32_t older = index->older[node];
+    uint32_t newer = index->newer[node];
+
+    if (older != DIRWATCHER_PATH_NONE)
+    {
+        index->newer[older] = newer;
+    }
+    else
+    {
+        index->oldest = newer;
+    }
+
+    if (newer != DIRWATCHER_PATH_NONE)
+    {
+        index->older[newer] = older;
+    }
+    else
+    {
+        index->newest = older;
+    }
+}
+
+static void _link_newest(_dirwatcher_change_index_t* index, uint32_t node)
+{
+    index->older[node] = index->newest;
+    index->newer[node] = DIRWATCHER_PATH_NONE;
+
+    if (index->newest != DIRWATCHER_PATH_NONE)
+    {
+        index->newer[index->newest] = node;
+    }
+    else
+    {
+        index->oldest = node;
+    }
+
+    index->newest = node;
+}
+
+/*
+    Removes node and its unchanged ancestors once nothing changed lies below them.
+*/
+static void _prune(_dirwatcher_change_index_t* index, uint32_t node)
+{
+    while (node != DIRWATCHER_PATH_ROOT &&
+           node != DIRWATCHER_PATH_NONE &&
+           !index->clock[node] &&
+           _dirwatcher_path_table_first_child(index->table, node) == DIRWATCHER_PATH_NONE)
+    {
+        uint32_t parent = _dirwatcher_path_table_parent(index->table, node);
+
+        _dirwatcher_path_table_remove(index->table, node);
+        node = parent;
+    }
+}
+
+/*
+    Drops the least recently changed path; tokens from before its change are refused from now on.
+*/
+static void _drop_oldest(_dirwatcher_change_index_t* index)
+{
+    uint32_t node = index->oldest;
+
+    _unlink(index, node);
+
+    if (index->clock[node] > index->horizon)
+    {
+        index->horizon = index->clock[node];
+    }
+
+    index->clock[node] = 0;
+    index->changed_count--;
+
+    _prune(index, node);
+}
+
+/* Public functions ***********************************/
+
+_dirwatcher_change_index_t* _dirwatcher_change_index_create(uint32_t max_paths, uint32_t tag)
+{
+    _dirwatcher_change_index_t* index = calloc(1, sizeof(_dirwatcher_change_index_t));
+
+    if (!index)
+    {
+        return NULL;
+    }
+
+    index->table     = _dirwatcher_path_table_create(true);
+    index->capacity  = DIRWATCHER_CHANGE_MIN_NODES;
+    index->clock     = calloc(index->capacity, sizeof(uint64_t));
+    index->older     = malloc(index->capacity * sizeof(uint32_t));
+    index->newer     = malloc(index->capacity * sizeof(uint32_t));
+    index->oldest    = DIRWATCHER_PATH_NONE;
+    index->newest    = DIRWATCHER_PATH_NONE;
+    index->max_paths = max_paths;
+    index->tag       = (uint64_t)(tag & 0xFFFFFF) << DIRWATCHER_CHANGE_CLOCK_BITS;
+
+    if (!index->table || !index->clock || !index->older || !index->newer)
+    {
+        _dirwatcher_change_index_destroy(index);
+        return NULL;
+    }
+
+    return index;
+}
+
+void _dirwatcher_change_index_destroy(_dirwatcher_change_index_t* index)
+{
+    if (!index)
+    {
+        return;
+    }
+
+    _dirwatcher_path_table_destroy(index->table);
+    free(index->clock);
+    free(index->older);
+    free(index->newer);
+    free(index);
+}
+
+void _dirwatcher_change_index_record(_dirwatcher_change_index_t* index, const char* path)
+{
+    uint32_t node = _dirwatcher_path_table_insert_path(index->table, path);
+
+    if (node == DIRWATCHER_PATH_NONE || !_reserve(index) || index->now == DIRWATCHER_CHANGE_CLOCK_MASK)
+    {
+        _dirwatcher_change_index_expire(index);
+        return;
+    }
+
+    if (index->clock[node])
+    {
+        _unlink(index, node);
+    }
+    else
+    {
+        index->changed_count++;
+    }
+
+    index->clock[node] = ++index->now;
+    _link_newest(index, node);
+
+    while (index->changed_count > index->max_paths)
+    {
+        _drop_oldest(index);
+    }
+}
+
+void _dirwatcher_change_index_expire(_dirwatcher_change_index_t* index)
+{
+    while (index->changed_count)
+    {
+        _drop_oldest(index);
+    }
+
+    //
+    // A clock that ran out starts over under the next tag, which refuses every earlier token
+    //
+
+    if (index->now == DIRWATCHER_CHANGE_CLOCK_MASK)
+    {
+        index->now = 0;
+        index->tag = index->tag + (1ULL << DIRWATCHER_CHANGE_CLOCK_BITS);
+
+        if (!index->tag)
+        {
+            index->tag = 1ULL << DIRWATCHER_CHANGE_CLOCK_BITS;
+        }
+    }
+
+    index->horizon = ++index->now;
+}
+
+uint64_t _dirwatcher_change_index_token(const _dirwatcher_change_index_t* index)
+{
+    return index->tag | index->now;
+}
+
+dirwatcher_changes_result_t _dirwatcher_change_index_since(const _dirwatcher_change_index_t* index,
+                                                           uint64_t                          token,
+                                                           dirwatcher_path_callback_t        callback,
+                                                           void*                             user_data,
+                                                           uint64_t*                         p_new_token)
+{
+    uint64_t clock    = token & DIRWATCHER_CHANGE_CLOCK_MASK;
+    char*    path     = NULL;
+    size_t   path_len = 0;
+
+    *p_new_token = _dirwatcher_change_index_token(index);
+
+    if ((token & ~DIRWATCHER_CHANGE_CLOCK_MASK) != index->tag ||
+        clock < index->horizon ||
+        clock > index->now)
+    {
+        return DIRWATCHER_CHANGES_EXPIRED;
+    }
+
+    for (uint32_t node = index->newest; node != DIRWATCHER_PATH_NONE && index->clock[node] > clock; node = index->older[node])
+    {
+        size_t required = _dirwatcher_path_table_build_path(index->table, node, NULL, 0);
+
+        if (required > path_len)
+        {
+            char* grown = realloc(path, required);
+
+            if (!grown)
+            {
+                //
+                // Paths already reported are a subset; the caller rescans
+                //
+
+                free(path);
+                return DIRWATCHER_CHANGES_EXPIRED;
+            }
+
+            path     = grown;
+            path_len = required;
+        }
+
+        _dirwatcher_path_table_build_path(index->table, node, path, path_len);
+        callback(path, user_data);
+    }
+
+    free(path);
+
+    return DIRWATCHER_CHANGES_OK;
+}
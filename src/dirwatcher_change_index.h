@@ -0,0 +1,72 @@
+/*
+    DIRWATCHER_CHANGE_INDEX.H
+      Private index of changed paths by logical clock
+
+    Every recorded path ticks the clock and is stamped with it. Changed paths
+    live in a path table and in one list ordered by their last change, so a
+    query walks only the paths changed after the token's clock, newest first,
+    each once.
+
+    Paths compare without the case of ASCII letters, as the file system
+    does, so a file touched as "a.txt" and "A.TXT" is listed once, in the
+    case its components were first recorded with. Other letters compare
+    exactly.
+
+    A token is the index tag (upper 24 bits) and a clock (lower 40 bits).
+    The horizon is the oldest clock a token may hold; it moves forward when
+    the index drops entries (capacity, expiry), so older tokens are refused
+    instead of silently missing changes.
+
+    Not thread-safe; the owner serializes access.
+*/
+
+#ifndef DIRWATCHER_CHANGE_INDEX_H
+#define DIRWATCHER_CHANGE_INDEX_H
+
+#include <dirwatcher.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct _dirwatcher_change_index _dirwatcher_change_index_t;
+
+/*
+    Creates an index holding at most max_paths changed paths. tag (24 bits,
+    non-zero) tells its tokens apart from those of other indexes.
+    Returns NULL on failure.
+*/
+_dirwatcher_change_index_t* _dirwatcher_change_index_create(uint32_t max_paths, uint32_t tag);
+
+void _dirwatcher_change_index_destroy(_dirwatcher_change_index_t* index);
+
+/*
+    Stamps path (relative to the root) with the next clock. Past max_paths,
+    the least recently changed path is dropped. If the path cannot be stored,
+    the index expires instead.
+*/
+void _dirwatcher_change_index_record(_dirwatcher_change_index_t* index, const char* path);
+
+/*
+    Refuses every token issued so far; for changes that were lost.
+*/
+void _dirwatcher_change_index_expire(_dirwatcher_change_index_t* index);
+
+/*
+    Returns the token for the current clock.
+*/
+uint64_t _dirwatcher_change_index_token(const _dirwatcher_change_index_t* index);
+
+/*
+    Calls callback for every path changed after token, newest first.
+    *p_new_token receives the token for the current clock.
+
+    Returns DIRWATCHER_CHANGES_EXPIRED, without calling callback, if token is
+    not from this index or older than the horizon.
+*/
+dirwatcher_changes_result_t _dirwatcher_change_index_since(const _dirwatcher_change_index_t* index,
+                                                           uint64_t                          token,
+                                                           dirwatcher_path_callback_t        callback,
+                                                           void*                             user_data,
+                                                           uint64_t*                         p_new_token);
+
+#endif
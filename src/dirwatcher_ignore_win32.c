@@ -0,0 +1,892 @@
+/* Includes *******************************************/
+
+#include <dirwatcher.h>
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+
+#include "dirwatcher_ignore_win32.h"
+
+/* Defines ********************************************/
+
+#define DIRWATCHER_IGNORE_NONE     UINT32_MAX
+#define DIRWATCHER_IGNORE_MAX_FILE (1024 * 1024)   // Bytes of an ignore file that are read
+#define DIRWATCHER_IGNORE_MIN_DIRS 64
+
+/*
+    Ignore files of a directory, in ascending precedence.
+*/
+static const wchar_t* const _ignore_file_names[] = { L".gitignore", L".ignore" };
+
+typedef struct _dirwatcher_ignore_rule
+{
+    wchar_t* pattern;           // Folded, '/' separated; without '!', the leading '/' and the trailing '/'
+    bool     negate;
+    bool     dir_only;
+    bool     anchored;          // Matched against the path below the directory, not only the final component
+} _dirwatcher_ignore_rule_t;
+
+typedef struct _dirwatcher_ignore_dir
+{
+    wchar_t*                   path;        // Folded, null termed, relative to the root ("" for the root)
+    uint32_t                   path_count;
+    uint32_t                   hash;
+    uint32_t                   parent;      // DIRWATCHER_IGNORE_NONE for the root
+    _dirwatcher_ignore_rule_t* rules;       // .gitignore then .ignore, in file order
+    uint32_t                   rule_count;
+    uint32_t                   rule_capacity;
+    bool                       loaded;
+    int8_t                     ignored;     // -1: not decided yet
+} _dirwatcher_ignore_dir_t;
+
+struct _dirwatcher_ignore
+{
+    wchar_t*                  root_path;
+    _dirwatcher_ignore_dir_t* dirs;
+    uint32_t                  dir_count;
+    uint32_t                  dir_capacity;
+    uint32_t*                 buckets;          // Dir index + 1 by path hash; 0 is empty
+    uint32_t                  mask;
+    wchar_t*                  scratch;          // Folded path being matched
+    uint32_t                  scratch_capacity;
+};
+
+/* Private functions **********************************/
+
+static wchar_t _fold(wchar_t c)
+{
+    return (wchar_t)towlower(c);
+}
+
+static uint32_t _hash_path(const wchar_t* path, uint32_t count)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        hash ^= (uint32_t)path[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t _last_separator(const wchar_t* path, uint32_t count)
+{
+    for (uint32_t i = count; i-- > 0; )
+    {
+        if (path[i] == L'\\')
+        {
+            return i;
+        }
+    }
+
+    return DIRWATCHER_IGNORE_NONE;
+}
+
+static bool _reserve_scratch(_dirwatcher_ignore_t* ignore, uint32_t count)
+{
+    if (count <= ignore->scratch_capacity)
+    {
+        return true;
+    }
+
+    wchar_t* scratch = realloc(ignore->scratch, (size_t)count * 2 * sizeof(wchar_t));
+
+    if (!scratch)
+    {
+        return false;
+    }
+
+    ignore->scratch          = scratch;
+    ignore->scratch_capacity = count * 2;
+
+    return true;
+}
+
+static void _free_rules(_dirwatcher_ignore_dir_t* dir)
+{
+    for (uint32_t i = 0; i < dir->rule_count; i++)
+    {
+        free(dir->rules[i].pattern);
+    }
+
+    free(dir->rules);
+
+    dir->rules         = NULL;
+    dir->rule_count    = 0;
+    dir->rule_capacity = 0;
+}
+
+static void _reset_decisions(_dirwatcher_ignore_t* ignore)
+{
+    for (uint32_t i = 0; i < ignore->dir_count; i++)
+    {
+        ignore->dirs[i].ignored = -1;
+    }
+}
+
+/* Directory cache ************************************/
+
+static uint32_t _find_dir(const _dirwatcher_ignore_t* ignore, const wchar_t* path, uint32_t count)
+{
+    uint32_t hash = _hash_path(path, count);
+
+    for (uint32_t i = hash & ignore->mask; ignore->buckets[i]; i = (i + 1) & ignore->mask)
+    {
+        const _dirwatcher_ignore_dir_t* dir = &ignore->dirs[ignore->buckets[i] - 1];
+
+        if (dir->hash == hash && dir->path_count == count && wmemcmp(dir->path, path, count) == 0)
+        {
+            return ignore->buckets[i] - 1;
+        }
+    }
+
+    return DIRWATCHER_IGNORE_NONE;
+}
+
+static void _bucket_insert(uint32_t* buckets, uint32_t mask, uint32_t hash, uint32_t index)
+{
+    uint32_t i = hash & mask;
+
+    while (buckets[i])
+    {
+        i = (i + 1) & mask;
+    }
+
+    buckets[i] = index + 1;
+}
+
+static bool _rehash(_dirwatcher_ignore_t* ignore, uint32_t bucket_count)
+{
+    uint32_t* buckets = calloc(bucket_count, sizeof(uint32_t));
+
+    if (!buckets)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < ignore->dir_count; i++)
+    {
+        _bucket_insert(buckets, bucket_count - 1, ignore->dirs[i].hash, i);
+    }
+
+    free(ignore->buckets);
+
+    ignore->buckets = buckets;
+    ignore->mask    = bucket_count - 1;
+
+    return true;
+}
+
+/*
+    Drops the entries of a folded directory path and its subtree. The rest
+    keep their creation order, so parents still precede their children.
+*/
+static void _drop_subtree(_dirwatcher_ignore_t* ignore, const wchar_t* path, uint32_t count)
+{
+    uint32_t* remap = malloc((size_t)ignore->dir_count * sizeof(uint32_t));
+
+    if (!remap)
+    {
+        return;
+    }
+
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < ignore->dir_count; i++)
+    {
+        _dirwatcher_ignore_dir_t* dir = &ignore->dirs[i];
+
+        if (dir->path_count >= count &&
+            wmemcmp(dir->path, path, count) == 0 &&
+            (dir->path_count == count || dir->path[count] == L'\\'))
+        {
+            _free_rules(dir);
+            free(dir->path);
+
+            remap[i] = DIRWATCHER_IGNORE_NONE;
+            continue;
+        }
+
+        if (dir->parent != DIRWATCHER_IGNORE_NONE)
+        {
+            dir->parent = remap[dir->parent];
+        }
+
+        remap[i]             = kept;
+        ignore->dirs[kept++] = *dir;
+    }
+
+    free(remap);
+
+    ignore->dir_count = kept;
+
+    //
+    // Rebuild the buckets in place
+    //
+
+    memset(ignore->buckets, 0, ((size_t)ignore->mask + 1) * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < ignore->dir_count; i++)
+    {
+        _bucket_insert(ignore->buckets, ignore->mask, ignore->dirs[i].hash, i);
+    }
+}
+
+/*
+    Returns the cache entry of a folded directory path, creating it and its parents if needed.
+*/
+static uint32_t _get_dir(_dirwatcher_ignore_t* ignore, const wchar_t* path, uint32_t count)
+{
+    uint32_t index = _find_dir(ignore, path, count);
+
+    if (index != DIRWATCHER_IGNORE_NONE)
+    {
+        return index;
+    }
+
+    uint32_t separator = _last_separator(path, count);
+    uint32_t parent    = _get_dir(ignore, path, separator == DIRWATCHER_IGNORE_NONE ? 0 : separator);
+
+    if (parent == DIRWATCHER_IGNORE_NONE)
+    {
+        return DIRWATCHER_IGNORE_NONE;
+    }
+
+    //
+    // Make room: bucket load <= 1/2, entries
+    //
+
+    if ((ignore->dir_count + 1) * 2 > ignore->mask + 1 && !_rehash(ignore, (ignore->mask + 1) * 2))
+    {
+        return DIRWATCHER_IGNORE_NONE;
+    }
+
+    if (ignore->dir_count == ignore->dir_capacity)
+    {
+        _dirwatcher_ignore_dir_t* dirs = realloc(ignore->dirs, (size_t)ignore->dir_capacity * 2 * sizeof(_dirwatcher_ignore_dir_t));
+
+        if (!dirs)
+        {
+            return DIRWATCHER_IGNORE_NONE;
+        }
+
+        ignore->dirs          = dirs;
+        ignore->dir_capacity *= 2;
+    }
+
+    wchar_t* copy = malloc(((size_t)count + 1) * sizeof(wchar_t));
+
+    if (!copy)
+    {
+        return DIRWATCHER_IGNORE_NONE;
+    }
+
+    wmemcpy(copy, path, count);
+    copy[count] = L'\0';
+
+    index = ignore->dir_count++;
+
+    _dirwatcher_ignore_dir_t* dir = &ignore->dirs[index];
+
+    memset(dir, 0, sizeof(*dir));
+    dir->path       = copy;
+    dir->path_count = count;
+    dir->hash       = _hash_path(path, count);
+    dir->parent     = parent;
+    dir->ignored    = -1;
+
+    _bucket_insert(ignore->buckets, ignore->mask, dir->hash, index);
+
+    return index;
+}
+
+/* Rules **********************************************/
+
+/*
+    Compiles one line of an ignore file. Returns false on allocation failure.
+*/
+static bool _add_rule(_dirwatcher_ignore_dir_t* dir, const wchar_t* line, uint32_t len)
+{
+    _dirwatcher_ignore_rule_t rule = { 0 };
+
+    while (len && line[len - 1] == L'\r')
+    {
+        len--;
+    }
+
+    //
+    // Trailing spaces are dropped unless escaped
+    //
+
+    while (len && line[len - 1] == L' ' && !(len >= 2 && line[len - 2] == L'\\'))
+    {
+        len--;
+    }
+
+    if (!len || line[0] == L'#')
+    {
+        return true;
+    }
+
+    if (line[0] == L'!')
+    {
+        rule.negate = true;
+        line++;
+        len--;
+    }
+
+    if (len && line[len - 1] == L'/')
+    {
+        rule.dir_only = true;
+        len--;
+    }
+
+    if (len && line[0] == L'/')
+    {
+        rule.anchored = true;
+        line++;
+        len--;
+    }
+    else
+    {
+        rule.anchored = wmemchr(line, L'/', len) != NULL;
+    }
+
+    if (!len)
+    {
+        return true;
+    }
+
+    if (dir->rule_count == dir->rule_capacity)
+    {
+        uint32_t                   capacity = dir->rule_capacity ? dir->rule_capacity * 2 : 8;
+        _dirwatcher_ignore_rule_t* rules    = realloc(dir->rules, (size_t)capacity * sizeof(_dirwatcher_ignore_rule_t));
+
+        if (!rules)
+        {
+            return false;
+        }
+
+        dir->rules         = rules;
+        dir->rule_capacity = capacity;
+    }
+
+    rule.pattern = malloc(((size_t)len + 1) * sizeof(wchar_t));
+
+    if (!rule.pattern)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        rule.pattern[i] = _fold(line[i]);
+    }
+
+    rule.pattern[len] = L'\0';
+
+    dir->rules[dir->rule_count++] = rule;
+    return true;
+}
+
+/*
+    Appends the rules of one ignore file of dir; a missing file has none.
+*/
+static void _load_file(const _dirwatcher_ignore_t* ignore, _dirwatcher_ignore_dir_t* dir, const wchar_t* file_name)
+{
+    size_t   root_count = wcslen(ignore->root_path);
+    size_t   name_count = wcslen(file_name);
+    wchar_t* path       = malloc((root_count + 1 + dir->path_count + 1 + name_count + 1) * sizeof(wchar_t));
+
+    if (!path)
+    {
+        return;
+    }
+
+    wchar_t* cur = path;
+
+    wmemcpy(cur, ignore->root_path, root_count);
+    cur += root_count;
+
+    if (dir->path_count)
+    {
+        *cur++ = L'\\';
+        wmemcpy(cur, dir->path, dir->path_count);
+        cur += dir->path_count;
+    }
+
+    *cur++ = L'\\';
+    wmemcpy(cur, file_name, name_count + 1);
+
+    HANDLE handle = CreateFileW(path,
+                                GENERIC_READ,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                NULL,
+                                OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL,
+                                NULL);
+
+    free(path);
+
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    //
+    // Read and decode the whole file (UTF-8, optional BOM)
+    //
+
+    BYTE*    bytes      = malloc(DIRWATCHER_IGNORE_MAX_FILE);
+    DWORD    byte_count = 0;
+    wchar_t* text       = NULL;
+    int      text_count = 0;
+
+    if (bytes && ReadFile(handle, bytes, DIRWATCHER_IGNORE_MAX_FILE, &byte_count, NULL))
+    {
+        DWORD skip = byte_count >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF ? 3 : 0;
+
+        text_count = byte_count > skip ? MultiByteToWideChar(CP_UTF8, 0, (const char*)bytes + skip, (int)(byte_count - skip), NULL, 0) : 0;
+        text       = text_count > 0 ? malloc((size_t)text_count * sizeof(wchar_t)) : NULL;
+
+        if (text)
+        {
+            MultiByteToWideChar(CP_UTF8, 0, (const char*)bytes + skip, (int)(byte_count - skip), text, text_count);
+        }
+    }
+
+    CloseHandle(handle);
+    free(bytes);
+
+    //
+    // One rule per line
+    //
+
+    for (int begin = 0, i = 0; text && i <= text_count; i++)
+    {
+        if (i == text_count || text[i] == L'\n')
+        {
+            if (!_add_rule(dir, text + begin, (uint32_t)(i - begin)))
+            {
+                break;
+            }
+
+            begin = i + 1;
+        }
+    }
+
+    free(text);
+}
+
+static void _ensure_rules(_dirwatcher_ignore_t* ignore, uint32_t index)
+{
+    _dirwatcher_ignore_dir_t* dir = &ignore->dirs[index];
+
+    if (dir->loaded)
+    {
+        return;
+    }
+
+    _free_rules(dir);
+
+    for (size_t i = 0; i < sizeof(_ignore_file_names) / sizeof(_ignore_file_names[0]); i++)
+    {
+        _load_file(ignore, dir, _ignore_file_names[i]);
+    }
+
+    dir->loaded = true;
+}
+
+/* Matching *******************************************/
+
+/*
+    Matches c against the class starting at p ('['). *p_end receives the
+    pattern position after the class. An unterminated class is a literal '['.
+*/
+static bool _match_class(const wchar_t* p, wchar_t c, const wchar_t** p_end)
+{
+    const wchar_t* q       = p + 1;
+    bool           negate  = *q == L'!' || *q == L'^';
+    bool           matched = false;
+
+    if (negate)
+    {
+        q++;
+    }
+
+    for (bool first = true; *q && (*q != L']' || first); first = false)
+    {
+        wchar_t lo = *q == L'\\' && q[1] ? *++q : *q;
+        wchar_t hi = lo;
+
+        if (q[1] == L'-' && q[2] && q[2] != L']')
+        {
+            hi  = q[2];
+            q  += 2;
+        }
+
+        matched = matched || (c >= lo && c <= hi);
+        q++;
+    }
+
+    if (!*q)
+    {
+        *p_end = p + 1;
+        return c == L'[';
+    }
+
+    *p_end = q + 1;
+    return matched != negate;
+}
+
+/*
+    Matches a folded subject ('\' separated) against a pattern ('/' separated).
+    '*' and '?' stop at separators; "**" spans them when it is a whole segment.
+*/
+static bool _glob(const wchar_t* pattern, const wchar_t* p, const wchar_t* s)
+{
+    while (*p)
+    {
+        bool segment_start = p == pattern || p[-1] == L'/';
+
+        if (p[0] == L'*' && p[1] == L'*' && segment_start && (p[2] == L'/' || !p[2]))
+        {
+            if (!p[2])
+            {
+                return true;
+            }
+
+            //
+            // "**/": zero or more whole directories
+            //
+
+            for (;;)
+            {
+                if (_glob(pattern, p + 3, s))
+                {
+                    return true;
+                }
+
+                s = wcschr(s, L'\\');
+
+                if (!s)
+                {
+                    return false;
+                }
+
+                s++;
+            }
+        }
+
+        switch (*p)
+        {
+        case L'*':
+            while (p[1] == L'*')
+            {
+                p++;
+            }
+
+            for (;; s++)
+            {
+                if (_glob(pattern, p + 1, s))
+                {
+                    return true;
+                }
+
+                if (!*s || *s == L'\\')
+                {
+                    return false;
+                }
+            }
+
+        case L'?':
+            if (!*s || *s == L'\\')
+            {
+                return false;
+            }
+
+            p++;
+            s++;
+            break;
+
+        case L'[':
+            if (!*s || *s == L'\\' || !_match_class(p, *s, &p))
+            {
+                return false;
+            }
+
+            s++;
+            break;
+
+        case L'/':
+            if (*s != L'\\')
+            {
+                return false;
+            }
+
+            p++;
+            s++;
+            break;
+
+        case L'\\':
+            if (p[1])
+            {
+                p++;
+            }
+
+            /* fall through */
+
+        default:
+            if (*s != *p)
+            {
+                return false;
+            }
+
+            p++;
+            s++;
+            break;
+        }
+    }
+
+    return !*s;
+}
+
+/*
+    Finds the rule deciding path (folded, relative to the root) among the
+    rules of dir and its ancestors, deepest directory and last rule first.
+    Returns true if that rule ignores path.
+*/
+static bool _evaluate(_dirwatcher_ignore_t* ignore, uint32_t dir, const wchar_t* path, uint32_t path_count, bool is_dir)
+{
+    uint32_t       separator = _last_separator(path, path_count);
+    const wchar_t* name      = separator == DIRWATCHER_IGNORE_NONE ? path : path + separator + 1;
+
+    for (uint32_t d = dir; d != DIRWATCHER_IGNORE_NONE; d = ignore->dirs[d].parent)
+    {
+        _ensure_rules(ignore, d);
+
+        const _dirwatcher_ignore_dir_t* entry = &ignore->dirs[d];
+        const wchar_t*                  below = entry->path_count ? path + entry->path_count + 1 : path;
+
+        for (uint32_t r = entry->rule_count; r-- > 0; )
+        {
+            const _dirwatcher_ignore_rule_t* rule = &entry->rules[r];
+
+            if (rule->dir_only && !is_dir)
+            {
+                continue;
+            }
+
+            if (_glob(rule->pattern, rule->pattern, rule->anchored ? below : name))
+            {
+                return !rule->negate;
+            }
+        }
+    }
+
+    return false;
+}
+
+/*
+    Returns whether a cached directory is ignored, deciding its ancestors first.
+*/
+static bool _is_dir_ignored(_dirwatcher_ignore_t* ignore, uint32_t index)
+{
+    if (ignore->dirs[index].ignored < 0)
+    {
+        uint32_t parent  = ignore->dirs[index].parent;
+        bool     ignored = parent != DIRWATCHER_IGNORE_NONE &&
+                           (_is_dir_ignored(ignore, parent) ||
+                            _evaluate(ignore, parent, ignore->dirs[index].path, ignore->dirs[index].path_count, true));
+
+        ignore->dirs[index].ignored = ignored ? 1 : 0;
+    }
+
+    return ignore->dirs[index].ignored > 0;
+}
+
+/* Public functions ***********************************/
+
+_dirwatcher_ignore_t* _dirwatcher_ignore_create(const wchar_t* root_path)
+{
+    _dirwatcher_ignore_t* ignore = calloc(1, sizeof(_dirwatcher_ignore_t));
+
+    if (!ignore)
+    {
+        return NULL;
+    }
+
+    ignore->root_path    = _wcsdup(root_path);
+    ignore->dir_capacity = DIRWATCHER_IGNORE_MIN_DIRS;
+    ignore->dirs         = malloc(ignore->dir_capacity * sizeof(_dirwatcher_ignore_dir_t));
+    ignore->mask         = DIRWATCHER_IGNORE_MIN_DIRS * 2 - 1;
+    ignore->buckets      = calloc((size_t)ignore->mask + 1, sizeof(uint32_t));
+
+    if (!ignore->root_path || !ignore->dirs || !ignore->buckets)
+    {
+        _dirwatcher_ignore_destroy(ignore);
+        return NULL;
+    }
+
+    //
+    // Root: no parent, never ignored
+    //
+
+    ignore->dirs[0].path = _wcsdup(L"");
+
+    if (!ignore->dirs[0].path)
+    {
+        _dirwatcher_ignore_destroy(ignore);
+        return NULL;
+    }
+
+    ignore->dirs[0].path_count    = 0;
+    ignore->dirs[0].hash          = _hash_path(L"", 0);
+    ignore->dirs[0].parent        = DIRWATCHER_IGNORE_NONE;
+    ignore->dirs[0].rules         = NULL;
+    ignore->dirs[0].rule_count    = 0;
+    ignore->dirs[0].rule_capacity = 0;
+    ignore->dirs[0].loaded        = false;
+    ignore->dirs[0].ignored       = 0;
+    ignore->dir_count             = 1;
+
+    _bucket_insert(ignore->buckets, ignore->mask, ignore->dirs[0].hash, 0);
+
+    return ignore;
+}
+
+void _dirwatcher_ignore_destroy(_dirwatcher_ignore_t* ignore)
+{
+    if (!ignore)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < ignore->dir_count; i++)
+    {
+        _free_rules(&ignore->dirs[i]);
+        free(ignore->dirs[i].path);
+    }
+
+    free(ignore->root_path);
+    free(ignore->dirs);
+    free(ignore->buckets);
+    free(ignore->scratch);
+    free(ignore);
+}
+
+bool _dirwatcher_ignore_match_child(_dirwatcher_ignore_t* ignore,
+                                    const wchar_t*        dir,
+                                    uint32_t              dir_count,
+                                    const wchar_t*        name,
+                                    uint32_t              name_count,
+                                    bool                  is_dir)
+{
+    uint32_t count = dir_count + (dir_count ? 1 : 0) + name_count;
+
+    if (!name_count || !_reserve_scratch(ignore, count + 1))
+    {
+        return false;
+    }
+
+    //
+    // Fold "dir\name" into the scratch buffer
+    //
+
+    wchar_t* cur = ignore->scratch;
+
+    for (uint32_t i = 0; i < dir_count; i++)
+    {
+        *cur++ = _fold(dir[i]);
+    }
+
+    if (dir_count)
+    {
+        *cur++ = L'\\';
+    }
+
+    for (uint32_t i = 0; i < name_count; i++)
+    {
+        *cur++ = _fold(name[i]);
+    }
+
+    *cur = L'\0';
+
+    uint32_t index = _get_dir(ignore, ignore->scratch, dir_count);
+
+    if (index == DIRWATCHER_IGNORE_NONE)
+    {
+        return false;
+    }
+
+    return _is_dir_ignored(ignore, index) || _evaluate(ignore, index, ignore->scratch, count, is_dir);
+}
+
+bool _dirwatcher_ignore_match(_dirwatcher_ignore_t* ignore, const wchar_t* path, uint32_t path_count, bool is_dir)
+{
+    uint32_t separator = _last_separator(path, path_count);
+
+    if (separator == DIRWATCHER_IGNORE_NONE)
+    {
+        return _dirwatcher_ignore_match_child(ignore, path, 0, path, path_count, is_dir);
+    }
+
+    return _dirwatcher_ignore_match_child(ignore, path, separator, path + separator + 1, path_count - separator - 1, is_dir);
+}
+
+void _dirwatcher_ignore_notify(_dirwatcher_ignore_t* ignore, const wchar_t* path, uint32_t path_count, bool removed)
+{
+    uint32_t separator = _last_separator(path, path_count);
+    uint32_t dir_count = separator == DIRWATCHER_IGNORE_NONE ? 0 : separator;
+    uint32_t name_at   = separator == DIRWATCHER_IGNORE_NONE ? 0 : separator + 1;
+
+    if (!_reserve_scratch(ignore, path_count + 1))
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < path_count; i++)
+    {
+        ignore->scratch[i] = _fold(path[i]);
+    }
+
+    ignore->scratch[path_count] = L'\0';
+
+    //
+    // An ignore file changed: reload its directory's rules
+    //
+
+    for (size_t i = 0; i < sizeof(_ignore_file_names) / sizeof(_ignore_file_names[0]); i++)
+    {
+        if (wcscmp(ignore->scratch + name_at, _ignore_file_names[i]) == 0)
+        {
+            uint32_t index = _find_dir(ignore, ignore->scratch, dir_count);
+
+            if (index != DIRWATCHER_IGNORE_NONE)
+            {
+                ignore->dirs[index].loaded = false;
+                _reset_decisions(ignore);
+            }
+
+            return;
+        }
+    }
+
+    //
+    // A cached directory went away: forget its subtree, so that the cache
+    // only holds live directories and one created in its place starts over
+    // with its own ignore files. The decisions left do not depend on it.
+    //
+
+    if (removed && path_count && _find_dir(ignore, ignore->scratch, path_count) != DIRWATCHER_IGNORE_NONE)
+    {
+        _drop_subtree(ignore, ignore->scratch, path_count);
+    }
+}
@@ -0,0 +1,59 @@
+/*
+    DIRWATCHER_IGNORE_WIN32.H
+      Private matcher of .gitignore / .ignore rules
+
+    Rules are compiled per directory on first use and cached with the
+    decision whether the directory itself is ignored, so matching a path
+    costs one lookup of its directory plus the rules that can apply to its
+    final component. Paths are relative to the root, with backslash
+    separators, and need not be null termed: events are matched straight
+    from the notify buffer, before their names are converted.
+
+    Matching is case-insensitive, like the file systems it serves.
+
+    Not thread-safe; the owner serializes access.
+*/
+
+#ifndef DIRWATCHER_IGNORE_WIN32_H
+#define DIRWATCHER_IGNORE_WIN32_H
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct _dirwatcher_ignore _dirwatcher_ignore_t;
+
+/*
+    Creates a matcher for the tree at root_path (full path).
+    Returns NULL on failure.
+*/
+_dirwatcher_ignore_t* _dirwatcher_ignore_create(const wchar_t* root_path);
+
+void _dirwatcher_ignore_destroy(_dirwatcher_ignore_t* ignore);
+
+/*
+    Returns true if path is ignored, by its own rules or as part of an
+    ignored directory. is_dir tells that path is known to be a directory;
+    directory-only rules ("build/") do not apply otherwise.
+    Returns false if the rules cannot be loaded.
+*/
+bool _dirwatcher_ignore_match(_dirwatcher_ignore_t* ignore, const wchar_t* path, uint32_t path_count, bool is_dir);
+
+/*
+    Same as _dirwatcher_ignore_match for name inside directory dir ("" for the root).
+*/
+bool _dirwatcher_ignore_match_child(_dirwatcher_ignore_t* ignore,
+                                    const wchar_t*        dir,
+                                    uint32_t              dir_count,
+                                    const wchar_t*        name,
+                                    uint32_t              name_count,
+                                    bool                  is_dir);
+
+/*
+    Drops cached rules that a change of path may have made stale: those of
+    its directory if path is an ignore file. The cache entries of path's
+    subtree are dropped if path was removed or renamed away.
+*/
+void _dirwatcher_ignore_notify(_dirwatcher_ignore_t* ignore, const wchar_t* path, uint32_t path_count, bool removed);
+
+#endif
@@ -0,0 +1,870 @@
+/* Includes *******************************************/
+
+#include <dirwatcher.h>
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strsafe.h>
+
+#include "dirwatcher_journal_win32.h"
+
+/* Defines ********************************************/
+
+#define DIRWATCHER_JOURNAL_MAGIC_NUMBER    0x314C4E524A574444ULL // 'DDWJRNL1'
+#define DIRWATCHER_JOURNAL_VERSION         2   // 2: rename records
+#define DIRWATCHER_JOURNAL_MIN_SEGMENT     (256 * 1024)
+#define DIRWATCHER_JOURNAL_EXTENSION       ".dwj"
+#define DIRWATCHER_JOURNAL_PATTERN         "\\*" DIRWATCHER_JOURNAL_EXTENSION
+#define DIRWATCHER_JOURNAL_FILE_NAME_LEN   (16 + sizeof(DIRWATCHER_JOURNAL_EXTENSION)) // hex first_seq + ext + null
+#define DIRWATCHER_JOURNAL_ALIGN(x)        (((x) + 7) & ~(size_t)7)
+
+/*
+    Segment layout (all records 8-byte aligned):
+
+        header | root path | record | record | ...
+
+    A path record interns one name and gives it the next path id of the
+    segment. An event record refers to a path id; its sequence number is
+    implicit (header.first_seq + index of the event in the segment). Segments
+    are self-contained: path ids restart at 0 in every segment.
+
+    Segment files are named after their first sequence number in fixed-width
+    hex, so lexical order is sequence order.
+*/
+
+typedef enum _dirwatcher_journal_record_type
+{
+    DIRWATCHER_JOURNAL_RECORD_PATH   = 1,
+    DIRWATCHER_JOURNAL_RECORD_EVENT  = 2,
+    DIRWATCHER_JOURNAL_RECORD_RENAME = 3     // Event record followed by the old name's path id
+} _dirwatcher_journal_record_type_t;
+
+typedef struct _dirwatcher_journal_header
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t header_size;       // Byte-size including root path, 8-aligned
+    uint64_t first_seq;         // Sequence number of the first event in this segment
+    uint64_t event_count;
+    uint64_t first_time;        // FILETIME of the first event
+    uint64_t last_time;         // FILETIME of the last event
+    uint64_t used_bytes;        // Valid bytes including header; updated after every record
+    uint32_t root_path_len;     // Excluding null-terminator
+    uint32_t reserved;
+    char     root_path[];       // UTF-8, null termed
+} _dirwatcher_journal_header_t;
+
+typedef struct _dirwatcher_journal_record
+{
+    uint8_t  type;              // _dirwatcher_journal_record_type_t
+    uint8_t  event;             // dirwatcher_event_t (event records)
+    uint16_t reserved;
+    uint32_t value;             // Path id (event records) or name length excluding null (path records)
+} _dirwatcher_journal_record_t;
+
+typedef struct _dirwatcher_journal_event_record
+{
+    _dirwatcher_journal_record_t record;
+    uint64_t                     time;
+} _dirwatcher_journal_event_record_t;
+
+typedef struct _dirwatcher_journal_rename_record
+{
+    _dirwatcher_journal_event_record_t event;
+    uint32_t                           old_path_id;
+    uint32_t                           reserved;
+} _dirwatcher_journal_rename_record_t;
+
+struct _dirwatcher_journal
+{
+    char*                         dir;
+    char*                         root_path;
+    size_t                        segment_size;
+    uint64_t                      next_seq;
+
+    HANDLE                        file_handle;      // Current segment
+    HANDLE                        mapping_handle;
+    BYTE*                         view;
+    _dirwatcher_journal_header_t* header;           // == view
+    size_t                        used;
+
+    const char**                  paths;            // Path id -> name inside the view
+    uint32_t*                     path_hashes;      // Path id -> hash
+    uint32_t                      path_count;
+    uint32_t                      path_capacity;
+    uint32_t*                     buckets;          // Open addressing, path id + 1 (0 = empty)
+    uint32_t                      bucket_mask;
+};
+
+/* Private functions **********************************/
+
+static uint32_t _hash_name(const char* name, size_t len)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static uint64_t _get_current_filetime(void)
+{
+    FILETIME       ft = { 0 };
+    ULARGE_INTEGER ul = { 0 };
+
+    GetSystemTimePreciseAsFileTime(&ft);
+
+    ul.LowPart  = ft.dwLowDateTime;
+    ul.HighPart = ft.dwHighDateTime;
+
+    return ul.QuadPart;
+}
+
+static bool _make_segment_path(const char* dir, uint64_t first_seq, char* buf, size_t buf_len)
+{
+    return SUCCEEDED(StringCchPrintfA(buf, buf_len, "%s\\%016llx" DIRWATCHER_JOURNAL_EXTENSION, dir, (unsigned long long)first_seq));
+}
+
+static int _compare_file_names(const void* a, const void* b)
+{
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+static void _free_file_names(char** names, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        free(names[i]);
+    }
+    free(names);
+}
+
+/*
+    Lists segment file names of a journal directory in sequence order.
+*/
+static bool _list_segments(const char* dir, char*** p_names, size_t* p_count)
+{
+    char             pattern[MAX_PATH * 4];
+    WIN32_FIND_DATAA find_data = { 0 };
+    char**           names     = NULL;
+    size_t           count     = 0;
+    size_t           capacity  = 0;
+
+    *p_names = NULL;
+    *p_count = 0;
+
+    if (FAILED(StringCchPrintfA(pattern, sizeof(pattern), "%s" DIRWATCHER_JOURNAL_PATTERN, dir)))
+    {
+        return false;
+    }
+
+    HANDLE find_handle = FindFirstFileA(pattern, &find_data);
+
+    if (find_handle == INVALID_HANDLE_VALUE)
+    {
+        return GetLastError() == ERROR_FILE_NOT_FOUND;
+    }
+
+    do
+    {
+        if ((find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ||
+            strlen(find_data.cFileName) != DIRWATCHER_JOURNAL_FILE_NAME_LEN - 1)
+        {
+            continue;
+        }
+
+        if (count == capacity)
+        {
+            size_t  new_capacity = capacity ? capacity * 2 : 16;
+            char**  new_names    = realloc(names, new_capacity * sizeof(char*));
+
+            if (!new_names)
+            {
+                FindClose(find_handle);
+                _free_file_names(names, count);
+                return false;
+            }
+
+            names    = new_names;
+            capacity = new_capacity;
+        }
+
+        names[count] = _strdup(find_data.cFileName);
+
+        if (!names[count])
+        {
+            FindClose(find_handle);
+            _free_file_names(names, count);
+            return false;
+        }
+
+        count++;
+    } while (FindNextFileA(find_handle, &find_data));
+
+    FindClose(find_handle);
+
+    qsort(names, count, sizeof(char*), _compare_file_names);
+
+    *p_names = names;
+    *p_count = count;
+
+    return true;
+}
+
+/*
+    Returns the sequence number following the newest segment, or 0 for an empty journal.
+*/
+static bool _get_resume_seq(const char* dir, uint64_t* p_seq)
+{
+    char**  names = NULL;
+    size_t  count = 0;
+    char    path[MAX_PATH * 4];
+
+    *p_seq = 0;
+
+    if (!_list_segments(dir, &names, &count))
+    {
+        return false;
+    }
+
+    if (!count)
+    {
+        return true;
+    }
+
+    bool success = SUCCEEDED(StringCchPrintfA(path, sizeof(path), "%s\\%s", dir, names[count - 1]));
+
+    _free_file_names(names, count);
+
+    if (!success)
+    {
+        return false;
+    }
+
+    HANDLE file_handle = CreateFileA(path,
+                                     GENERIC_READ,
+                                     FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                     NULL,
+                                     OPEN_EXISTING,
+                                     FILE_ATTRIBUTE_NORMAL,
+                                     NULL);
+
+    if (file_handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    _dirwatcher_journal_header_t header     = { 0 };
+    DWORD                        bytes_read = 0;
+
+    success = ReadFile(file_handle, &header, sizeof(header), &bytes_read, NULL) &&
+              bytes_read == sizeof(header)                                       &&
+              header.magic == DIRWATCHER_JOURNAL_MAGIC_NUMBER;
+
+    CloseHandle(file_handle);
+
+    if (!success)
+    {
+        SetLastError(ERROR_INVALID_DATA);
+        return false;
+    }
+
+    *p_seq = header.first_seq + header.event_count;
+
+    //
+    // An empty newest segment would collide with the next one; drop it
+    //
+
+    if (!header.event_count)
+    {
+        DeleteFileA(path);
+    }
+
+    return true;
+}
+
+static void _reset_intern_table(_dirwatcher_journal_t* journal)
+{
+    journal->path_count = 0;
+    memset(journal->buckets, 0, ((size_t)journal->bucket_mask + 1) * sizeof(uint32_t));
+}
+
+static bool _grow_intern_table(_dirwatcher_journal_t* journal)
+{
+    uint32_t  new_path_capacity = journal->path_capacity * 2;
+    uint32_t  new_bucket_count  = new_path_capacity * 2;
+    void*     new_paths         = realloc((void*)journal->paths, new_path_capacity * sizeof(const char*));
+
+    if (!new_paths)
+    {
+        return false;
+    }
+
+    journal->paths = new_paths;
+
+    uint32_t* new_hashes = realloc(journal->path_hashes, new_path_capacity * sizeof(uint32_t));
+
+    if (!new_hashes)
+    {
+        return false;
+    }
+
+    journal->path_hashes = new_hashes;
+
+    uint32_t* new_buckets = calloc(new_bucket_count, sizeof(uint32_t));
+
+    if (!new_buckets)
+    {
+        return false;
+    }
+
+    //
+    // Rehash
+    //
+
+    for (uint32_t id = 0; id < journal->path_count; id++)
+    {
+        uint32_t i = journal->path_hashes[id] & (new_bucket_count - 1);
+
+        while (new_buckets[i])
+        {
+            i = (i + 1) & (new_bucket_count - 1);
+        }
+
+        new_buckets[i] = id + 1;
+    }
+
+    free(journal->buckets);
+
+    journal->buckets       = new_buckets;
+    journal->bucket_mask   = new_bucket_count - 1;
+    journal->path_capacity = new_path_capacity;
+
+    return true;
+}
+
+static void _close_segment(_dirwatcher_journal_t* journal)
+{
+    if (!journal->view)
+    {
+        return;
+    }
+
+    //
+    // Flush and trim the segment to its used size
+    //
+
+    LARGE_INTEGER end = { 0 };
+    end.QuadPart = (LONGLONG)journal->used;
+
+    FlushViewOfFile(journal->view, 0);
+    UnmapViewOfFile(journal->view);
+    CloseHandle(journal->mapping_handle);
+
+    SetFilePointerEx(journal->file_handle, end, NULL, FILE_BEGIN);
+    SetEndOfFile(journal->file_handle);
+    FlushFileBuffers(journal->file_handle);
+    CloseHandle(journal->file_handle);
+
+    journal->view           = NULL;
+    journal->header         = NULL;
+    journal->mapping_handle = NULL;
+    journal->file_handle    = NULL;
+    journal->used           = 0;
+
+    _reset_intern_table(journal);
+}
+
+static bool _open_segment(_dirwatcher_journal_t* journal)
+{
+    char           path[MAX_PATH * 4];
+    ULARGE_INTEGER size = { 0 };
+
+    if (!_make_segment_path(journal->dir, journal->next_seq, path, sizeof(path)))
+    {
+        SetLastError(ERROR_BUFFER_OVERFLOW);
+        return false;
+    }
+
+    journal->file_handle = CreateFileA(path,
+                                       GENERIC_READ | GENERIC_WRITE,
+                                       FILE_SHARE_READ,
+                                       NULL,
+                                       CREATE_NEW,
+                                       FILE_ATTRIBUTE_NORMAL,
+                                       NULL);
+
+    if (journal->file_handle == INVALID_HANDLE_VALUE)
+    {
+        journal->file_handle = NULL;
+        return false;
+    }
+
+    size.QuadPart = journal->segment_size;
+
+    journal->mapping_handle = CreateFileMappingA(journal->file_handle, NULL, PAGE_READWRITE, size.HighPart, size.LowPart, NULL);
+
+    if (!journal->mapping_handle)
+    {
+        CloseHandle(journal->file_handle);
+        journal->file_handle = NULL;
+        return false;
+    }
+
+    journal->view = MapViewOfFile(journal->mapping_handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+    if (!journal->view)
+    {
+        CloseHandle(journal->mapping_handle);
+        CloseHandle(journal->file_handle);
+        journal->mapping_handle = NULL;
+        journal->file_handle    = NULL;
+        return false;
+    }
+
+    //
+    // Write header
+    //
+
+    size_t root_path_len = strlen(journal->root_path);
+
+    journal->header                = (_dirwatcher_journal_header_t*)journal->view;
+    journal->header->version       = DIRWATCHER_JOURNAL_VERSION;
+    journal->header->header_size   = (uint32_t)DIRWATCHER_JOURNAL_ALIGN(sizeof(_dirwatcher_journal_header_t) + root_path_len + 1);
+    journal->header->first_seq     = journal->next_seq;
+    journal->header->root_path_len = (uint32_t)root_path_len;
+
+    memcpy(journal->header->root_path, journal->root_path, root_path_len + 1);
+
+    journal->used                = journal->header->header_size;
+    journal->header->used_bytes  = journal->used;
+    journal->header->magic       = DIRWATCHER_JOURNAL_MAGIC_NUMBER;
+
+    return true;
+}
+
+/*
+    Returns the path id of name in the current segment, writing a path record if needed.
+*/
+static bool _intern_path(_dirwatcher_journal_t* journal, const char* name, uint32_t* p_id)
+{
+    size_t   len  = strlen(name);
+    uint32_t hash = _hash_name(name, len);
+    uint32_t i    = hash & journal->bucket_mask;
+
+    while (journal->buckets[i])
+    {
+        uint32_t id = journal->buckets[i] - 1;
+
+        if (journal->path_hashes[id] == hash && strcmp(journal->paths[id], name) == 0)
+        {
+            *p_id = id;
+            return true;
+        }
+
+        i = (i + 1) & journal->bucket_mask;
+    }
+
+    //
+    // New path in this segment
+    //
+
+    if (journal->path_count * 2 >= journal->bucket_mask + 1)
+    {
+        if (!_grow_intern_table(journal))
+        {
+            SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            return false;
+        }
+
+        return _intern_path(journal, name, p_id);
+    }
+
+    _dirwatcher_journal_record_t* record = (_dirwatcher_journal_record_t*)(journal->view + journal->used);
+    char*                         text   = (char*)(record + 1);
+
+    record->type  = DIRWATCHER_JOURNAL_RECORD_PATH;
+    record->value = (uint32_t)len;
+    memcpy(text, name, len + 1);
+
+    journal->paths[journal->path_count]       = text;
+    journal->path_hashes[journal->path_count] = hash;
+    journal->buckets[i]                       = journal->path_count + 1;
+
+    *p_id = journal->path_count++;
+
+    journal->used += DIRWATCHER_JOURNAL_ALIGN(sizeof(_dirwatcher_journal_record_t) + len + 1);
+
+    return true;
+}
+
+/* Writer functions ***********************************/
+
+_dirwatcher_journal_t* _dirwatcher_journal_open(const char* dir, size_t segment_size, const char* root_path)
+{
+    _dirwatcher_journal_t* journal = calloc(1, sizeof(_dirwatcher_journal_t));
+
+    if (!journal)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+
+    if (!segment_size)
+    {
+        segment_size = DIRWATCHER_JOURNAL_DEFAULT_SEGMENT_SIZE;
+    }
+
+    journal->segment_size  = DIRWATCHER_JOURNAL_ALIGN(max(segment_size, DIRWATCHER_JOURNAL_MIN_SEGMENT));
+    journal->dir           = _strdup(dir);
+    journal->root_path     = _strdup(root_path ? root_path : "");
+    journal->path_capacity = 1024;
+    journal->paths         = malloc(journal->path_capacity * sizeof(const char*));
+    journal->path_hashes   = malloc(journal->path_capacity * sizeof(uint32_t));
+    journal->buckets       = calloc((size_t)journal->path_capacity * 2, sizeof(uint32_t));
+    journal->bucket_mask   = journal->path_capacity * 2 - 1;
+
+    if (!journal->dir || !journal->root_path || !journal->paths || !journal->path_hashes || !journal->buckets)
+    {
+        _dirwatcher_journal_close(journal);
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+
+    CreateDirectoryA(dir, NULL);
+
+    if (!_get_resume_seq(dir, &journal->next_seq) || !_open_segment(journal))
+    {
+        DWORD last_error = GetLastError();
+        _dirwatcher_journal_close(journal);
+        SetLastError(last_error);
+        return NULL;
+    }
+
+    return journal;
+}
+
+void _dirwatcher_journal_close(_dirwatcher_journal_t* journal)
+{
+    if (!journal)
+    {
+        return;
+    }
+
+    _close_segment(journal);
+
+    free(journal->dir);
+    free(journal->root_path);
+    free((void*)journal->paths);
+    free(journal->path_hashes);
+    free(journal->buckets);
+    free(journal);
+}
+
+bool _dirwatcher_journal_append(_dirwatcher_journal_t* journal, const dirwatcher_event_info_t* event_info)
+{
+    const char* name     = event_info->name ? event_info->name : "";
+    const char* old_name = event_info->old_name;
+    size_t      required = DIRWATCHER_JOURNAL_ALIGN(sizeof(_dirwatcher_journal_record_t) + strlen(name) + 1) +
+                           sizeof(_dirwatcher_journal_event_record_t);
+
+    if (old_name)
+    {
+        required += DIRWATCHER_JOURNAL_ALIGN(sizeof(_dirwatcher_journal_record_t) + strlen(old_name) + 1) +
+                    sizeof(_dirwatcher_journal_rename_record_t) - sizeof(_dirwatcher_journal_event_record_t);
+    }
+
+    //
+    // Roll when the worst case (new paths + event) does not fit
+    //
+
+    if (journal->used + required > journal->segment_size)
+    {
+        if (journal->header->event_count == 0)
+        {
+            SetLastError(ERROR_BUFFER_OVERFLOW);
+            return false;
+        }
+
+        _close_segment(journal);
+
+        if (!_open_segment(journal))
+        {
+            return false;
+        }
+
+        //
+        // Long names and a long root path may not fit an empty segment either
+        //
+
+        if (journal->used + required > journal->segment_size)
+        {
+            SetLastError(ERROR_BUFFER_OVERFLOW);
+            return false;
+        }
+    }
+
+    uint32_t path_id     = 0;
+    uint32_t old_path_id = 0;
+
+    if (!_intern_path(journal, name, &path_id) ||
+        (old_name && !_intern_path(journal, old_name, &old_path_id)))
+    {
+        return false;
+    }
+
+    _dirwatcher_journal_event_record_t* record = (_dirwatcher_journal_event_record_t*)(journal->view + journal->used);
+
+    record->record.type  = old_name ? DIRWATCHER_JOURNAL_RECORD_RENAME : DIRWATCHER_JOURNAL_RECORD_EVENT;
+    record->record.event = (uint8_t)event_info->event;
+    record->record.value = path_id;
+    record->time         = event_info->timestamp ? event_info->timestamp : _get_current_filetime();
+
+    if (old_name)
+    {
+        ((_dirwatcher_journal_rename_record_t*)record)->old_path_id = old_path_id;
+        journal->used += sizeof(_dirwatcher_journal_rename_record_t);
+    }
+    else
+    {
+        journal->used += sizeof(_dirwatcher_journal_event_record_t);
+    }
+
+    //
+    // Publish the record by advancing the header last
+    //
+
+    if (!journal->header->event_count)
+    {
+        journal->header->first_time = record->time;
+    }
+
+    journal->header->last_time  = record->time;
+    journal->header->event_count++;
+    journal->header->used_bytes = journal->used;
+
+    journal->next_seq++;
+
+    return true;
+}
+
+/* Public functions ***********************************/
+
+bool dirwatcher_replay_journal(const char*                       dir,
+                               const dirwatcher_journal_range_t* range,
+                               dirwatcher_target_t               target,
+                               dirwatcher_callback_t             callback,
+                               void*                             user_data,
+                               uint64_t*                         replayed)
+{
+    dirwatcher_journal_range_t all_range = { 0, UINT64_MAX, 0, UINT64_MAX };
+    char**                     names     = NULL;
+    size_t                     count     = 0;
+    const char**               paths     = NULL;
+    uint32_t                   path_cap  = 0;
+    uint64_t                   delivered = 0;
+    bool                       success   = true;
+    char                       path[MAX_PATH * 4];
+
+    if (replayed) *replayed = 0;
+
+    if (!dir || !callback)
+    {
+        return false;
+    }
+
+    if (!range)
+    {
+        range = &all_range;
+    }
+
+    if (!_list_segments(dir, &names, &count))
+    {
+        return false;
+    }
+
+    for (size_t s = 0; s < count && success; s++)
+    {
+        if (FAILED(StringCchPrintfA(path, sizeof(path), "%s\\%s", dir, names[s])))
+        {
+            success = false;
+            break;
+        }
+
+        //
+        // Map segment read-only
+        //
+
+        HANDLE file_handle = CreateFileA(path,
+                                         GENERIC_READ,
+                                         FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                         NULL,
+                                         OPEN_EXISTING,
+                                         FILE_FLAG_SEQUENTIAL_SCAN,
+                                         NULL);
+
+        if (file_handle == INVALID_HANDLE_VALUE)
+        {
+            success = false;
+            break;
+        }
+
+        LARGE_INTEGER file_size      = { 0 };
+        HANDLE        mapping_handle = NULL;
+        const BYTE*   view           = NULL;
+
+        if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart < (LONGLONG)sizeof(_dirwatcher_journal_header_t))
+        {
+            CloseHandle(file_handle);
+            continue;
+        }
+
+        mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        view           = mapping_handle ? MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0) : NULL;
+
+        if (!view)
+        {
+            if (mapping_handle) CloseHandle(mapping_handle);
+            CloseHandle(file_handle);
+            success = false;
+            break;
+        }
+
+        const _dirwatcher_journal_header_t* header = (const _dirwatcher_journal_header_t*)view;
+        uint64_t                            used   = header->used_bytes;
+
+        if (header->magic   != DIRWATCHER_JOURNAL_MAGIC_NUMBER ||
+            header->version >  DIRWATCHER_JOURNAL_VERSION      ||
+            used            >  (uint64_t)file_size.QuadPart    ||
+            header->header_size > used)
+        {
+            success = false;
+        }
+        else if (header->event_count                            &&
+                 header->first_seq                              <= range->last_seq   &&
+                 header->first_seq + header->event_count - 1    >= range->first_seq  &&
+                 header->first_time                             <= range->last_time  &&
+                 header->last_time                              >= range->first_time)
+        {
+            //
+            // Walk records
+            //
+
+            uint64_t                event_index = 0;
+            uint32_t                path_count  = 0;
+            size_t                  pos         = header->header_size;
+            dirwatcher_event_info_t event_info  = { 0 };
+
+            event_info.target = target;
+
+            while (pos + sizeof(_dirwatcher_journal_record_t) <= used)
+            {
+                const _dirwatcher_journal_record_t* record = (const _dirwatcher_journal_record_t*)(view + pos);
+
+                if (record->type == DIRWATCHER_JOURNAL_RECORD_PATH)
+                {
+                    size_t record_size = DIRWATCHER_JOURNAL_ALIGN(sizeof(_dirwatcher_journal_record_t) + (size_t)record->value + 1);
+
+                    //
+                    // The name must end inside its record, not at a null found further on
+                    //
+
+                    if (pos + record_size > used || ((const char*)(record + 1))[record->value] != '\0')
+                    {
+                        success = false;
+                        break;
+                    }
+
+                    if (path_count == path_cap)
+                    {
+                        uint32_t new_cap   = path_cap ? path_cap * 2 : 1024;
+                        void*    new_paths = realloc((void*)paths, new_cap * sizeof(const char*));
+
+                        if (!new_paths)
+                        {
+                            success = false;
+                            break;
+                        }
+
+                        paths    = new_paths;
+                        path_cap = new_cap;
+                    }
+
+                    paths[path_count++] = (const char*)(record + 1);
+                    pos += record_size;
+                }
+                else if (record->type == DIRWATCHER_JOURNAL_RECORD_EVENT ||
+                         record->type == DIRWATCHER_JOURNAL_RECORD_RENAME)
+                {
+                    const _dirwatcher_journal_event_record_t* event_record = (const _dirwatcher_journal_event_record_t*)record;
+                    uint64_t                                  seq          = header->first_seq + event_index++;
+                    bool                                      is_rename    = record->type == DIRWATCHER_JOURNAL_RECORD_RENAME;
+                    size_t                                    record_size  = is_rename ? sizeof(_dirwatcher_journal_rename_record_t)
+                                                                                       : sizeof(_dirwatcher_journal_event_record_t);
+                    uint32_t                                  old_path_id  = 0;
+
+                    if (pos + record_size > used || record->value >= path_count)
+                    {
+                        success = false;
+                        break;
+                    }
+
+                    if (is_rename)
+                    {
+                        old_path_id = ((const _dirwatcher_journal_rename_record_t*)record)->old_path_id;
+
+                        if (old_path_id >= path_count)
+                        {
+                            success = false;
+                            break;
+                        }
+                    }
+
+                    pos += record_size;
+
+                    if (seq > range->last_seq)
+                    {
+                        break;
+                    }
+
+                    if (seq               <  range->first_seq  ||
+                        event_record->time <  range->first_time ||
+                        event_record->time >  range->last_time)
+                    {
+                        continue;
+                    }
+
+                    event_info.name      = (char*)paths[record->value];
+                    event_info.old_name  = is_rename ? (char*)paths[old_path_id] : NULL;
+                    event_info.event     = (dirwatcher_event_t)record->event;
+                    event_info.timestamp = event_record->time;
+
+                    callback(&event_info, user_data);
+                    delivered++;
+                }
+                else
+                {
+                    success = false;
+                    break;
+                }
+            }
+        }
+
+        UnmapViewOfFile(view);
+        CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+    }
+
+    free((void*)paths);
+    _free_file_names(names, count);
+
+    if (replayed) *replayed = delivered;
+
+    return success;
+}
@@ -0,0 +1,32 @@
+/*
+    DIRWATCHER_JOURNAL_WIN32.H
+      Private interface of the append-only event journal (writer side)
+*/
+
+#ifndef DIRWATCHER_JOURNAL_WIN32_H
+#define DIRWATCHER_JOURNAL_WIN32_H
+
+#include <dirwatcher.h>
+
+typedef struct _dirwatcher_journal _dirwatcher_journal_t;
+
+/*
+    Opens a journal directory for appending and stores root_path (UTF-8) in
+    every segment header. Sequence numbers continue after the newest segment
+    already in the directory.
+*/
+_dirwatcher_journal_t* _dirwatcher_journal_open(const char* dir, size_t segment_size, const char* root_path);
+
+/*
+    Finalizes the current segment (trims it to its used size) and releases the journal.
+*/
+void _dirwatcher_journal_close(_dirwatcher_journal_t* journal);
+
+/*
+    Appends one event, rolling to a new segment when the current one is full.
+    Called from the worker thread only.
+    Returns false on I/O failure; GetLastError() holds the reason.
+*/
+bool _dirwatcher_journal_append(_dirwatcher_journal_t* journal, const dirwatcher_event_info_t* event_info);
+
+#endif
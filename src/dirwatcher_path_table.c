@@ -0,0 +1,860 @@
+/* Includes *******************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dirwatcher_path_table.h"
+
+/* Defines ********************************************/
+
+#define DIRWATCHER_PATH_TABLE_MIN_NODES      64
+#define DIRWATCHER_PATH_TABLE_MIN_COMPONENTS 64
+#define DIRWATCHER_PATH_TABLE_MIN_POOL       4096
+#define DIRWATCHER_PATH_TABLE_COMPACT_MIN    (64 * 1024)  // Pool bytes before dead strings are reclaimed
+
+/*
+    Layout:
+
+    - Nodes are ids into five parallel uint32_t arrays. A free node has no
+      parent and is chained through next_sibling.
+
+    - Components (single path segments) are interned once in a byte pool and
+      reference counted by the nodes that use them. A free component is
+      chained through comp_offset.
+
+    - Two open-addressing hash sets with linear probing and backward-shift
+      deletion (no tombstones) index components by text and nodes by
+      (parent, component). Buckets hold id + 1; 0 is empty.
+*/
+
+struct _dirwatcher_path_table
+{
+    uint32_t* parent;
+    uint32_t* component;
+    uint32_t* first_child;
+    uint32_t* next_sibling;
+    uint32_t* prev_sibling;
+    uint32_t  node_count;       // Live nodes
+    uint32_t  node_bound;       // Ids ever handed out
+    uint32_t  node_capacity;
+    uint32_t  free_node;
+
+    uint32_t* child_buckets;
+    uint32_t  child_mask;
+
+    char*     pool;             // Null termed component texts
+    size_t    pool_used;
+    size_t    pool_capacity;
+    size_t    pool_dead;        // Bytes of released components
+    uint32_t* comp_offset;
+    uint32_t* comp_refs;
+    uint32_t  comp_count;
+    uint32_t  comp_bound;
+    uint32_t  comp_capacity;
+    uint32_t  free_comp;
+
+    uint32_t* comp_buckets;
+    uint32_t  comp_mask;
+
+    bool      ignore_case;      // ASCII letters of components compare without case
+};
+
+/* Private functions **********************************/
+
+static unsigned char _fold_char(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+static uint32_t _hash_text(const _dirwatcher_path_table_t* table, const char* text, size_t len)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)text[i];
+
+        hash ^= table->ignore_case ? _fold_char(c) : c;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t _hash_child(uint32_t parent, uint32_t component)
+{
+    uint32_t hash = parent * 0x9E3779B1u ^ component * 0x85EBCA6Bu;
+
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6Du;
+    hash ^= hash >> 13;
+
+    return hash;
+}
+
+static bool _grow_array(uint32_t** p_array, uint32_t new_count)
+{
+    uint32_t* array = realloc(*p_array, (size_t)new_count * sizeof(uint32_t));
+
+    if (!array)
+    {
+        return false;
+    }
+
+    *p_array = array;
+    return true;
+}
+
+static bool _text_equals(const _dirwatcher_path_table_t* table, const char* stored, const char* text, size_t len)
+{
+    if (!table->ignore_case)
+    {
+        return strncmp(stored, text, len) == 0 && stored[len] == '\0';
+    }
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!stored[i] || _fold_char((unsigned char)stored[i]) != _fold_char((unsigned char)text[i]))
+        {
+            return false;
+        }
+    }
+
+    return stored[len] == '\0';
+}
+
+/* Component set **************************************/
+
+static uint32_t _comp_find(const _dirwatcher_path_table_t* table, const char* text, size_t len)
+{
+    uint32_t i = _hash_text(table, text, len) & table->comp_mask;
+
+    while (table->comp_buckets[i])
+    {
+        uint32_t comp = table->comp_buckets[i] - 1;
+
+        if (_text_equals(table, table->pool + table->comp_offset[comp], text, len))
+        {
+            return comp;
+        }
+
+        i = (i + 1) & table->comp_mask;
+    }
+
+    return DIRWATCHER_PATH_NONE;
+}
+
+static void _comp_bucket_insert(_dirwatcher_path_table_t* table, uint32_t* buckets, uint32_t mask, uint32_t comp)
+{
+    const char* text = table->pool + table->comp_offset[comp];
+    uint32_t    i    = _hash_text(table, text, strlen(text)) & mask;
+
+    while (buckets[i])
+    {
+        i = (i + 1) & mask;
+    }
+
+    buckets[i] = comp + 1;
+}
+
+static bool _comp_rehash(_dirwatcher_path_table_t* table, uint32_t bucket_count)
+{
+    uint32_t* buckets = calloc(bucket_count, sizeof(uint32_t));
+
+    if (!buckets)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i <= table->comp_mask; i++)
+    {
+        if (table->comp_buckets[i])
+        {
+            _comp_bucket_insert(table, buckets, bucket_count - 1, table->comp_buckets[i] - 1);
+        }
+    }
+
+    free(table->comp_buckets);
+
+    table->comp_buckets = buckets;
+    table->comp_mask    = bucket_count - 1;
+
+    return true;
+}
+
+static void _comp_bucket_remove(_dirwatcher_path_table_t* table, uint32_t comp)
+{
+    const char* text = table->pool + table->comp_offset[comp];
+    uint32_t    i    = _hash_text(table, text, strlen(text)) & table->comp_mask;
+
+    while (table->comp_buckets[i] != comp + 1)
+    {
+        i = (i + 1) & table->comp_mask;
+    }
+
+    //
+    // Backward-shift the rest of the cluster
+    //
+
+    for (uint32_t j = (i + 1) & table->comp_mask; table->comp_buckets[j]; j = (j + 1) & table->comp_mask)
+    {
+        const char* other = table->pool + table->comp_offset[table->comp_buckets[j] - 1];
+        uint32_t    home  = _hash_text(table, other, strlen(other)) & table->comp_mask;
+
+        if (((j - home) & table->comp_mask) >= ((j - i) & table->comp_mask))
+        {
+            table->comp_buckets[i] = table->comp_buckets[j];
+            i = j;
+        }
+    }
+
+    table->comp_buckets[i] = 0;
+}
+
+/*
+    Moves live component texts to the front of the pool. Component ids are kept.
+*/
+static void _compact_pool(_dirwatcher_path_table_t* table)
+{
+    char*  pool = malloc(table->pool_capacity);
+    size_t used = 0;
+
+    if (!pool)
+    {
+        return;
+    }
+
+    for (uint32_t comp = 0; comp < table->comp_bound; comp++)
+    {
+        if (!table->comp_refs[comp])
+        {
+            continue;
+        }
+
+        const char* text = table->pool + table->comp_offset[comp];
+        size_t      size = strlen(text) + 1;
+
+        memcpy(pool + used, text, size);
+        table->comp_offset[comp] = (uint32_t)used;
+        used += size;
+    }
+
+    free(table->pool);
+
+    table->pool      = pool;
+    table->pool_used = used;
+    table->pool_dead = 0;
+}
+
+static uint32_t _comp_acquire(_dirwatcher_path_table_t* table, const char* text, size_t len)
+{
+    uint32_t comp = _comp_find(table, text, len);
+
+    if (comp != DIRWATCHER_PATH_NONE)
+    {
+        table->comp_refs[comp]++;
+        return comp;
+    }
+
+    //
+    // Make room: bucket load <= 1/2, pool, id arrays
+    //
+
+    if ((table->comp_count + 1) * 2 > table->comp_mask + 1 && !_comp_rehash(table, (table->comp_mask + 1) * 2))
+    {
+        return DIRWATCHER_PATH_NONE;
+    }
+
+    if (table->pool_used + len + 1 > table->pool_capacity)
+    {
+        size_t new_capacity = table->pool_capacity * 2;
+
+        while (table->pool_used + len + 1 > new_capacity)
+        {
+            new_capacity *= 2;
+        }
+
+        if (new_capacity > UINT32_MAX)
+        {
+            return DIRWATCHER_PATH_NONE;
+        }
+
+        char* pool = realloc(table->pool, new_capacity);
+
+        if (!pool)
+        {
+            return DIRWATCHER_PATH_NONE;
+        }
+
+        table->pool          = pool;
+        table->pool_capacity = new_capacity;
+    }
+
+    if (table->free_comp != DIRWATCHER_PATH_NONE)
+    {
+        comp             = table->free_comp;
+        table->free_comp = table->comp_offset[comp];
+    }
+    else
+    {
+        if (table->comp_bound == table->comp_capacity)
+        {
+            uint32_t new_capacity = table->comp_capacity * 2;
+
+            if (!_grow_array(&table->comp_offset, new_capacity) ||
+                !_grow_array(&table->comp_refs, new_capacity))
+            {
+                return DIRWATCHER_PATH_NONE;
+            }
+
+            table->comp_capacity = new_capacity;
+        }
+
+        comp = table->comp_bound++;
+    }
+
+    memcpy(table->pool + table->pool_used, text, len);
+    table->pool[table->pool_used + len] = '\0';
+
+    table->comp_offset[comp] = (uint32_t)table->pool_used;
+    table->comp_refs[comp]   = 1;
+    table->pool_used        += len + 1;
+    table->comp_count++;
+
+    _comp_bucket_insert(table, table->comp_buckets, table->comp_mask, comp);
+
+    return comp;
+}
+
+static void _comp_release(_dirwatcher_path_table_t* table, uint32_t comp)
+{
+    if (--table->comp_refs[comp])
+    {
+        return;
+    }
+
+    _comp_bucket_remove(table, comp);
+
+    table->pool_dead += strlen(table->pool + table->comp_offset[comp]) + 1;
+
+    table->comp_offset[comp] = table->free_comp;
+    table->free_comp         = comp;
+    table->comp_count--;
+
+    if (table->pool_used >= DIRWATCHER_PATH_TABLE_COMPACT_MIN && table->pool_dead * 2 > table->pool_used)
+    {
+        _compact_pool(table);
+    }
+}
+
+/* Child set ******************************************/
+
+static void _child_bucket_insert(const _dirwatcher_path_table_t* table, uint32_t* buckets, uint32_t mask, uint32_t node)
+{
+    uint32_t i = _hash_child(table->parent[node], table->component[node]) & mask;
+
+    while (buckets[i])
+    {
+        i = (i + 1) & mask;
+    }
+
+    buckets[i] = node + 1;
+}
+
+static bool _child_rehash(_dirwatcher_path_table_t* table, uint32_t bucket_count)
+{
+    uint32_t* buckets = calloc(bucket_count, sizeof(uint32_t));
+
+    if (!buckets)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i <= table->child_mask; i++)
+    {
+        if (table->child_buckets[i])
+        {
+            _child_bucket_insert(table, buckets, bucket_count - 1, table->child_buckets[i] - 1);
+        }
+    }
+
+    free(table->child_buckets);
+
+    table->child_buckets = buckets;
+    table->child_mask    = bucket_count - 1;
+
+    return true;
+}
+
+static void _child_bucket_remove(_dirwatcher_path_table_t* table, uint32_t node)
+{
+    uint32_t i = _hash_child(table->parent[node], table->component[node]) & table->child_mask;
+
+    while (table->child_buckets[i] != node + 1)
+    {
+        i = (i + 1) & table->child_mask;
+    }
+
+    for (uint32_t j = (i + 1) & table->child_mask; table->child_buckets[j]; j = (j + 1) & table->child_mask)
+    {
+        uint32_t other = table->child_buckets[j] - 1;
+        uint32_t home  = _hash_child(table->parent[other], table->component[other]) & table->child_mask;
+
+        if (((j - home) & table->child_mask) >= ((j - i) & table->child_mask))
+        {
+            table->child_buckets[i] = table->child_buckets[j];
+            i = j;
+        }
+    }
+
+    table->child_buckets[i] = 0;
+}
+
+/* Node links *****************************************/
+
+static void _link_node(_dirwatcher_path_table_t* table, uint32_t node, uint32_t parent)
+{
+    uint32_t first = table->first_child[parent];
+
+    table->parent[node]       = parent;
+    table->prev_sibling[node] = DIRWATCHER_PATH_NONE;
+    table->next_sibling[node] = first;
+
+    if (first != DIRWATCHER_PATH_NONE)
+    {
+        table->prev_sibling[first] = node;
+    }
+
+    table->first_child[parent] = node;
+}
+
+static void _unlink_node(_dirwatcher_path_table_t* table, uint32_t node)
+{
+    uint32_t prev = table->prev_sibling[node];
+    uint32_t next = table->next_sibling[node];
+
+    if (prev != DIRWATCHER_PATH_NONE)
+    {
+        table->next_sibling[prev] = next;
+    }
+    else
+    {
+        table->first_child[table->parent[node]] = next;
+    }
+
+    if (next != DIRWATCHER_PATH_NONE)
+    {
+        table->prev_sibling[next] = prev;
+    }
+}
+
+static void _free_node(_dirwatcher_path_table_t* table, uint32_t node)
+{
+    _child_bucket_remove(table, node);
+    _comp_release(table, table->component[node]);
+
+    table->parent[node]       = DIRWATCHER_PATH_NONE;
+    table->component[node]    = DIRWATCHER_PATH_NONE;
+    table->next_sibling[node] = table->free_node;
+    table->free_node          = node;
+    table->node_count--;
+}
+
+static uint32_t _alloc_node(_dirwatcher_path_table_t* table)
+{
+    uint32_t node;
+
+    if ((table->node_count + 1) * 2 > table->child_mask + 1 && !_child_rehash(table, (table->child_mask + 1) * 2))
+    {
+        return DIRWATCHER_PATH_NONE;
+    }
+
+    if (table->free_node != DIRWATCHER_PATH_NONE)
+    {
+        node             = table->free_node;
+        table->free_node = table->next_sibling[node];
+    }
+    else
+    {
+        if (table->node_bound == table->node_capacity)
+        {
+            uint32_t new_capacity = table->node_capacity * 2;
+
+            if (!_grow_array(&table->parent, new_capacity)       ||
+                !_grow_array(&table->component, new_capacity)    ||
+                !_grow_array(&table->first_child, new_capacity)  ||
+                !_grow_array(&table->next_sibling, new_capacity) ||
+                !_grow_array(&table->prev_sibling, new_capacity))
+            {
+                return DIRWATCHER_PATH_NONE;
+            }
+
+            table->node_capacity = new_capacity;
+        }
+
+        node = table->node_bound++;
+    }
+
+    table->first_child[node] = DIRWATCHER_PATH_NONE;
+    table->node_count++;
+
+    return node;
+}
+
+/* Table functions ************************************/
+
+_dirwatcher_path_table_t* _dirwatcher_path_table_create(bool ignore_case)
+{
+    _dirwatcher_path_table_t* table = calloc(1, sizeof(_dirwatcher_path_table_t));
+
+    if (!table)
+    {
+        return NULL;
+    }
+
+    table->node_capacity = DIRWATCHER_PATH_TABLE_MIN_NODES;
+    table->comp_capacity = DIRWATCHER_PATH_TABLE_MIN_COMPONENTS;
+    table->pool_capacity = DIRWATCHER_PATH_TABLE_MIN_POOL;
+    table->free_node     = DIRWATCHER_PATH_NONE;
+    table->free_comp     = DIRWATCHER_PATH_NONE;
+    table->child_mask    = DIRWATCHER_PATH_TABLE_MIN_NODES * 2 - 1;
+    table->comp_mask     = DIRWATCHER_PATH_TABLE_MIN_COMPONENTS * 2 - 1;
+    table->ignore_case   = ignore_case;
+
+    table->parent        = malloc(table->node_capacity * sizeof(uint32_t));
+    table->component     = malloc(table->node_capacity * sizeof(uint32_t));
+    table->first_child   = malloc(table->node_capacity * sizeof(uint32_t));
+    table->next_sibling  = malloc(table->node_capacity * sizeof(uint32_t));
+    table->prev_sibling  = malloc(table->node_capacity * sizeof(uint32_t));
+    table->child_buckets = calloc((size_t)table->child_mask + 1, sizeof(uint32_t));
+    table->pool          = malloc(table->pool_capacity);
+    table->comp_offset   = malloc(table->comp_capacity * sizeof(uint32_t));
+    table->comp_refs     = malloc(table->comp_capacity * sizeof(uint32_t));
+    table->comp_buckets  = calloc((size_t)table->comp_mask + 1, sizeof(uint32_t));
+
+    if (!table->parent       || !table->component     || !table->first_child ||
+        !table->next_sibling || !table->prev_sibling  || !table->child_buckets ||
+        !table->pool         || !table->comp_offset   || !table->comp_refs   ||
+        !table->comp_buckets)
+    {
+        _dirwatcher_path_table_destroy(table);
+        return NULL;
+    }
+
+    //
+    // Root: no parent, no component, not in the child set
+    //
+
+    table->parent[DIRWATCHER_PATH_ROOT]       = DIRWATCHER_PATH_NONE;
+    table->component[DIRWATCHER_PATH_ROOT]    = DIRWATCHER_PATH_NONE;
+    table->first_child[DIRWATCHER_PATH_ROOT]  = DIRWATCHER_PATH_NONE;
+    table->next_sibling[DIRWATCHER_PATH_ROOT] = DIRWATCHER_PATH_NONE;
+    table->prev_sibling[DIRWATCHER_PATH_ROOT] = DIRWATCHER_PATH_NONE;
+    table->node_bound = 1;
+    table->node_count = 1;
+
+    return table;
+}
+
+void _dirwatcher_path_table_destroy(_dirwatcher_path_table_t* table)
+{
+    if (!table)
+    {
+        return;
+    }
+
+    free(table->parent);
+    free(table->component);
+    free(table->first_child);
+    free(table->next_sibling);
+    free(table->prev_sibling);
+    free(table->child_buckets);
+    free(table->pool);
+    free(table->comp_offset);
+    free(table->comp_refs);
+    free(table->comp_buckets);
+    free(table);
+}
+
+bool _dirwatcher_path_table_is_valid(const _dirwatcher_path_table_t* table, uint32_t node)
+{
+    return node < table->node_bound && (node == DIRWATCHER_PATH_ROOT || table->parent[node] != DIRWATCHER_PATH_NONE);
+}
+
+uint32_t _dirwatcher_path_table_lookup(const _dirwatcher_path_table_t* table, uint32_t parent, const char* name, size_t name_len)
+{
+    uint32_t comp = _comp_find(table, name, name_len);
+
+    if (comp == DIRWATCHER_PATH_NONE)
+    {
+        return DIRWATCHER_PATH_NONE;
+    }
+
+    uint32_t i = _hash_child(parent, comp) & table->child_mask;
+
+    while (table->child_buckets[i])
+    {
+        uint32_t node = table->child_buckets[i] - 1;
+
+        if (table->parent[node] == parent && table->component[node] == comp)
+        {
+            return node;
+        }
+
+        i = (i + 1) & table->child_mask;
+    }
+
+    return DIRWATCHER_PATH_NONE;
+}
+
+uint32_t _dirwatcher_path_table_insert(_dirwatcher_path_table_t* table, uint32_t parent, const char* name, size_t name_len)
+{
+    uint32_t node = _dirwatcher_path_table_lookup(table, parent, name, name_len);
+
+    if (node != DIRWATCHER_PATH_NONE)
+    {
+        return node;
+    }
+
+    node = _alloc_node(table);
+
+    if (node == DIRWATCHER_PATH_NONE)
+    {
+        return DIRWATCHER_PATH_NONE;
+    }
+
+    uint32_t comp = _comp_acquire(table, name, name_len);
+
+    if (comp == DIRWATCHER_PATH_NONE)
+    {
+        table->parent[node]       = DIRWATCHER_PATH_NONE;
+        table->next_sibling[node] = table->free_node;
+        table->free_node          = node;
+        table->node_count--;
+        return DIRWATCHER_PATH_NONE;
+    }
+
+    table->component[node] = comp;
+
+    _link_node(table, node, parent);
+    _child_bucket_insert(table, table->child_buckets, table->child_mask, node);
+
+    return node;
+}
+
+static uint32_t _walk_path(_dirwatcher_path_table_t* table, const char* path, bool create)
+{
+    uint32_t node = DIRWATCHER_PATH_ROOT;
+
+    while (*path && node != DIRWATCHER_PATH_NONE)
+    {
+        const char* end = strchr(path, DIRWATCHER_PATH_SEPARATOR);
+        size_t      len = end ? (size_t)(end - path) : strlen(path);
+
+        if (len)
+        {
+            node = create ? _dirwatcher_path_table_insert(table, node, path, len)
+                          : _dirwatcher_path_table_lookup(table, node, path, len);
+        }
+
+        path += len;
+
+        if (*path)
+        {
+            path++;
+        }
+    }
+
+    return node;
+}
+
+uint32_t _dirwatcher_path_table_find(const _dirwatcher_path_table_t* table, const char* path)
+{
+    return _walk_path((_dirwatcher_path_table_t*)table, path, false);
+}
+
+uint32_t _dirwatcher_path_table_insert_path(_dirwatcher_path_table_t* table, const char* path)
+{
+    return _walk_path(table, path, true);
+}
+
+void _dirwatcher_path_table_remove(_dirwatcher_path_table_t* table, uint32_t node)
+{
+    if (node == DIRWATCHER_PATH_ROOT || !_dirwatcher_path_table_is_valid(table, node))
+    {
+        return;
+    }
+
+    _unlink_node(table, node);
+
+    //
+    // Free the subtree bottom-up, always taking the first child
+    //
+
+    uint32_t cur = node;
+
+    for (;;)
+    {
+        if (table->first_child[cur] != DIRWATCHER_PATH_NONE)
+        {
+            cur = table->first_child[cur];
+            continue;
+        }
+
+        uint32_t parent = table->parent[cur];
+        uint32_t next   = table->next_sibling[cur];
+
+        _free_node(table, cur);
+
+        if (cur == node)
+        {
+            break;
+        }
+
+        table->first_child[parent] = next;
+
+        if (next != DIRWATCHER_PATH_NONE)
+        {
+            table->prev_sibling[next] = DIRWATCHER_PATH_NONE;
+        }
+
+        cur = next != DIRWATCHER_PATH_NONE ? next : parent;
+    }
+}
+
+bool _dirwatcher_path_table_move(_dirwatcher_path_table_t* table, uint32_t node, uint32_t new_parent, const char* name, size_t name_len)
+{
+    if (node == DIRWATCHER_PATH_ROOT                                   ||
+        !_dirwatcher_path_table_is_valid(table, node)                  ||
+        !_dirwatcher_path_table_is_valid(table, new_parent)            ||
+        _dirwatcher_path_table_lookup(table, new_parent, name, name_len) != DIRWATCHER_PATH_NONE)
+    {
+        return false;
+    }
+
+    for (uint32_t p = new_parent; p != DIRWATCHER_PATH_NONE; p = table->parent[p])
+    {
+        if (p == node)
+        {
+            return false;
+        }
+    }
+
+    uint32_t comp = _comp_acquire(table, name, name_len);
+
+    if (comp == DIRWATCHER_PATH_NONE)
+    {
+        return false;
+    }
+
+    //
+    // Relink; the subtree below node is not touched
+    //
+
+    _child_bucket_remove(table, node);
+    _unlink_node(table, node);
+    _comp_release(table, table->component[node]);
+
+    table->component[node] = comp;
+
+    _link_node(table, node, new_parent);
+    _child_bucket_insert(table, table->child_buckets, table->child_mask, node);
+
+    return true;
+}
+
+size_t _dirwatcher_path_table_build_path(const _dirwatcher_path_table_t* table, uint32_t node, char* buf, size_t buf_len)
+{
+    if (!_dirwatcher_path_table_is_valid(table, node))
+    {
+        return 0;
+    }
+
+    size_t required = 1;
+
+    for (uint32_t p = node; p != DIRWATCHER_PATH_ROOT; p = table->parent[p])
+    {
+        required += strlen(table->pool + table->comp_offset[table->component[p]]) + (p != node ? 1 : 0);
+    }
+
+    if (!buf)
+    {
+        return required;
+    }
+
+    if (buf_len < required)
+    {
+        return 0;
+    }
+
+    //
+    // Fill from the end
+    //
+
+    char* end = buf + required - 1;
+
+    *end = '\0';
+
+    for (uint32_t p = node; p != DIRWATCHER_PATH_ROOT; p = table->parent[p])
+    {
+        const char* text = table->pool + table->comp_offset[table->component[p]];
+        size_t      len  = strlen(text);
+
+        if (p != node)
+        {
+            *--end = DIRWATCHER_PATH_SEPARATOR;
+        }
+
+        end -= len;
+        memcpy(end, text, len);
+    }
+
+    return required;
+}
+
+const char* _dirwatcher_path_table_name(const _dirwatcher_path_table_t* table, uint32_t node)
+{
+    if (node == DIRWATCHER_PATH_ROOT || !_dirwatcher_path_table_is_valid(table, node))
+    {
+        return "";
+    }
+
+    return table->pool + table->comp_offset[table->component[node]];
+}
+
+uint32_t _dirwatcher_path_table_parent(const _dirwatcher_path_table_t* table, uint32_t node)
+{
+    return table->parent[node];
+}
+
+uint32_t _dirwatcher_path_table_first_child(const _dirwatcher_path_table_t* table, uint32_t node)
+{
+    return table->first_child[node];
+}
+
+uint32_t _dirwatcher_path_table_next_sibling(const _dirwatcher_path_table_t* table, uint32_t node)
+{
+    return table->next_sibling[node];
+}
+
+uint32_t _dirwatcher_path_table_id_bound(const _dirwatcher_path_table_t* table)
+{
+    return table->node_bound;
+}
+
+uint32_t _dirwatcher_path_table_count(const _dirwatcher_path_table_t* table)
+{
+    return table->node_count;
+}
+
+size_t _dirwatcher_path_table_memory_usage(const _dirwatcher_path_table_t* table)
+{
+    return sizeof(_dirwatcher_path_table_t)                                 +
+           (size_t)table->node_capacity * 5 * sizeof(uint32_t)              +
+           ((size_t)table->child_mask + 1) * sizeof(uint32_t)               +
+           table->pool_capacity                                             +
+           (size_t)table->comp_capacity * 2 * sizeof(uint32_t)              +
+           ((size_t)table->comp_mask + 1) * sizeof(uint32_t);
+}
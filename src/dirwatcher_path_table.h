@@ -0,0 +1,106 @@
+/*
+    DIRWATCHER_PATH_TABLE.H
+      Private compact table of relative paths
+
+    Paths are stored as a tree of interned components. Every node is a dense
+    id into flat arrays (parent, component, first child, siblings), so
+    per-node state of a consumer lives in its own arrays indexed by node id.
+    Moving a node relinks it under its new parent; descendants are untouched.
+    Full paths are rebuilt on demand into the caller's buffer.
+
+    Not thread-safe; the owner serializes access.
+*/
+
+#ifndef DIRWATCHER_PATH_TABLE_H
+#define DIRWATCHER_PATH_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DIRWATCHER_PATH_NONE      UINT32_MAX
+#define DIRWATCHER_PATH_ROOT      0
+#define DIRWATCHER_PATH_SEPARATOR '\\'
+
+typedef struct _dirwatcher_path_table _dirwatcher_path_table_t;
+
+/*
+    Creates a table holding only the root node.
+    With ignore_case, names that differ only in the case of ASCII letters
+    are the same component; it keeps the case it was first stored with.
+    Returns NULL on failure.
+*/
+_dirwatcher_path_table_t* _dirwatcher_path_table_create(bool ignore_case);
+
+void _dirwatcher_path_table_destroy(_dirwatcher_path_table_t* table);
+
+/*
+    Returns the child of parent named name, or DIRWATCHER_PATH_NONE.
+*/
+uint32_t _dirwatcher_path_table_lookup(const _dirwatcher_path_table_t* table, uint32_t parent, const char* name, size_t name_len);
+
+/*
+    Returns the child of parent named name, creating it if needed.
+    Returns DIRWATCHER_PATH_NONE on failure.
+*/
+uint32_t _dirwatcher_path_table_insert(_dirwatcher_path_table_t* table, uint32_t parent, const char* name, size_t name_len);
+
+/*
+    Resolves a separator-delimited path relative to the root ("" is the root).
+    Returns DIRWATCHER_PATH_NONE if any component is missing.
+*/
+uint32_t _dirwatcher_path_table_find(const _dirwatcher_path_table_t* table, const char* path);
+
+/*
+    Same as _dirwatcher_path_table_find but creates missing components.
+*/
+uint32_t _dirwatcher_path_table_insert_path(_dirwatcher_path_table_t* table, const char* path);
+
+/*
+    Removes node and its whole subtree. The root cannot be removed.
+*/
+void _dirwatcher_path_table_remove(_dirwatcher_path_table_t* table, uint32_t node);
+
+/*
+    Relinks node under new_parent with a new name. Descendants keep their ids.
+    Fails if the destination name exists or new_parent lies inside node's subtree.
+*/
+bool _dirwatcher_path_table_move(_dirwatcher_path_table_t* table, uint32_t node, uint32_t new_parent, const char* name, size_t name_len);
+
+/*
+    Writes node's path relative to the root.
+    If buf is NULL, returns required buffer length (including null-terminator).
+    Returns 0 if buf is too small.
+*/
+size_t _dirwatcher_path_table_build_path(const _dirwatcher_path_table_t* table, uint32_t node, char* buf /* NULLABLE */, size_t buf_len);
+
+/*
+    Returns the final component of node (null termed, "" for the root).
+*/
+const char* _dirwatcher_path_table_name(const _dirwatcher_path_table_t* table, uint32_t node);
+
+uint32_t _dirwatcher_path_table_parent(const _dirwatcher_path_table_t* table, uint32_t node);
+uint32_t _dirwatcher_path_table_first_child(const _dirwatcher_path_table_t* table, uint32_t node);
+uint32_t _dirwatcher_path_table_next_sibling(const _dirwatcher_path_table_t* table, uint32_t node);
+
+/*
+    Returns true if node is a live node of the table.
+*/
+bool _dirwatcher_path_table_is_valid(const _dirwatcher_path_table_t* table, uint32_t node);
+
+/*
+    Every node id is below this bound; size parallel arrays with it.
+*/
+uint32_t _dirwatcher_path_table_id_bound(const _dirwatcher_path_table_t* table);
+
+/*
+    Number of live nodes, including the root.
+*/
+uint32_t _dirwatcher_path_table_count(const _dirwatcher_path_table_t* table);
+
+/*
+    Heap bytes owned by the table.
+*/
+size_t _dirwatcher_path_table_memory_usage(const _dirwatcher_path_table_t* table);
+
+#endif
@@ -0,0 +1,1209 @@
+/* Includes *******************************************/
+
+#include <dirwatcher.h>
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "dirwatcher_path_table.h"
+#include "dirwatcher_poll_win32.h"
+
+/* Defines ********************************************/
+
+#define DIRWATCHER_POLL_LIST_BUFFER_SIZE  (64 * 1024)
+#define DIRWATCHER_POLL_FULL_SWEEP_PASSES 8     // Every Nth pass lists every directory
+#define DIRWATCHER_POLL_MAX_PARALLEL      16    // Concurrent stats and listings; remote file systems are latency bound
+
+/*
+    Snapshot of one path table node, indexed by node id.
+*/
+typedef struct _dirwatcher_poll_entry
+{
+    LONGLONG mtime;             // Last write time; for directories, as of their last listing (0: never listed)
+    LONGLONG size;
+    LONGLONG file_id;           // 0 if the file system has none
+    DWORD    attributes;
+    uint32_t pass;              // Last pass the entry was seen in its parent's listing
+} _dirwatcher_poll_entry_t;
+
+/*
+    One entry of a directory listing.
+*/
+typedef struct _dirwatcher_poll_found
+{
+    LONGLONG mtime;
+    LONGLONG size;
+    LONGLONG file_id;
+    DWORD    attributes;
+    uint32_t name_offset;       // Into the item's names
+    uint32_t name_count;        // Count of wchar
+} _dirwatcher_poll_found_t;
+
+/*
+    One directory to stat and, if needed, list. Filled by the thread pool,
+    merged into the snapshot by the polling thread.
+*/
+typedef struct _dirwatcher_poll_item
+{
+    uint32_t                  node;
+    wchar_t*                  path;
+    LONGLONG                  old_mtime;
+    bool                      force;            // List even if the last write time did not change
+
+    DWORD                     error;
+    LONGLONG                  mtime;
+    bool                      listed;
+    _dirwatcher_poll_found_t* found;
+    uint32_t                  found_count;
+    uint32_t                  found_capacity;
+    wchar_t*                  names;            // Not null termed
+    uint32_t                  names_count;
+    uint32_t                  names_capacity;
+} _dirwatcher_poll_item_t;
+
+typedef struct _dirwatcher_poll_batch
+{
+    _dirwatcher_poll_item_t* items;
+    LONG                     count;
+    volatile LONG            next;              // Next item to take; Interlocked-only
+    volatile LONG            running;           // Threads still draining; Interlocked-only
+    volatile LONG*           interrupt;
+    HANDLE                   done_event;
+} _dirwatcher_poll_batch_t;
+
+/*
+    An added or removed node waiting for rename pairing.
+*/
+typedef struct _dirwatcher_poll_change
+{
+    uint32_t node;
+    bool     paired;
+} _dirwatcher_poll_change_t;
+
+struct _dirwatcher_poller
+{
+    wchar_t*                   root_path;
+    _dirwatcher_path_table_t*  table;
+    _dirwatcher_poll_entry_t*  entries;
+    uint32_t                   entries_capacity;
+    uint32_t                   pass;
+    uint32_t                   directory_count; // Listable directories in the snapshot, including the root
+    uint32_t                   parallelism;
+    HANDLE                     done_event;      // Auto-reset; set by the last pool thread of a batch
+
+    //
+    // Scratch of one pass, kept to avoid reallocating
+    //
+
+    _dirwatcher_poll_item_t*   items;
+    uint32_t                   items_count;
+    uint32_t                   items_capacity;
+    uint32_t*                  new_dirs;        // Directories added this pass, listed after pairing
+    uint32_t                   new_dirs_count;
+    uint32_t                   new_dirs_capacity;
+    _dirwatcher_poll_change_t* added;
+    uint32_t                   added_count;
+    uint32_t                   added_capacity;
+    _dirwatcher_poll_change_t* removed;
+    uint32_t                   removed_count;
+    uint32_t                   removed_capacity;
+    uint32_t*                  id_buckets;      // Added index + 1 by file id; 0 is empty
+    uint32_t                   id_mask;
+    char*                      path_buf;
+    size_t                     path_capacity;
+    char*                      old_path_buf;
+    size_t                     old_path_capacity;
+    char*                      name_buf;
+    size_t                     name_capacity;
+
+    _dirwatcher_poll_emit_t    emit;
+    void*                      context;
+    _dirwatcher_poll_filter_t  filter;          // NULL: none
+    void*                      filter_context;
+    bool                       quiet;           // Baseline pass: record without emitting
+    bool                       baseline_done;   // The whole tree was listed once; passes stay quiet until then
+    bool                       changed;
+};
+
+/* Private functions **********************************/
+
+static bool _reserve(void** p_array, uint32_t* p_capacity, uint32_t needed, size_t elem_size)
+{
+    if (needed <= *p_capacity)
+    {
+        return true;
+    }
+
+    uint32_t capacity = *p_capacity ? *p_capacity : 16;
+
+    while (capacity < needed)
+    {
+        capacity *= 2;
+    }
+
+    void* array = realloc(*p_array, (size_t)capacity * elem_size);
+
+    if (!array)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return false;
+    }
+
+    *p_array    = array;
+    *p_capacity = capacity;
+    return true;
+}
+
+static bool _reserve_bytes(char** p_buf, size_t* p_capacity, size_t needed)
+{
+    if (needed <= *p_capacity)
+    {
+        return true;
+    }
+
+    char* buf = realloc(*p_buf, needed);
+
+    if (!buf)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return false;
+    }
+
+    *p_buf      = buf;
+    *p_capacity = needed;
+    return true;
+}
+
+static LONGLONG _large_to_int(LARGE_INTEGER value)
+{
+    return value.QuadPart;
+}
+
+static LONGLONG _filetime_to_int(FILETIME ft)
+{
+    return (LONGLONG)(((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime);
+}
+
+static bool _is_listable(DWORD attributes)
+{
+    //
+    // Reparse points (junctions, symbolic links) are not followed, as with the native backend
+    //
+
+    return (attributes & FILE_ATTRIBUTE_DIRECTORY) && !(attributes & FILE_ATTRIBUTE_REPARSE_POINT);
+}
+
+static bool _is_dot_name(const wchar_t* name, DWORD name_count)
+{
+    return (name_count == 1 && name[0] == L'.') ||
+           (name_count == 2 && name[0] == L'.' && name[1] == L'.');
+}
+
+static bool _reserve_entries(_dirwatcher_poller_t* poller)
+{
+    uint32_t old_capacity = poller->entries_capacity;
+    uint32_t bound        = _dirwatcher_path_table_id_bound(poller->table);
+
+    if (!_reserve((void**)&poller->entries, &poller->entries_capacity, bound, sizeof(_dirwatcher_poll_entry_t)))
+    {
+        return false;
+    }
+
+    memset(poller->entries + old_capacity, 0, (size_t)(poller->entries_capacity - old_capacity) * sizeof(_dirwatcher_poll_entry_t));
+    return true;
+}
+
+/*
+    Builds node's path relative to the root into *p_buf.
+*/
+static const char* _build_path(_dirwatcher_poller_t* poller, uint32_t node, char** p_buf, size_t* p_capacity)
+{
+    size_t len = _dirwatcher_path_table_build_path(poller->table, node, NULL, 0);
+
+    if (!_reserve_bytes(p_buf, p_capacity, len))
+    {
+        return NULL;
+    }
+
+    _dirwatcher_path_table_build_path(poller->table, node, *p_buf, *p_capacity);
+    return *p_buf;
+}
+
+/*
+    Returns a new full path of node (root path + relative path).
+*/
+static wchar_t* _build_full_path(_dirwatcher_poller_t* poller, uint32_t node)
+{
+    const char* rel_path = _build_path(poller, node, &poller->path_buf, &poller->path_capacity);
+
+    if (!rel_path)
+    {
+        return NULL;
+    }
+
+    size_t   root_count = wcslen(poller->root_path);
+    int      rel_count  = MultiByteToWideChar(CP_UTF8, 0, rel_path, -1, NULL, 0);
+    wchar_t* full_path  = malloc((root_count + 1 + rel_count) * sizeof(wchar_t));
+
+    if (!full_path)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+
+    memcpy(full_path, poller->root_path, root_count * sizeof(wchar_t));
+
+    if (rel_path[0])
+    {
+        full_path[root_count++] = L'\\';
+    }
+
+    MultiByteToWideChar(CP_UTF8, 0, rel_path, -1, full_path + root_count, rel_count);
+    return full_path;
+}
+
+static bool _emit_node(_dirwatcher_poller_t* poller, dirwatcher_event_t event, uint32_t node)
+{
+    if (poller->quiet)
+    {
+        return true;
+    }
+
+    const char* path = _build_path(poller, node, &poller->path_buf, &poller->path_capacity);
+
+    if (!path)
+    {
+        return false;
+    }
+
+    poller->changed = true;
+    return poller->emit(poller->context, event, path, NULL);
+}
+
+/*
+    Reports node and everything below it as removed (children first) and
+    drops them from the snapshot.
+*/
+static bool _remove_subtree(_dirwatcher_poller_t* poller, uint32_t node)
+{
+    uint32_t cur = node;
+    uint32_t next;
+
+    while ((next = _dirwatcher_path_table_first_child(poller->table, cur)) != DIRWATCHER_PATH_NONE)
+    {
+        cur = next;
+    }
+
+    for (;;)
+    {
+        if (!_emit_node(poller, DIRWATCHER_EVENT_REMOVED, cur))
+        {
+            return false;
+        }
+
+        if (_is_listable(poller->entries[cur].attributes))
+        {
+            poller->directory_count--;
+        }
+
+        if (cur == node)
+        {
+            break;
+        }
+
+        next = _dirwatcher_path_table_next_sibling(poller->table, cur);
+
+        if (next != DIRWATCHER_PATH_NONE)
+        {
+            cur = next;
+
+            while ((next = _dirwatcher_path_table_first_child(poller->table, cur)) != DIRWATCHER_PATH_NONE)
+            {
+                cur = next;
+            }
+        }
+        else
+        {
+            cur = _dirwatcher_path_table_parent(poller->table, cur);
+        }
+    }
+
+    _dirwatcher_path_table_remove(poller->table, node);
+    return true;
+}
+
+/* Directory listing (thread pool) ********************/
+
+static bool _append_found(_dirwatcher_poll_item_t* item, const FILE_ID_BOTH_DIR_INFO* info)
+{
+    uint32_t name_count = info->FileNameLength / sizeof(wchar_t);
+
+    if (!_reserve((void**)&item->found, &item->found_capacity, item->found_count + 1, sizeof(_dirwatcher_poll_found_t)) ||
+        !_reserve((void**)&item->names, &item->names_capacity, item->names_count + name_count, sizeof(wchar_t)))
+    {
+        return false;
+    }
+
+    _dirwatcher_poll_found_t* found = &item->found[item->found_count++];
+
+    found->mtime       = _large_to_int(info->LastWriteTime);
+    found->size        = _large_to_int(info->EndOfFile);
+    found->file_id     = _large_to_int(info->FileId);
+    found->attributes  = info->FileAttributes;
+    found->name_offset = item->names_count;
+    found->name_count  = name_count;
+
+    memcpy(item->names + item->names_count, info->FileName, name_count * sizeof(wchar_t));
+    item->names_count += name_count;
+
+    return true;
+}
+
+/*
+    Lists a directory with its file ids, times and sizes in one call per
+    buffer, so entries need no separate stat.
+*/
+static DWORD _list_directory(_dirwatcher_poll_item_t* item)
+{
+    HANDLE handle = CreateFileW(item->path,
+                                FILE_LIST_DIRECTORY,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                NULL,
+                                OPEN_EXISTING,
+                                FILE_FLAG_BACKUP_SEMANTICS,
+                                NULL);
+
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return GetLastError();
+    }
+
+    BYTE* buffer = malloc(DIRWATCHER_POLL_LIST_BUFFER_SIZE);   // malloc alignment suffices for the 8-byte records
+    DWORD error  = ERROR_SUCCESS;
+
+    if (!buffer)
+    {
+        CloseHandle(handle);
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+
+    FILE_INFO_BY_HANDLE_CLASS info_class = FileIdBothDirectoryRestartInfo;
+
+    while (error == ERROR_SUCCESS)
+    {
+        if (!GetFileInformationByHandleEx(handle, info_class, buffer, DIRWATCHER_POLL_LIST_BUFFER_SIZE))
+        {
+            error = GetLastError();
+            break;
+        }
+
+        info_class = FileIdBothDirectoryInfo;
+
+        for (const BYTE* cur = buffer; ; )
+        {
+            const FILE_ID_BOTH_DIR_INFO* info = (const FILE_ID_BOTH_DIR_INFO*)cur;
+
+            if (!_is_dot_name(info->FileName, info->FileNameLength / sizeof(wchar_t)) && !_append_found(item, info))
+            {
+                error = ERROR_NOT_ENOUGH_MEMORY;
+                break;
+            }
+
+            if (!info->NextEntryOffset)
+            {
+                break;
+            }
+
+            cur += info->NextEntryOffset;
+        }
+    }
+
+    free(buffer);
+    CloseHandle(handle);
+
+    return error == ERROR_NO_MORE_FILES ? ERROR_SUCCESS : error;
+}
+
+static void _poll_item(_dirwatcher_poll_item_t* item)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+
+    if (!GetFileAttributesExW(item->path, GetFileExInfoStandard, &data))
+    {
+        item->error = GetLastError();
+        return;
+    }
+
+    if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        item->error = ERROR_DIRECTORY;
+        return;
+    }
+
+    //
+    // Stat before listing: a change that lands in between is listed again next pass
+    //
+
+    item->mtime = _filetime_to_int(data.ftLastWriteTime);
+
+    if (!item->force && item->mtime == item->old_mtime)
+    {
+        return;
+    }
+
+    item->error  = _list_directory(item);
+    item->listed = item->error == ERROR_SUCCESS;
+}
+
+static void _drain_batch(_dirwatcher_poll_batch_t* batch)
+{
+    for (;;)
+    {
+        LONG i = InterlockedIncrement(&batch->next) - 1;
+
+        if (i >= batch->count)
+        {
+            return;
+        }
+
+        if (InterlockedCompareExchange(batch->interrupt, 0, 0))
+        {
+            batch->items[i].error = ERROR_OPERATION_ABORTED;
+            continue;
+        }
+
+        _poll_item(&batch->items[i]);
+    }
+}
+
+static void CALLBACK _batch_callback(PTP_CALLBACK_INSTANCE instance, PVOID context)
+{
+    (void)instance;
+
+    _dirwatcher_poll_batch_t* batch = context;
+
+    _drain_batch(batch);
+
+    if (InterlockedDecrement(&batch->running) == 0)
+    {
+        SetEvent(batch->done_event);
+    }
+}
+
+/*
+    Polls the pending items on the calling thread and up to parallelism - 1
+    thread pool threads. Returns when every item is done.
+*/
+static void _run_batch(_dirwatcher_poller_t* poller, volatile LONG* interrupt)
+{
+    _dirwatcher_poll_batch_t batch = { 0 };
+
+    batch.items      = poller->items;
+    batch.count      = (LONG)poller->items_count;
+    batch.next       = 0;
+    batch.running    = 1;   // The calling thread
+    batch.interrupt  = interrupt;
+    batch.done_event = poller->done_event;
+
+    uint32_t helpers = min(poller->parallelism - 1, poller->items_count ? poller->items_count - 1 : 0);
+
+    for (uint32_t i = 0; i < helpers; i++)
+    {
+        InterlockedIncrement(&batch.running);
+
+        if (!TrySubmitThreadpoolCallback(_batch_callback, &batch, NULL))
+        {
+            InterlockedDecrement(&batch.running);
+            break;
+        }
+    }
+
+    _drain_batch(&batch);
+
+    if (InterlockedDecrement(&batch.running) != 0)
+    {
+        WaitForSingleObject(poller->done_event, INFINITE);
+    }
+}
+
+/* Snapshot *******************************************/
+
+static bool _push_item(_dirwatcher_poller_t* poller, uint32_t node, bool force)
+{
+    if (!_reserve((void**)&poller->items, &poller->items_capacity, poller->items_count + 1, sizeof(_dirwatcher_poll_item_t)))
+    {
+        return false;
+    }
+
+    wchar_t* path = _build_full_path(poller, node);
+
+    if (!path)
+    {
+        return false;
+    }
+
+    _dirwatcher_poll_item_t* item = &poller->items[poller->items_count++];
+
+    memset(item, 0, sizeof(*item));
+    item->node      = node;
+    item->path      = path;
+    item->old_mtime = poller->entries[node].mtime;
+    item->force     = force;
+
+    return true;
+}
+
+static void _clear_items(_dirwatcher_poller_t* poller)
+{
+    for (uint32_t i = 0; i < poller->items_count; i++)
+    {
+        free(poller->items[i].path);
+        free(poller->items[i].found);
+        free(poller->items[i].names);
+    }
+
+    poller->items_count = 0;
+}
+
+static bool _push_change(_dirwatcher_poll_change_t** p_changes, uint32_t* p_count, uint32_t* p_capacity, uint32_t node)
+{
+    if (!_reserve((void**)p_changes, p_capacity, *p_count + 1, sizeof(_dirwatcher_poll_change_t)))
+    {
+        return false;
+    }
+
+    (*p_changes)[*p_count].node   = node;
+    (*p_changes)[*p_count].paired = false;
+    (*p_count)++;
+
+    return true;
+}
+
+static bool _push_new_dir(_dirwatcher_poller_t* poller, uint32_t node)
+{
+    if (!_reserve((void**)&poller->new_dirs, &poller->new_dirs_capacity, poller->new_dirs_count + 1, sizeof(uint32_t)))
+    {
+        return false;
+    }
+
+    poller->new_dirs[poller->new_dirs_count++] = node;
+    return true;
+}
+
+/*
+    Diffs one listing against the snapshot. Modifications are emitted right
+    away; additions and removals are collected for rename pairing.
+*/
+static bool _merge_listing(_dirwatcher_poller_t* poller, const _dirwatcher_poll_item_t* item)
+{
+    _dirwatcher_path_table_t* table   = poller->table;
+    uint32_t                  parent  = item->node;
+    const wchar_t*            rel_dir = item->path + wcslen(poller->root_path);
+
+    if (*rel_dir == L'\\')
+    {
+        rel_dir++;
+    }
+
+    for (uint32_t i = 0; i < item->found_count; i++)
+    {
+        const _dirwatcher_poll_found_t* found = &item->found[i];
+
+        //
+        // Name to UTF-8
+        //
+
+        int name_len = WideCharToMultiByte(CP_UTF8, 0, item->names + found->name_offset, (int)found->name_count, NULL, 0, NULL, FALSE);
+
+        if (name_len <= 0 || !_reserve_bytes(&poller->name_buf, &poller->name_capacity, (size_t)name_len))
+        {
+            return false;
+        }
+
+        WideCharToMultiByte(CP_UTF8, 0, item->names + found->name_offset, (int)found->name_count, poller->name_buf, name_len, NULL, FALSE);
+
+        //
+        // Known entry
+        //
+
+        uint32_t child = _dirwatcher_path_table_lookup(table, parent, poller->name_buf, (size_t)name_len);
+
+        //
+        // Filtered out: forget it without a report
+        //
+
+        if (poller->filter &&
+            poller->filter(poller->filter_context,
+                           rel_dir,
+                           (uint32_t)wcslen(rel_dir),
+                           item->names + found->name_offset,
+                           found->name_count,
+                           (found->attributes & FILE_ATTRIBUTE_DIRECTORY) != 0))
+        {
+            bool quiet = poller->quiet;
+
+            poller->quiet = true;
+
+            if (child != DIRWATCHER_PATH_NONE && !_remove_subtree(poller, child))
+            {
+                poller->quiet = quiet;
+                return false;
+            }
+
+            poller->quiet = quiet;
+            continue;
+        }
+
+        if (child != DIRWATCHER_PATH_NONE &&
+            ((poller->entries[child].attributes ^ found->attributes) & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            //
+            // Replaced by an entry of the other kind
+            //
+
+            if (!_remove_subtree(poller, child))
+            {
+                return false;
+            }
+
+            child = DIRWATCHER_PATH_NONE;
+        }
+
+        if (child != DIRWATCHER_PATH_NONE)
+        {
+            _dirwatcher_poll_entry_t* entry = &poller->entries[child];
+
+            if (!(found->attributes & FILE_ATTRIBUTE_DIRECTORY) &&
+                (entry->mtime != found->mtime || entry->size != found->size))
+            {
+                entry->mtime = found->mtime;
+                entry->size  = found->size;
+
+                if (!_emit_node(poller, DIRWATCHER_EVENT_MODIFIED, child))
+                {
+                    return false;
+                }
+            }
+
+            entry->file_id    = found->file_id;
+            entry->attributes = found->attributes;
+            entry->pass       = poller->pass;
+            continue;
+        }
+
+        //
+        // New entry
+        //
+
+        child = _dirwatcher_path_table_insert(table, parent, poller->name_buf, (size_t)name_len);
+
+        if (child == DIRWATCHER_PATH_NONE)
+        {
+            SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            return false;
+        }
+
+        if (!_reserve_entries(poller))
+        {
+            return false;
+        }
+
+        _dirwatcher_poll_entry_t* entry = &poller->entries[child];
+
+        entry->mtime      = _is_listable(found->attributes) ? 0 : found->mtime;
+        entry->size       = found->size;
+        entry->file_id    = found->file_id;
+        entry->attributes = found->attributes;
+        entry->pass       = poller->pass;
+
+        if (_is_listable(found->attributes))
+        {
+            poller->directory_count++;
+        }
+
+        if (!_push_change(&poller->added, &poller->added_count, &poller->added_capacity, child))
+        {
+            return false;
+        }
+    }
+
+    //
+    // Entries missing from the listing
+    //
+
+    for (uint32_t child = _dirwatcher_path_table_first_child(table, parent);
+         child != DIRWATCHER_PATH_NONE;
+         child = _dirwatcher_path_table_next_sibling(table, child))
+    {
+        if (poller->entries[child].pass != poller->pass &&
+            !_push_change(&poller->removed, &poller->removed_count, &poller->removed_capacity, child))
+        {
+            return false;
+        }
+    }
+
+    poller->entries[parent].mtime = item->mtime;
+    return true;
+}
+
+static uint32_t _find_added_by_id(_dirwatcher_poller_t* poller, LONGLONG file_id, DWORD attributes)
+{
+    uint32_t i = (uint32_t)((ULONGLONG)file_id * 0x9E3779B97F4A7C15ULL >> 32) & poller->id_mask;
+
+    while (poller->id_buckets[i])
+    {
+        uint32_t                   index = poller->id_buckets[i] - 1;
+        _dirwatcher_poll_change_t* added = &poller->added[index];
+
+        if (!added->paired &&
+            poller->entries[added->node].file_id == file_id &&
+            !((poller->entries[added->node].attributes ^ attributes) & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            return index;
+        }
+
+        i = (i + 1) & poller->id_mask;
+    }
+
+    return DIRWATCHER_PATH_NONE;
+}
+
+static bool _index_added_by_id(_dirwatcher_poller_t* poller)
+{
+    uint32_t bucket_count = 16;
+
+    while (bucket_count < poller->added_count * 2)
+    {
+        bucket_count *= 2;
+    }
+
+    uint32_t* buckets = realloc(poller->id_buckets, bucket_count * sizeof(uint32_t));
+
+    if (!buckets)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return false;
+    }
+
+    memset(buckets, 0, bucket_count * sizeof(uint32_t));
+    poller->id_buckets = buckets;
+    poller->id_mask    = bucket_count - 1;
+
+    for (uint32_t index = 0; index < poller->added_count; index++)
+    {
+        LONGLONG file_id = poller->entries[poller->added[index].node].file_id;
+
+        if (!file_id)
+        {
+            continue;
+        }
+
+        uint32_t i = (uint32_t)((ULONGLONG)file_id * 0x9E3779B97F4A7C15ULL >> 32) & poller->id_mask;
+
+        while (buckets[i])
+        {
+            i = (i + 1) & poller->id_mask;
+        }
+
+        buckets[i] = index + 1;
+    }
+
+    return true;
+}
+
+/*
+    Moves the removed node to the place of the added one.
+    *p_moved is false if the snapshot could not be relinked.
+    Returns false on memory failure.
+*/
+static bool _relink(_dirwatcher_poller_t* poller, uint32_t removed_node, _dirwatcher_poll_change_t* added, bool* p_moved)
+{
+    _dirwatcher_path_table_t* table      = poller->table;
+    _dirwatcher_poll_entry_t  new_entry  = poller->entries[added->node];
+    uint32_t                  new_parent = _dirwatcher_path_table_parent(table, added->node);
+    const char*               name       = _dirwatcher_path_table_name(table, added->node);
+    size_t                    name_len   = strlen(name);
+
+    if (!_reserve_bytes(&poller->name_buf, &poller->name_capacity, name_len + 1))
+    {
+        return false;
+    }
+
+    memcpy(poller->name_buf, name, name_len + 1);
+
+    //
+    // The added node is a fresh leaf (new directories are listed after pairing)
+    //
+
+    _dirwatcher_path_table_remove(table, added->node);
+
+    if (_is_listable(new_entry.attributes))
+    {
+        poller->directory_count--;
+    }
+
+    if (!_dirwatcher_path_table_move(table, removed_node, new_parent, poller->name_buf, name_len))
+    {
+        //
+        // Only a racing listing can make this fail; put the added node back
+        //
+
+        added->node = _dirwatcher_path_table_insert(table, new_parent, poller->name_buf, name_len);
+
+        if (added->node == DIRWATCHER_PATH_NONE || !_reserve_entries(poller))
+        {
+            SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            return false;
+        }
+
+        poller->entries[added->node] = new_entry;
+        poller->directory_count     += _is_listable(new_entry.attributes) ? 1 : 0;
+        *p_moved                     = false;
+        return true;
+    }
+
+    //
+    // A moved directory keeps its own snapshot; a file takes the listed state
+    //
+
+    _dirwatcher_poll_entry_t* entry = &poller->entries[removed_node];
+
+    if (!_is_listable(entry->attributes))
+    {
+        entry->mtime = new_entry.mtime;
+        entry->size  = new_entry.size;
+    }
+
+    entry->attributes = new_entry.attributes;
+    entry->pass       = poller->pass;
+
+    added->paired = true;
+    *p_moved      = true;
+    return true;
+}
+
+static bool _emit_changes(_dirwatcher_poller_t* poller)
+{
+    bool success = true;
+
+    if (poller->added_count && poller->removed_count && !_index_added_by_id(poller))
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; success && i < poller->removed_count; i++)
+    {
+        uint32_t node = poller->removed[i].node;
+
+        if (!_dirwatcher_path_table_is_valid(poller->table, node))
+        {
+            continue;
+        }
+
+        //
+        // Rename: same file id removed in one place and added in another
+        //
+
+        _dirwatcher_poll_entry_t* entry = &poller->entries[node];
+        uint32_t                  index = poller->added_count && entry->file_id
+                                              ? _find_added_by_id(poller, entry->file_id, entry->attributes)
+                                              : DIRWATCHER_PATH_NONE;
+
+        if (index != DIRWATCHER_PATH_NONE)
+        {
+            if (!_build_path(poller, node, &poller->old_path_buf, &poller->old_path_capacity))
+            {
+                return false;
+            }
+
+            bool moved;
+
+            if (!_relink(poller, node, &poller->added[index], &moved))
+            {
+                return false;
+            }
+
+            if (moved)
+            {
+                const char* path = _build_path(poller, node, &poller->path_buf, &poller->path_capacity);
+
+                if (!path)
+                {
+                    return false;
+                }
+
+                poller->changed = true;
+                success         = poller->emit(poller->context, DIRWATCHER_EVENT_RENAMED, path, poller->old_path_buf);
+                continue;
+            }
+        }
+
+        success = _remove_subtree(poller, node);
+    }
+
+    for (uint32_t i = 0; success && i < poller->added_count; i++)
+    {
+        uint32_t node = poller->added[i].node;
+
+        if (poller->added[i].paired || !_dirwatcher_path_table_is_valid(poller->table, node))
+        {
+            continue;
+        }
+
+        success = _emit_node(poller, DIRWATCHER_EVENT_ADDED, node) &&
+                  (!_is_listable(poller->entries[node].attributes) || _push_new_dir(poller, node));
+    }
+
+    poller->added_count   = 0;
+    poller->removed_count = 0;
+
+    return success;
+}
+
+/*
+    Lists known directories: every one on a full sweep, otherwise only those
+    whose last write time changed.
+*/
+static bool _scan_known_dirs(_dirwatcher_poller_t* poller, volatile LONG* interrupt, bool full)
+{
+    _dirwatcher_path_table_t* table = poller->table;
+    uint32_t                  node  = DIRWATCHER_PATH_ROOT;
+    bool                      success = true;
+
+    //
+    // Collect directories in pre-order so parents merge before their children
+    //
+
+    for (;;)
+    {
+        bool listable = _is_listable(poller->entries[node].attributes);
+
+        if (listable && !_push_item(poller, node, full))
+        {
+            _clear_items(poller);
+            return false;
+        }
+
+        uint32_t next = listable ? _dirwatcher_path_table_first_child(table, node) : DIRWATCHER_PATH_NONE;
+
+        while (next == DIRWATCHER_PATH_NONE && node != DIRWATCHER_PATH_ROOT)
+        {
+            next = _dirwatcher_path_table_next_sibling(table, node);
+            node = next == DIRWATCHER_PATH_NONE ? _dirwatcher_path_table_parent(table, node) : node;
+        }
+
+        if (next == DIRWATCHER_PATH_NONE)
+        {
+            break;
+        }
+
+        node = next;
+    }
+
+    _run_batch(poller, interrupt);
+
+    //
+    // The root itself must stay readable
+    //
+
+    if (poller->items[0].error != ERROR_SUCCESS && poller->items[0].error != ERROR_OPERATION_ABORTED)
+    {
+        SetLastError(poller->items[0].error);
+        _clear_items(poller);
+        return false;
+    }
+
+    //
+    // Unreadable directories are skipped; a vanished one is reported by its parent's listing
+    //
+
+    for (uint32_t i = 0; success && i < poller->items_count; i++)
+    {
+        if (poller->items[i].listed && _dirwatcher_path_table_is_valid(table, poller->items[i].node))
+        {
+            success = _merge_listing(poller, &poller->items[i]);
+        }
+    }
+
+    _clear_items(poller);
+
+    //
+    // Pairing needs no I/O and always runs, so no addition is left unreported
+    //
+
+    return _emit_changes(poller) && success;
+}
+
+/*
+    Lists new directories level by level; everything in them is new.
+*/
+static bool _scan_new_dirs(_dirwatcher_poller_t* poller, volatile LONG* interrupt)
+{
+    bool success = true;
+
+    while (success && poller->new_dirs_count && !InterlockedCompareExchange(interrupt, 0, 0))
+    {
+        for (uint32_t i = 0; success && i < poller->new_dirs_count; i++)
+        {
+            success = _push_item(poller, poller->new_dirs[i], true);
+        }
+
+        poller->new_dirs_count = 0;
+
+        if (success)
+        {
+            _run_batch(poller, interrupt);
+        }
+
+        for (uint32_t i = 0; success && i < poller->items_count; i++)
+        {
+            _dirwatcher_poll_item_t* item = &poller->items[i];
+
+            if (item->node == DIRWATCHER_PATH_ROOT && item->error != ERROR_SUCCESS && item->error != ERROR_OPERATION_ABORTED)
+            {
+                SetLastError(item->error);
+                success = false;
+            }
+            else if (item->listed && _dirwatcher_path_table_is_valid(poller->table, item->node))
+            {
+                success = _merge_listing(poller, item);
+            }
+        }
+
+        _clear_items(poller);
+
+        success = _emit_changes(poller) && success;
+    }
+
+    //
+    // Directories left over are listed on the next pass (their mtime is still 0)
+    //
+
+    poller->new_dirs_count = 0;
+    return success;
+}
+
+/* Public functions ***********************************/
+
+_dirwatcher_poller_t* _dirwatcher_poller_create(const wchar_t* root_path)
+{
+    _dirwatcher_poller_t* poller = calloc(1, sizeof(_dirwatcher_poller_t));
+
+    if (!poller)
+    {
+        return NULL;
+    }
+
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+
+    poller->parallelism = min(max(system_info.dwNumberOfProcessors, 1), DIRWATCHER_POLL_MAX_PARALLEL);
+    poller->root_path   = _wcsdup(root_path);
+    poller->table       = _dirwatcher_path_table_create(false);
+    poller->done_event  = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+    if (!poller->root_path || !poller->table || !poller->done_event || !_reserve_entries(poller))
+    {
+        _dirwatcher_poller_destroy(poller);
+        return NULL;
+    }
+
+    poller->entries[DIRWATCHER_PATH_ROOT].attributes = FILE_ATTRIBUTE_DIRECTORY;
+    poller->directory_count                          = 1;
+
+    return poller;
+}
+
+void _dirwatcher_poller_destroy(_dirwatcher_poller_t* poller)
+{
+    if (!poller)
+    {
+        return;
+    }
+
+    _clear_items(poller);
+
+    if (poller->done_event)
+    {
+        CloseHandle(poller->done_event);
+    }
+
+    _dirwatcher_path_table_destroy(poller->table);
+
+    free(poller->root_path);
+    free(poller->entries);
+    free(poller->items);
+    free(poller->new_dirs);
+    free(poller->added);
+    free(poller->removed);
+    free(poller->id_buckets);
+    free(poller->path_buf);
+    free(poller->old_path_buf);
+    free(poller->name_buf);
+    free(poller);
+}
+
+void _dirwatcher_poller_set_filter(_dirwatcher_poller_t* poller, _dirwatcher_poll_filter_t filter /* NULLABLE */, void* context)
+{
+    poller->filter         = filter;
+    poller->filter_context = context;
+}
+
+bool _dirwatcher_poller_scan(_dirwatcher_poller_t*   poller,
+                             _dirwatcher_poll_emit_t emit,
+                             void*                   context,
+                             volatile LONG*          interrupt,
+                             bool*                   p_changed)
+{
+    bool success;
+
+    poller->emit    = emit;
+    poller->context = context;
+    poller->changed = false;
+    poller->quiet   = !poller->baseline_done;
+    poller->pass++;
+
+    if (poller->pass == 1)
+    {
+        //
+        // Baseline: the whole tree is one new directory
+        //
+
+        success = _push_new_dir(poller, DIRWATCHER_PATH_ROOT) && _scan_new_dirs(poller, interrupt);
+    }
+    else
+    {
+        //
+        // Directories an interrupted baseline did not reach still have mtime 0
+        // and are listed here; what they hold is not new
+        //
+
+        success = _scan_known_dirs(poller, interrupt, poller->pass % DIRWATCHER_POLL_FULL_SWEEP_PASSES == 0) &&
+                  _scan_new_dirs(poller, interrupt);
+    }
+
+    //
+    // Uninterrupted, _scan_new_dirs only returns once no new directory is left
+    //
+
+    if (success && !InterlockedCompareExchange(interrupt, 0, 0))
+    {
+        poller->baseline_done = true;
+    }
+
+    *p_changed = poller->changed;
+    return success;
+}
+
+uint32_t _dirwatcher_poller_get_directory_count(const _dirwatcher_poller_t* poller)
+{
+    return poller->directory_count;
+}
+
+bool _dirwatcher_poller_has_baseline(const _dirwatcher_poller_t* poller)
+{
+    return poller->baseline_done;
+}
@@ -0,0 +1,79 @@
+/*
+    DIRWATCHER_POLL_WIN32.H
+      Private interface of the polling backend
+
+    A pass stats every known directory and lists only those whose last write
+    time changed; every few passes all directories are listed, which catches
+    in-place writes that do not touch the directory. Listings are diffed
+    against the previous pass, kept in a path table. A removed and an added
+    entry with the same file id are reported as one rename and the snapshot
+    node is relinked, so a moved directory is not rescanned.
+*/
+
+#ifndef DIRWATCHER_POLL_WIN32_H
+#define DIRWATCHER_POLL_WIN32_H
+
+#include <dirwatcher.h>
+
+#include <Windows.h>
+
+typedef struct _dirwatcher_poller _dirwatcher_poller_t;
+
+/*
+    Receives one change. name and old_name are only valid during the call.
+    Returns false to abort the pass; GetLastError() must hold the reason.
+*/
+typedef bool (*_dirwatcher_poll_emit_t)(void* context, dirwatcher_event_t event, const char* name, const char* old_name /* NULLABLE */);
+
+/*
+    Decides whether an entry is left out of the snapshot, as if it did not
+    exist. dir is the entry's directory relative to the root ("" for the
+    root); neither string is null termed.
+*/
+typedef bool (*_dirwatcher_poll_filter_t)(void*          context,
+                                          const wchar_t* dir,
+                                          uint32_t       dir_count,
+                                          const wchar_t* name,
+                                          uint32_t       name_count,
+                                          bool           is_dir);
+
+/*
+    Creates a poller for root_path (full path, may carry the \\?\ prefix).
+    Returns NULL on failure.
+*/
+_dirwatcher_poller_t* _dirwatcher_poller_create(const wchar_t* root_path);
+
+void _dirwatcher_poller_destroy(_dirwatcher_poller_t* poller);
+
+/*
+    Sets the filter of later passes (NULL: none). Entries the filter starts
+    to exclude are dropped from the snapshot without being reported.
+*/
+void _dirwatcher_poller_set_filter(_dirwatcher_poller_t* poller, _dirwatcher_poll_filter_t filter /* NULLABLE */, void* context);
+
+/*
+    Runs one pass. Passes record the tree without emitting until one
+    completes uninterrupted: the baseline.
+    Stops early, returning true, once *interrupt is non-zero; the rest is
+    picked up by the next pass.
+
+    *p_changed receives whether anything was emitted.
+    Returns false if the root cannot be read or emit fails; GetLastError() holds the reason.
+*/
+bool _dirwatcher_poller_scan(_dirwatcher_poller_t*   poller,
+                             _dirwatcher_poll_emit_t emit,
+                             void*                   context,
+                             volatile LONG*          interrupt,
+                             bool*                   p_changed);
+
+/*
+    Returns the number of directories the snapshot covers, including the root.
+*/
+uint32_t _dirwatcher_poller_get_directory_count(const _dirwatcher_poller_t* poller);
+
+/*
+    Returns true once a pass completed the baseline; changes are reported from then on.
+*/
+bool _dirwatcher_poller_has_baseline(const _dirwatcher_poller_t* poller);
+
+#endif
@@ -0,0 +1,584 @@
+/* Includes *******************************************/
+
+#include <dirwatcher.h>
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strsafe.h>
+
+#include "dirwatcher_shm_win32.h"
+
+/* Defines ********************************************/
+
+#define DIRWATCHER_SHM_MAGIC_NUMBER    0x474E495257444D53ULL // 'SMDWRING'
+#define DIRWATCHER_READER_MAGIC_NUMBER 0x5245444145524457ULL // 'WDREADER'
+#define DIRWATCHER_SHM_VERSION         3
+#define DIRWATCHER_SHM_ROOT_MAX        1024
+#define DIRWATCHER_SHM_SPIN_COUNT      4096
+#define DIRWATCHER_SHM_READ_RETRIES    64      // Tries on a slot still being written before reporting the ring empty
+#define DIRWATCHER_SHM_WAIT_SUFFIX     "-waiters"
+#define DIRWATCHER_SHM_WAKE_SUFFIX     "-wake"
+
+/*
+    Shared layout: one header followed by `capacity` slots.
+
+    Every slot is guarded by its own sequence number (a seqlock). The publisher
+    invalidates the slot, writes the payload, then stores the event's sequence
+    number. A reader copies the payload and re-reads the sequence number; if it
+    changed, the slot was recycled under it and the reader has been overrun.
+
+    Readers map the ring read-only. The only shared state they write is the
+    waiter count of a separate block ("<name>-waiters"); after each batch the
+    publisher releases that many counts of a semaphore ("<name>-wake").
+*/
+
+typedef struct _dirwatcher_shm_header
+{
+    uint64_t       magic;
+    uint32_t       version;
+    uint32_t       capacity;                            // Slot count, power of two
+    uint32_t       slot_size;                           // Byte-size of one slot
+    uint32_t       root_path_len;                       // Excluding null-terminator
+    char           root_path[DIRWATCHER_SHM_ROOT_MAX];  // UTF-8, null termed
+    volatile LONG64 write_seq;                          // Sequence number of the next event
+                                                        // Stored with Interlocked*, loaded with ReadAcquire64
+} _dirwatcher_shm_header_t;
+
+typedef struct _dirwatcher_shm_slot
+{
+    volatile LONG64 seq;                                // Event sequence number, -1 while being written
+                                                        // Stored with Interlocked*, loaded with ReadAcquire64
+    uint32_t        event;                              // dirwatcher_event_t
+    uint32_t        name_len;                           // Excluding null-terminator
+    uint32_t        old_name_len;                       // Excluding null-terminator
+    uint32_t        reserved;
+    char            name[DIRWATCHER_READER_NAME_MAX];   // UTF-8, null termed, may be truncated
+    char            old_name[DIRWATCHER_READER_NAME_MAX]; // DIRWATCHER_EVENT_RENAMED only
+} _dirwatcher_shm_slot_t;
+
+typedef struct _dirwatcher_shm_wait
+{
+    volatile LONG   waiters;                            // Readers sleeping in dirwatcher_wait_reader()
+                                                        // Interlocked-only (atomic); do NOT read/write directly
+} _dirwatcher_shm_wait_t;
+
+struct _dirwatcher_shm_publisher
+{
+    HANDLE                    mapping_handle;
+    _dirwatcher_shm_header_t* header;
+    _dirwatcher_shm_slot_t*   slots;
+    HANDLE                    wait_mapping_handle;
+    _dirwatcher_shm_wait_t*   wait;
+    HANDLE                    wake_semaphore;
+    uint64_t                  mask;                     // capacity - 1
+    uint64_t                  next_seq;                 // Worker-local copy of header->write_seq
+};
+
+typedef struct _dirwatcher_reader_impl
+{
+    uint64_t                  magic;
+
+    HANDLE                    mapping_handle;
+    _dirwatcher_shm_header_t* header;                   // Mapped read-only
+    _dirwatcher_shm_slot_t*   slots;
+    HANDLE                    wait_mapping_handle;
+    _dirwatcher_shm_wait_t*   wait;
+    HANDLE                    wake_semaphore;           // SYNCHRONIZE access only
+    uint64_t                  capacity;
+    uint64_t                  mask;
+    uint64_t                  cursor;                   // Sequence number of the next event to read
+} _dirwatcher_reader_impl_t;
+
+/* Private functions **********************************/
+
+static uint32_t _round_up_pow2(uint32_t value)
+{
+    uint32_t ret = 1;
+
+    while (ret < value && ret < 0x80000000u)
+    {
+        ret <<= 1;
+    }
+
+    return ret;
+}
+
+static size_t _get_mapping_size(uint32_t capacity)
+{
+    return sizeof(_dirwatcher_shm_header_t) + (size_t)capacity * sizeof(_dirwatcher_shm_slot_t);
+}
+
+static uint32_t _copy_utf8_truncated(char* dst, size_t dst_len, const char* src)
+{
+    size_t len = strlen(src);
+
+    if (len >= dst_len)
+    {
+        len = dst_len - 1;
+
+        //
+        // Do not split a multi-byte sequence
+        //
+
+        while (len > 0 && (((unsigned char)src[len]) & 0xC0) == 0x80)
+        {
+            len--;
+        }
+    }
+
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+
+    return (uint32_t)len;
+}
+
+static bool _is_valid_reader_ptr(_dirwatcher_reader_impl_t* reader)
+{
+    return ((reader) && (reader->magic == DIRWATCHER_READER_MAGIC_NUMBER));
+}
+
+/*
+    Builds the name of an object that accompanies the ring name.
+    Returns false if the result does not fit.
+*/
+static bool _get_object_name(char* buf, size_t buf_len, const char* name, const char* suffix)
+{
+    return SUCCEEDED(StringCchPrintfA(buf, buf_len, "%s%s", name, suffix));
+}
+
+static bool _has_unread(_dirwatcher_reader_impl_t* reader)
+{
+    return (uint64_t)ReadAcquire64(&reader->header->write_seq) > reader->cursor;
+}
+
+static void _close_reader_handles(_dirwatcher_reader_impl_t* reader)
+{
+    if (reader->header) UnmapViewOfFile(reader->header);
+    if (reader->mapping_handle) CloseHandle(reader->mapping_handle);
+    if (reader->wait) UnmapViewOfFile(reader->wait);
+    if (reader->wait_mapping_handle) CloseHandle(reader->wait_mapping_handle);
+    if (reader->wake_semaphore) CloseHandle(reader->wake_semaphore);
+}
+
+/* Publisher functions ********************************/
+
+_dirwatcher_shm_publisher_t* _dirwatcher_shm_create_publisher(const char* name, uint32_t capacity, const char* root_path)
+{
+    _dirwatcher_shm_publisher_t* publisher = calloc(1, sizeof(_dirwatcher_shm_publisher_t));
+
+    if (!publisher)
+    {
+        return NULL;
+    }
+
+    capacity = _round_up_pow2(capacity ? capacity : DIRWATCHER_READER_DEFAULT_CAPACITY);
+
+    ULARGE_INTEGER mapping_size = { 0 };
+    mapping_size.QuadPart = _get_mapping_size(capacity);
+
+    char wait_name[MAX_PATH];
+    char wake_name[MAX_PATH];
+
+    if (!_get_object_name(wait_name, sizeof(wait_name), name, DIRWATCHER_SHM_WAIT_SUFFIX) ||
+        !_get_object_name(wake_name, sizeof(wake_name), name, DIRWATCHER_SHM_WAKE_SUFFIX))
+    {
+        free(publisher);
+        return NULL;
+    }
+
+    publisher->mapping_handle = CreateFileMappingA(INVALID_HANDLE_VALUE,
+                                                   NULL,
+                                                   PAGE_READWRITE,
+                                                   mapping_size.HighPart,
+                                                   mapping_size.LowPart,
+                                                   name);
+
+    if (!publisher->mapping_handle || GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        //
+        // Only one publisher may own a ring
+        //
+
+        if (publisher->mapping_handle) CloseHandle(publisher->mapping_handle);
+        free(publisher);
+        return NULL;
+    }
+
+    publisher->header = MapViewOfFile(publisher->mapping_handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+
+    if (!publisher->header)
+    {
+        CloseHandle(publisher->mapping_handle);
+        free(publisher);
+        return NULL;
+    }
+
+    //
+    // Objects for sleeping readers; created before the magic so attached readers always find them
+    //
+
+    publisher->wait_mapping_handle = CreateFileMappingA(INVALID_HANDLE_VALUE,
+                                                        NULL,
+                                                        PAGE_READWRITE,
+                                                        0,
+                                                        sizeof(_dirwatcher_shm_wait_t),
+                                                        wait_name);
+
+    if (publisher->wait_mapping_handle && GetLastError() != ERROR_ALREADY_EXISTS)
+    {
+        publisher->wait = MapViewOfFile(publisher->wait_mapping_handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    }
+
+    publisher->wake_semaphore = CreateSemaphoreA(NULL, 0, MAXLONG, wake_name);
+
+    if (!publisher->wait || !publisher->wake_semaphore || GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        _dirwatcher_shm_destroy_publisher(publisher);
+        return NULL;
+    }
+
+    //
+    // Initialize header; magic is written last so readers never see a half-built ring
+    //
+
+    publisher->slots    = (_dirwatcher_shm_slot_t*)(publisher->header + 1);
+    publisher->mask     = (uint64_t)capacity - 1;
+    publisher->next_seq = 0;
+
+    publisher->header->version       = DIRWATCHER_SHM_VERSION;
+    publisher->header->capacity      = capacity;
+    publisher->header->slot_size     = sizeof(_dirwatcher_shm_slot_t);
+    publisher->header->root_path_len = _copy_utf8_truncated(publisher->header->root_path,
+                                                            sizeof(publisher->header->root_path),
+                                                            root_path ? root_path : "");
+
+    for (uint32_t i = 0; i < capacity; i++)
+    {
+        publisher->slots[i].seq = -1;
+    }
+
+    InterlockedExchange64(&publisher->header->write_seq, 0);
+
+    MemoryBarrier();
+    publisher->header->magic = DIRWATCHER_SHM_MAGIC_NUMBER;
+
+    return publisher;
+}
+
+void _dirwatcher_shm_destroy_publisher(_dirwatcher_shm_publisher_t* publisher)
+{
+    if (!publisher)
+    {
+        return;
+    }
+
+    if (publisher->wait) UnmapViewOfFile(publisher->wait);
+    if (publisher->wait_mapping_handle) CloseHandle(publisher->wait_mapping_handle);
+    if (publisher->wake_semaphore) CloseHandle(publisher->wake_semaphore);
+
+    UnmapViewOfFile(publisher->header);
+    CloseHandle(publisher->mapping_handle);
+    free(publisher);
+}
+
+void _dirwatcher_shm_publish(_dirwatcher_shm_publisher_t* publisher, const dirwatcher_event_info_t* event_info)
+{
+    uint64_t                seq  = publisher->next_seq;
+    _dirwatcher_shm_slot_t* slot = &publisher->slots[seq & publisher->mask];
+
+    InterlockedExchange64(&slot->seq, -1);
+
+    slot->event        = (uint32_t)event_info->event;
+    slot->name_len     = _copy_utf8_truncated(slot->name, sizeof(slot->name), event_info->name ? event_info->name : "");
+    slot->old_name_len = _copy_utf8_truncated(slot->old_name, sizeof(slot->old_name), event_info->old_name ? event_info->old_name : "");
+
+    InterlockedExchange64(&slot->seq, (LONG64)seq);
+    InterlockedExchange64(&publisher->header->write_seq, (LONG64)(seq + 1));
+
+    publisher->next_seq = seq + 1;
+}
+
+void _dirwatcher_shm_wake_readers(_dirwatcher_shm_publisher_t* publisher)
+{
+    //
+    // The interlocked store of write_seq is a full barrier; a reader counted
+    // after it re-checks write_seq before sleeping
+    //
+
+    LONG waiters = InterlockedCompareExchange(&publisher->wait->waiters, 0, 0);
+
+    if (waiters > 0)
+    {
+        ReleaseSemaphore(publisher->wake_semaphore, waiters, NULL);
+    }
+}
+
+/* Public functions ***********************************/
+
+dirwatcher_reader_t dirwatcher_open_reader(const char* name)
+{
+    if (!name)
+    {
+        return NULL;
+    }
+
+    _dirwatcher_reader_impl_t* reader = calloc(1, sizeof(_dirwatcher_reader_impl_t));
+
+    if (!reader)
+    {
+        return NULL;
+    }
+
+    char wait_name[MAX_PATH];
+    char wake_name[MAX_PATH];
+
+    if (!_get_object_name(wait_name, sizeof(wait_name), name, DIRWATCHER_SHM_WAIT_SUFFIX) ||
+        !_get_object_name(wake_name, sizeof(wake_name), name, DIRWATCHER_SHM_WAKE_SUFFIX))
+    {
+        free(reader);
+        return NULL;
+    }
+
+    //
+    // The ring is mapped read-only; readers cannot disturb the publisher or each other
+    //
+
+    reader->mapping_handle      = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    reader->header              = reader->mapping_handle ? MapViewOfFile(reader->mapping_handle, FILE_MAP_READ, 0, 0, 0) : NULL;
+    reader->wait_mapping_handle = OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, wait_name);
+    reader->wait                = reader->wait_mapping_handle ? MapViewOfFile(reader->wait_mapping_handle, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0) : NULL;
+    reader->wake_semaphore      = OpenSemaphoreA(SYNCHRONIZE, FALSE, wake_name);
+
+    if (!reader->header                                          ||
+        !reader->wait                                            ||
+        !reader->wake_semaphore                                  ||
+        reader->header->magic     != DIRWATCHER_SHM_MAGIC_NUMBER ||
+        reader->header->version   != DIRWATCHER_SHM_VERSION      ||
+        reader->header->slot_size != sizeof(_dirwatcher_shm_slot_t))
+    {
+        _close_reader_handles(reader);
+        free(reader);
+        return NULL;
+    }
+
+    //
+    // New readers start at the current head and only see events published after attaching
+    //
+
+    reader->slots    = (_dirwatcher_shm_slot_t*)(reader->header + 1);
+    reader->capacity = reader->header->capacity;
+    reader->mask     = reader->capacity - 1;
+    reader->cursor   = (uint64_t)ReadAcquire64(&reader->header->write_seq);
+    reader->magic    = DIRWATCHER_READER_MAGIC_NUMBER;
+
+    return reader;
+}
+
+bool dirwatcher_close_reader(dirwatcher_reader_t reader)
+{
+    _dirwatcher_reader_impl_t* reader_impl = reader;
+
+    if (!_is_valid_reader_ptr(reader_impl))
+    {
+        return false;
+    }
+
+    _close_reader_handles(reader_impl);
+
+    reader_impl->magic = 0;
+
+    free(reader_impl);
+    return true;
+}
+
+dirwatcher_read_result_t dirwatcher_read_event(dirwatcher_reader_t  reader,
+                                               dirwatcher_event_t*  event,
+                                               char*                name_buf,
+                                               size_t               buf_len,
+                                               char*                old_name_buf,
+                                               size_t               old_buf_len,
+                                               uint64_t*            lost)
+{
+    _dirwatcher_reader_impl_t* reader_impl = reader;
+
+    if (!_is_valid_reader_ptr(reader_impl) || !event || !name_buf || !buf_len)
+    {
+        return DIRWATCHER_READ_INVALID;
+    }
+
+    if (lost) *lost = 0;
+
+    for (uint32_t retry = 0; retry < DIRWATCHER_SHM_READ_RETRIES; retry++)
+    {
+        uint64_t head = (uint64_t)ReadAcquire64(&reader_impl->header->write_seq);
+
+        if (reader_impl->cursor >= head)
+        {
+            return DIRWATCHER_READ_EMPTY;
+        }
+
+        //
+        // Fell behind by more than the ring capacity: skip to the oldest surviving event
+        //
+
+        if (head - reader_impl->cursor > reader_impl->capacity)
+        {
+            uint64_t oldest = head - reader_impl->capacity;
+
+            if (lost) *lost = oldest - reader_impl->cursor;
+
+            reader_impl->cursor = oldest;
+            return DIRWATCHER_READ_OVERRUN;
+        }
+
+        _dirwatcher_shm_slot_t* slot = &reader_impl->slots[reader_impl->cursor & reader_impl->mask];
+
+        //
+        // Copy under the slot's seqlock
+        //
+
+        if ((uint64_t)ReadAcquire64(&slot->seq) != reader_impl->cursor)
+        {
+            YieldProcessor();
+            continue;
+        }
+
+        dirwatcher_event_t ev           = (dirwatcher_event_t)slot->event;
+        size_t             name_len     = slot->name_len < buf_len ? slot->name_len : buf_len - 1;
+        size_t             old_name_len = 0;
+
+        memcpy(name_buf, slot->name, name_len);
+
+        if (old_name_buf && old_buf_len)
+        {
+            old_name_len = slot->old_name_len < old_buf_len ? slot->old_name_len : old_buf_len - 1;
+            memcpy(old_name_buf, slot->old_name, old_name_len);
+        }
+
+        //
+        // The copy must be complete before the sequence number is checked again
+        //
+
+        MemoryBarrier();
+
+        if ((uint64_t)ReadAcquire64(&slot->seq) != reader_impl->cursor)
+        {
+            //
+            // Recycled while copying; the next iteration reports the overrun
+            //
+
+            continue;
+        }
+
+        name_buf[name_len] = '\0';
+        *event             = ev;
+
+        if (old_name_buf && old_buf_len)
+        {
+            old_name_buf[old_name_len] = '\0';
+        }
+
+        reader_impl->cursor++;
+        return DIRWATCHER_READ_OK;
+    }
+
+    //
+    // The publisher was preempted (or died) while writing the slot; try again later
+    //
+
+    return DIRWATCHER_READ_EMPTY;
+}
+
+bool dirwatcher_wait_reader(dirwatcher_reader_t reader, uint32_t timeout_ms)
+{
+    _dirwatcher_reader_impl_t* reader_impl = reader;
+
+    if (!_is_valid_reader_ptr(reader_impl))
+    {
+        return false;
+    }
+
+    ULONGLONG start = GetTickCount64();
+
+    //
+    // Spin briefly; events often follow each other closely
+    //
+
+    for (uint32_t spin = 0; spin < DIRWATCHER_SHM_SPIN_COUNT; spin++)
+    {
+        if (_has_unread(reader_impl))
+        {
+            return true;
+        }
+
+        if (timeout_ms != INFINITE && GetTickCount64() - start >= timeout_ms)
+        {
+            return false;
+        }
+
+        YieldProcessor();
+    }
+
+    for (;;)
+    {
+        //
+        // Count ourselves before the last check, so that a batch published
+        // after it releases the semaphore for us
+        //
+
+        InterlockedIncrement(&reader_impl->wait->waiters);
+
+        ULONGLONG elapsed = GetTickCount64() - start;
+        bool      ready   = _has_unread(reader_impl);
+        DWORD     wait    = WAIT_TIMEOUT;
+
+        if (!ready && (timeout_ms == INFINITE || elapsed < timeout_ms))
+        {
+            wait = WaitForSingleObject(reader_impl->wake_semaphore, timeout_ms == INFINITE ? INFINITE : (DWORD)(timeout_ms - elapsed));
+        }
+
+        InterlockedDecrement(&reader_impl->wait->waiters);
+
+        if (ready || _has_unread(reader_impl))
+        {
+            return true;
+        }
+
+        //
+        // A count left over from an earlier batch wakes us early; sleep again
+        //
+
+        if (wait != WAIT_OBJECT_0)
+        {
+            return false;
+        }
+    }
+}
+
+size_t dirwatcher_get_reader_root_path(dirwatcher_reader_t reader, char* buf, size_t buf_len)
+{
+    _dirwatcher_reader_impl_t* reader_impl = reader;
+
+    if (!_is_valid_reader_ptr(reader_impl))
+    {
+        return 0;
+    }
+
+    size_t required = (size_t)reader_impl->header->root_path_len + 1;
+
+    if (!buf)
+    {
+        return required;
+    }
+
+    if (buf_len < required)
+    {
+        return 0;
+    }
+
+    memcpy(buf, reader_impl->header->root_path, required);
+
+    return required;
+}
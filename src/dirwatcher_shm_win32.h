@@ -0,0 +1,33 @@
+/*
+    DIRWATCHER_SHM_WIN32.H
+      Private interface of the shared-memory event ring (publisher side)
+*/
+
+#ifndef DIRWATCHER_SHM_WIN32_H
+#define DIRWATCHER_SHM_WIN32_H
+
+#include <dirwatcher.h>
+
+typedef struct _dirwatcher_shm_publisher _dirwatcher_shm_publisher_t;
+
+/*
+    Creates a named ring and stores root_path (UTF-8) in its header, along
+    with the "<name>-waiters" block and "<name>-wake" semaphore of sleeping
+    readers. Fails if a ring with the same name already exists.
+*/
+_dirwatcher_shm_publisher_t* _dirwatcher_shm_create_publisher(const char* name, uint32_t capacity, const char* root_path);
+
+void _dirwatcher_shm_destroy_publisher(_dirwatcher_shm_publisher_t* publisher);
+
+/*
+    Appends one event to the ring. Called from the worker thread only.
+*/
+void _dirwatcher_shm_publish(_dirwatcher_shm_publisher_t* publisher, const dirwatcher_event_info_t* event_info);
+
+/*
+    Wakes the readers sleeping in dirwatcher_wait_reader(). Called from the
+    worker thread once per batch of published events.
+*/
+void _dirwatcher_shm_wake_readers(_dirwatcher_shm_publisher_t* publisher);
+
+#endif
@@ -0,0 +1,351 @@
+/* Includes *******************************************/
+
+#include <dirwatcher.h>
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dirwatcher_synthetic_win32.h"
+
+/* Defines ********************************************/
+
+#define DIRWATCHER_SYNTHETIC_NAME_MAX          512  // wchar; a rename pair must fit one notify buffer
+#define DIRWATCHER_SYNTHETIC_DEFAULT_NAME_MIN  8
+#define DIRWATCHER_SYNTHETIC_DEFAULT_NAME_MAX  32
+#define DIRWATCHER_SYNTHETIC_SEPARATOR_ODDS    12   // One in N name characters starts a new component
+#define DIRWATCHER_SYNTHETIC_ALIGN(x)          (((x) + 7) & ~(DWORD)7)
+
+struct _dirwatcher_synthetic
+{
+    dirwatcher_synthetic_config_t config;
+    uint32_t                      weight_total;
+    uint64_t                      rng;
+    uint64_t                      generated;        // Events generated so far
+    uint64_t                      next_file_id;
+    uint32_t                      burst_left;       // Events left in the current burst
+    LONGLONG                      start_ticks;      // QPC of the first event, 0 before it
+    LONGLONG                      ticks_per_second;
+    wchar_t                       name[DIRWATCHER_SYNTHETIC_NAME_MAX];
+};
+
+/* Private functions **********************************/
+
+static uint64_t _next_random(_dirwatcher_synthetic_t* synthetic)
+{
+    //
+    // xorshift64*
+    //
+
+    synthetic->rng ^= synthetic->rng >> 12;
+    synthetic->rng ^= synthetic->rng << 25;
+    synthetic->rng ^= synthetic->rng >> 27;
+
+    return synthetic->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t _random_below(_dirwatcher_synthetic_t* synthetic, uint32_t bound)
+{
+    return (uint32_t)((_next_random(synthetic) >> 32) * bound >> 32);
+}
+
+static DWORD _event_to_action(dirwatcher_event_t event)
+{
+    switch (event)
+    {
+    case DIRWATCHER_EVENT_ADDED:
+        return FILE_ACTION_ADDED;
+    case DIRWATCHER_EVENT_REMOVED:
+        return FILE_ACTION_REMOVED;
+    case DIRWATCHER_EVENT_MODIFIED:
+        return FILE_ACTION_MODIFIED;
+    case DIRWATCHER_EVENT_RENAMED_FROM:
+        return FILE_ACTION_RENAMED_OLD_NAME;
+    case DIRWATCHER_EVENT_RENAMED_TO:
+        return FILE_ACTION_RENAMED_NEW_NAME;
+    default:
+        return 0;
+    }
+}
+
+static dirwatcher_event_t _pick_event(_dirwatcher_synthetic_t* synthetic)
+{
+    uint32_t pick = _random_below(synthetic, synthetic->weight_total);
+
+    for (int event = 0; event < DIRWATCHER_EVENT_COUNT; event++)
+    {
+        if (pick < synthetic->config.weights[event])
+        {
+            return (dirwatcher_event_t)event;
+        }
+
+        pick -= synthetic->config.weights[event];
+    }
+
+    return DIRWATCHER_EVENT_MODIFIED;
+}
+
+/*
+    Fills synthetic->name with a random relative path and returns its length.
+*/
+static uint32_t _make_name(_dirwatcher_synthetic_t* synthetic)
+{
+    static const wchar_t alphabet[] = L"abcdefghijklmnopqrstuvwxyz0123456789_.";
+
+    uint32_t min_len = synthetic->config.name_min_len;
+    uint32_t len     = min_len + _random_below(synthetic, synthetic->config.name_max_len - min_len + 1);
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        bool separator = i > 0 && i + 1 < len &&
+                         synthetic->name[i - 1] != L'\\' &&
+                         _random_below(synthetic, DIRWATCHER_SYNTHETIC_SEPARATOR_ODDS) == 0;
+
+        synthetic->name[i] = separator ? L'\\' : alphabet[_random_below(synthetic, (uint32_t)(sizeof(alphabet) / sizeof(wchar_t) - 1))];
+    }
+
+    return len;
+}
+
+/*
+    Appends one record after *p_used. Returns false if it does not fit.
+*/
+static bool _append_record(_dirwatcher_synthetic_t*           synthetic,
+                           BYTE*                              buffer,
+                           DWORD                              buffer_size,
+                           DWORD*                             p_used,
+                           FILE_NOTIFY_EXTENDED_INFORMATION** p_last,
+                           DWORD                              action,
+                           LONGLONG                           file_id)
+{
+    uint32_t name_len    = _make_name(synthetic);
+    DWORD    record_size = DIRWATCHER_SYNTHETIC_ALIGN((DWORD)offsetof(FILE_NOTIFY_EXTENDED_INFORMATION, FileName) + name_len * (DWORD)sizeof(wchar_t));
+
+    if (*p_used + record_size > buffer_size)
+    {
+        return false;
+    }
+
+    FILE_NOTIFY_EXTENDED_INFORMATION* info = (FILE_NOTIFY_EXTENDED_INFORMATION*)(buffer + *p_used);
+
+    memset(info, 0, offsetof(FILE_NOTIFY_EXTENDED_INFORMATION, FileName));
+    info->Action          = action;
+    info->FileId.QuadPart = file_id;
+    info->FileNameLength  = name_len * sizeof(wchar_t);
+    memcpy(info->FileName, synthetic->name, name_len * sizeof(wchar_t));
+
+    if (*p_last)
+    {
+        (*p_last)->NextEntryOffset = (DWORD)((BYTE*)info - (BYTE*)*p_last);
+    }
+
+    *p_last  = info;
+    *p_used += record_size;
+
+    return true;
+}
+
+/*
+    Returns the milliseconds until the next burst is due under the configured rate.
+*/
+static DWORD _get_burst_wait(_dirwatcher_synthetic_t* synthetic)
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+
+    if (!synthetic->start_ticks)
+    {
+        synthetic->start_ticks = now.QuadPart;
+    }
+
+    if (!synthetic->config.rate)
+    {
+        return 0;
+    }
+
+    LONGLONG due = synthetic->start_ticks +
+                   (LONGLONG)((double)synthetic->generated * synthetic->ticks_per_second / synthetic->config.rate);
+
+    return due > now.QuadPart ? (DWORD)((due - now.QuadPart) * 1000 / synthetic->ticks_per_second) : 0;
+}
+
+static void _start_burst(_dirwatcher_synthetic_t* synthetic)
+{
+    uint64_t limit = synthetic->config.limit;
+
+    synthetic->burst_left = limit ? (uint32_t)min(synthetic->config.burst_size, limit - synthetic->generated)
+                                  : synthetic->config.burst_size;
+}
+
+/* Public functions ***********************************/
+
+_dirwatcher_synthetic_t* _dirwatcher_synthetic_create(const dirwatcher_synthetic_config_t* config /* NULLABLE */)
+{
+    _dirwatcher_synthetic_t* synthetic = calloc(1, sizeof(_dirwatcher_synthetic_t));
+    LARGE_INTEGER            frequency;
+
+    if (!synthetic)
+    {
+        return NULL;
+    }
+
+    if (config)
+    {
+        synthetic->config = *config;
+    }
+
+    dirwatcher_synthetic_config_t* c = &synthetic->config;
+
+    //
+    // Fill in defaults
+    //
+
+    if (!c->burst_size)
+    {
+        c->burst_size = 1;
+    }
+
+    if (!c->name_min_len && !c->name_max_len)
+    {
+        c->name_min_len = DIRWATCHER_SYNTHETIC_DEFAULT_NAME_MIN;
+        c->name_max_len = DIRWATCHER_SYNTHETIC_DEFAULT_NAME_MAX;
+    }
+
+    c->name_min_len = min(max(c->name_min_len, 1), DIRWATCHER_SYNTHETIC_NAME_MAX);
+    c->name_max_len = min(max(c->name_max_len, c->name_min_len), DIRWATCHER_SYNTHETIC_NAME_MAX);
+
+    c->weights[DIRWATCHER_EVENT_NULL] = 0;
+
+    for (int event = 0; event < DIRWATCHER_EVENT_COUNT; event++)
+    {
+        if (event != DIRWATCHER_EVENT_RENAMED && !_event_to_action((dirwatcher_event_t)event))
+        {
+            c->weights[event] = 0;
+        }
+
+        synthetic->weight_total += c->weights[event];
+    }
+
+    if (!synthetic->weight_total)
+    {
+        c->weights[DIRWATCHER_EVENT_ADDED]    = 1;
+        c->weights[DIRWATCHER_EVENT_REMOVED]  = 1;
+        c->weights[DIRWATCHER_EVENT_MODIFIED] = 2;
+        c->weights[DIRWATCHER_EVENT_RENAMED]  = 1;
+        synthetic->weight_total               = 5;
+    }
+
+    synthetic->rng          = ((uint64_t)c->seed << 1) ^ 0x9E3779B97F4A7C15ULL;   // Never 0
+    synthetic->next_file_id = 1;
+
+    QueryPerformanceFrequency(&frequency);
+    synthetic->ticks_per_second = frequency.QuadPart;
+
+    return synthetic;
+}
+
+void _dirwatcher_synthetic_destroy(_dirwatcher_synthetic_t* synthetic)
+{
+    free(synthetic);
+}
+
+DWORD _dirwatcher_synthetic_fill(_dirwatcher_synthetic_t* synthetic, BYTE* buffer, DWORD buffer_size, int max_records, DWORD* p_wait_ms)
+{
+    FILE_NOTIFY_EXTENDED_INFORMATION* last    = NULL;
+    DWORD                             used    = 0;
+    int                               records = 0;
+    uint64_t                          limit   = synthetic->config.limit;
+
+    *p_wait_ms = 0;
+
+    if (limit && synthetic->generated >= limit)
+    {
+        *p_wait_ms = INFINITE;
+        return 0;
+    }
+
+    //
+    // Start a burst once it is due
+    //
+
+    if (!synthetic->burst_left)
+    {
+        *p_wait_ms = _get_burst_wait(synthetic);
+
+        if (*p_wait_ms)
+        {
+            return 0;
+        }
+
+        _start_burst(synthetic);
+    }
+
+    //
+    // Fill the buffer from the burst
+    //
+
+    while (synthetic->burst_left && records < max_records)
+    {
+        dirwatcher_event_t event   = _pick_event(synthetic);
+        LONGLONG           file_id = (LONGLONG)synthetic->next_file_id++;
+        DWORD              mark    = used;
+
+        if (event == DIRWATCHER_EVENT_RENAMED)
+        {
+            //
+            // Both halves with one file id, as the kernel reports a rename
+            //
+
+            FILE_NOTIFY_EXTENDED_INFORMATION* prev_last = last;
+
+            if (records + 2 > max_records ||
+                !_append_record(synthetic, buffer, buffer_size, &used, &last, FILE_ACTION_RENAMED_OLD_NAME, file_id) ||
+                !_append_record(synthetic, buffer, buffer_size, &used, &last, FILE_ACTION_RENAMED_NEW_NAME, file_id))
+            {
+                //
+                // Roll back a half that fit alone
+                //
+
+                if (used != mark)
+                {
+                    used = mark;
+                    last = prev_last;
+                }
+
+                break;
+            }
+
+            records += 2;
+        }
+        else
+        {
+            if (!_append_record(synthetic, buffer, buffer_size, &used, &last, _event_to_action(event), file_id))
+            {
+                break;
+            }
+
+            records++;
+        }
+
+        synthetic->burst_left--;
+        synthetic->generated++;
+
+        //
+        // Without a rate, bursts follow each other with no gap
+        //
+
+        if (!synthetic->burst_left && !synthetic->config.rate && (!limit || synthetic->generated < limit))
+        {
+            _start_burst(synthetic);
+        }
+    }
+
+    if (last)
+    {
+        last->NextEntryOffset = 0;
+    }
+
+    return used;
+}
@@ -0,0 +1,37 @@
+/*
+    DIRWATCHER_SYNTHETIC_WIN32.H
+      Private interface of the synthetic event source
+
+    Generates kernel-style notify buffers (extended layout) from a
+    configuration, so the decode and dispatch path can be driven without a
+    file system.
+*/
+
+#ifndef DIRWATCHER_SYNTHETIC_WIN32_H
+#define DIRWATCHER_SYNTHETIC_WIN32_H
+
+#include <dirwatcher.h>
+
+#include <Windows.h>
+
+typedef struct _dirwatcher_synthetic _dirwatcher_synthetic_t;
+
+/*
+    Creates a generator; config NULL uses the defaults.
+    Returns NULL on failure.
+*/
+_dirwatcher_synthetic_t* _dirwatcher_synthetic_create(const dirwatcher_synthetic_config_t* config /* NULLABLE */);
+
+void _dirwatcher_synthetic_destroy(_dirwatcher_synthetic_t* synthetic);
+
+/*
+    Writes the next records of the current burst into buffer as a chain of
+    FILE_NOTIFY_EXTENDED_INFORMATION, at most max_records of them.
+    Returns the byte count written.
+
+    *p_wait_ms receives how long to wait before the next call to keep the
+    configured rate (INFINITE once the limit is reached).
+*/
+DWORD _dirwatcher_synthetic_fill(_dirwatcher_synthetic_t* synthetic, BYTE* buffer, DWORD buffer_size, int max_records, DWORD* p_wait_ms);
+
+#endif
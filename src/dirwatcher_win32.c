@@ -6,23 +6,114 @@
 #include <stdbool.h>
 #include <wchar.h>
 #include <stdint.h>
+#include <string.h>
 #include <strsafe.h>
 #include <pathcch.h>
 
+#include "dirwatcher_shm_win32.h"
+#include "dirwatcher_journal_win32.h"
+#include "dirwatcher_poll_win32.h"
+#include "dirwatcher_synthetic_win32.h"
+#include "dirwatcher_budget_win32.h"
+#include "dirwatcher_change_index.h"
+#include "dirwatcher_ignore_win32.h"
+#include "dirwatcher_write_tracker_win32.h"
+
 #pragma comment(lib, "Pathcch.lib")
 
 /* Defines ********************************************/
 
 #define DIRWATCHER_TARGET_MAGIC_NUMBER 0x4449525741544348ULL // 'DIRWATCH'
+#define DIRWATCHER_MAX_NOTIFIES        256
+#define DIRWATCHER_PROBE_PREFIX        ".dirwatcher-probe-"
+#define DIRWATCHER_NOTIFY_NAMES        (FILE_NOTIFY_CHANGE_DIR_NAME   | \
+                                        FILE_NOTIFY_CHANGE_FILE_NAME)
+#define DIRWATCHER_NOTIFY_WRITES       (FILE_NOTIFY_CHANGE_LAST_WRITE | \
+                                        FILE_NOTIFY_CHANGE_SIZE)
+#define DIRWATCHER_NAME_EVENTS         (DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_ADDED)        | \
+                                        DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_REMOVED)      | \
+                                        DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_RENAMED_FROM) | \
+                                        DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_RENAMED_TO)   | \
+                                        DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_RENAMED))
+#define DIRWATCHER_WRITE_EVENTS        (DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_MODIFIED) | \
+                                        DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_CLOSED_WRITE))
+
+typedef BOOL (WINAPI* _read_directory_changes_ex_t)(HANDLE, LPVOID, DWORD, BOOL, DWORD, LPDWORD,
+                                                    LPOVERLAPPED, LPOVERLAPPED_COMPLETION_ROUTINE,
+                                                    READ_DIRECTORY_NOTIFY_INFORMATION_CLASS);
+
+/*
+    One kernel record, independent of the notify buffer layout.
+*/
+typedef struct _dirwatcher_notify
+{
+    DWORD          action;
+    const wchar_t* name;                        // Not null termed
+    int            name_count;                  // Count of wchar
+    LONGLONG       file_id;                     // 0 if unknown (basic layout)
+    DWORD          attributes;                  // 0 if unknown (basic layout)
+    bool           ignored;                     // Matched by the target's ignore files or exclusions
+    int            pair;                        // Index of the old-name record merged into this one, -1 if none
+    bool           merged;                      // Merged into a later record
+} _dirwatcher_notify_t;
+
+/*
+    A directory outside the root that the target also watches (dirwatcher_add_target_path).
+*/
+typedef struct _dirwatcher_subpath
+{
+    HANDLE                      handle;         // Opened for overlapped I/O
+    OVERLAPPED                  overlapped;     // hEvent is manual-reset; signaled when the pending read completes
+    bool                        pending;        // A read is queued; owned by the worker thread once added
+    _read_directory_changes_ex_t read_changes_ex; // ReadDirectoryChangesExW, NULL if unavailable or unsupported; owned by the worker thread once added
+    DWORD                       notify_filter;  // Of its reads; fixed by the first one on the handle. Owned by the worker thread once added
+    wchar_t*                    full_path;
+    char*                       prefix;         // UTF-8 full path; the names of its events follow it
+    _dirwatcher_ignore_t*       ignore;         // Rules of the ignore files below it, NULL while the target's are disabled; owned by the worker thread
+    volatile LONG               retired;        // Removed from the target; Interlocked-only (atomic)
+    struct _dirwatcher_subpath* next;           // In the retired list
+    __declspec(align(8)) BYTE   buffer[4096];
+} _dirwatcher_subpath_t;
 
 typedef struct _dirwatcher_target_impl
 {
     uint64_t              magic;
 
-    HANDLE                dir_handle;           // Handle to the target directory
+    HANDLE                root_handle;          // Handle to the target directory; names it for path queries and reopening
+    HANDLE                dir_handle;           // Reopened from root_handle for overlapped notify reads; NULL while polling,
+                                                // which frees its kernel notify buffer. Closed and reopened by the worker thread
+    SRWLOCK               dir_lock;             // Held exclusive to change dir_handle; shared by other threads to cancel its I/O
+    DWORD                 notify_filter;        // Of the reads on dir_handle; fixed by the first one on the handle. Owned by the worker thread
+    HANDLE                read_event;           // Manual-reset; signaled when the pending notify read completes
+    OVERLAPPED            read_overlapped;      // Of the pending root read; owned by the worker thread
+    bool                  read_pending;         // Owned by the worker thread
+    bool                  subpath_turn;         // Serve a completed extra directory before the root next; owned by the worker thread
+    __declspec(align(8)) BYTE read_buffer[4096]; // Of the root read; owned by the worker thread
+    volatile LONG         spin_us;              // Busy-wait for a read before blocking; Interlocked-only (atomic)
+
+    _read_directory_changes_ex_t read_changes_ex; // ReadDirectoryChangesExW, NULL if unavailable or unsupported
+                                                  // by the file system; owned by the worker thread
+
+    dirwatcher_backend_t  backend;              // Requested backend
+    volatile LONG         polling;              // Non-zero once the worker polls instead of reading notifications
+                                                // Interlocked-only (atomic); do NOT read/write directly
+    _dirwatcher_poller_t* poller;               // Snapshot of the polling backend; owned by the worker thread
+    _dirwatcher_synthetic_t* synthetic;         // Event generator of the synthetic backend; owned by the worker thread
+    volatile LONG         poll_min_interval;    // Milliseconds; Interlocked-only (atomic)
+    volatile LONG         poll_max_interval;    // Milliseconds; Interlocked-only (atomic)
+
+    _dirwatcher_budget_entry_t budget_entry;    // Place in the process-wide watch budget
+    volatile LONG         demoted;              // Non-zero while the watch budget has the worker poll at the cold interval
+                                                // Interlocked-only (atomic); do NOT read/write directly
+    volatile LONG         polled_directories;   // Directories covered by the last poll pass; Interlocked-only (atomic)
+    volatile LONG64       demotions;            // Interlocked-only (atomic)
+    volatile LONG64       promotions;           // Interlocked-only (atomic)
 
     HANDLE                worker_thread_handle; // Handle to the worker thread
     HANDLE                worker_control_event; // Worker thread control event (set: run, reset: stop)
+    HANDLE                worker_wake_event;    // Auto-reset; cuts a poll interval short on pause or exit
+    volatile LONG         interrupt_flag;       // Stops a poll pass early on pause or exit
+                                                // Interlocked-only (atomic); do NOT read/write directly
 
     volatile LONG         exit_flag;            // Indicates whether the worker thread should terminate
                                                 // Interlocked-only (atomic); do NOT read/write directly
@@ -36,8 +127,43 @@ typedef struct _dirwatcher_target_impl
     dirwatcher_callback_t callback;             // Callback invoked when a directory event occurs
     void*                 callback_user_data;   // 
     SRWLOCK               callback_lock;        // Must be held when changing the callback
+
+    _dirwatcher_shm_publisher_t* publisher;     // Shared-memory ring the events are published to (nullable)
+    _dirwatcher_journal_t*       journal;       // Journal the events are appended to (nullable)
+    volatile LONG                journal_error; // Win32 error of the last failed append; the journal is skipped while non-zero
+                                                // Interlocked-only (atomic); changed under sink_lock
+    SRWLOCK               sink_lock;            // Must be held when changing the publisher or the journal
+
+    _dirwatcher_subpath_t* subpaths[DIRWATCHER_MAX_TARGET_PATHS]; // Extra directories, each with a pending read
+    uint32_t              subpath_count;
+    _dirwatcher_subpath_t* retired_subpaths;    // Removed, waiting for the worker to cancel their reads
+    wchar_t**             excluded;             // Paths below the root that are not reported, relative to it
+    uint32_t              excluded_count;
+    SRWLOCK               paths_lock;           // Guards the fields above
+    HANDLE                paths_event;          // Auto-reset; set when extra directories are added or retired
+
+    volatile LONG         ignore_files;         // Non-zero to honour .gitignore / .ignore files; Interlocked-only (atomic)
+    _dirwatcher_ignore_t* ignore;               // Rules of the ignore files, NULL while disabled; owned by the worker thread
+
+    volatile LONG         event_mask;           // DIRWATCHER_EVENT_MASK bits of the delivered events; Interlocked-only (atomic)
+    _dirwatcher_write_tracker_t* write_tracker; // Files being written, NULL unless CLOSED_WRITE is delivered; owned by the worker thread
+    ULONGLONG             next_probe_tick;      // GetTickCount64() of the next probe of write_tracker; owned by the worker thread
+
+    _dirwatcher_change_index_t* change_index;   // Paths by last changed clock (nullable)
+    SRWLOCK               index_lock;           // Guards change_index and its contents
+
+    SRWLOCK               probe_lock;           // Serializes dirwatcher_probe_target_latency()
+    HANDLE                probe_event;          // Auto-reset; set by the worker when it dispatches the probe
+    volatile LONG         probe_active;         // Non-zero while probing; probe files are hidden. Interlocked-only (atomic)
+    volatile LONG         probe_wanted;         // Event kind that completes the probe; Interlocked-only (atomic)
+    volatile LONG64       probe_ticks;          // QPC just before the probe change, 0 once dispatched; Interlocked-only (atomic)
+    volatile LONG64       probe_latency;        // QPC ticks from the probe change to its dispatch; Interlocked-only (atomic)
 } _dirwatcher_target_impl_t;
 
+/* Globals ********************************************/
+
+static volatile LONG _change_tag_counter = 0;
+
 /* Private functions **********************************/
 
 static bool _wstrn_to_cstr(const wchar_t* wstrn   /* not null termed wchar str */,
@@ -86,31 +212,233 @@ static dirwatcher_event_t _action_to_event(DWORD action)
     return DIRWATCHER_EVENT_NULL;
 }
 
-static bool _go_next_notify(PFILE_NOTIFY_INFORMATION* ppnotify)
+static char* _wstrn_to_new_cstr(const wchar_t* wstrn, int wcount /* count of wchar */)
 {
-    if (!(*ppnotify)->NextEntryOffset)
+    int   len = _get_cstr_count_from_wstrn(wstrn, wcount);
+    char* str = malloc(len);
+
+    if (str)
     {
-        return false;
+        _wstrn_to_cstr(wstrn, wcount, str, len);
     }
 
-    *ppnotify = (PFILE_NOTIFY_INFORMATION)(((char*)*ppnotify) + ((*ppnotify)->NextEntryOffset));
-
-    return true;
+    return str;
 }
 
-static int _get_notifies_count(PFILE_NOTIFY_INFORMATION pnotify)
+/*
+    Reads the kernel records of one notify buffer, in either layout.
+*/
+static int _read_notifies(const BYTE*           buffer,
+                          bool                  extended,  /* FILE_NOTIFY_EXTENDED_INFORMATION layout */
+                          _dirwatcher_notify_t* notifies,
+                          int                   max_count)
 {
-    int count = 1;
+    int   count = 0;
+    DWORD next  = 0;
 
-    while (_go_next_notify(&pnotify))
+    while (count < max_count)
     {
-        count++;
+        _dirwatcher_notify_t* notify = &notifies[count++];
+
+        if (extended)
+        {
+            const FILE_NOTIFY_EXTENDED_INFORMATION* info = (const FILE_NOTIFY_EXTENDED_INFORMATION*)buffer;
+
+            notify->action     = info->Action;
+            notify->name       = info->FileName;
+            notify->name_count = (int)(info->FileNameLength / sizeof(wchar_t));
+            notify->file_id    = info->FileId.QuadPart;
+            notify->attributes = info->FileAttributes;
+            next               = info->NextEntryOffset;
+        }
+        else
+        {
+            const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)buffer;
+
+            notify->action     = info->Action;
+            notify->name       = info->FileName;
+            notify->name_count = (int)(info->FileNameLength / sizeof(wchar_t));
+            notify->file_id    = 0;
+            notify->attributes = 0;
+            next               = info->NextEntryOffset;
+        }
+
+        notify->pair    = -1;
+        notify->merged  = false;
+        notify->ignored = false;
+
+        if (!next)
+        {
+            break;
+        }
+
+        buffer += next;
     }
 
     return count;
 }
 
-static bool _notifies_to_events(PFILE_NOTIFY_INFORMATION pnotify,
+/*
+    Returns whether dir\name (relative to the root, dir "" for the root) lies in
+    an excluded path. Neither string is null termed. Caller holds paths_lock.
+*/
+static bool _is_excluded(const _dirwatcher_target_impl_t* target,
+                         const wchar_t*                   dir,
+                         uint32_t                         dir_count,
+                         const wchar_t*                   name,
+                         uint32_t                         name_count)
+{
+    for (uint32_t i = 0; i < target->excluded_count; i++)
+    {
+        const wchar_t* excluded = target->excluded[i];
+        uint32_t       count    = (uint32_t)wcslen(excluded);
+
+        if (count <= dir_count)
+        {
+            //
+            // Excluded directory above the entry
+            //
+
+            if ((count == dir_count || dir[count] == L'\\') &&
+                CompareStringOrdinal(dir, (int)count, excluded, (int)count, TRUE) == CSTR_EQUAL)
+            {
+                return true;
+            }
+        }
+        else if (count == (dir_count ? dir_count + 1 : 0) + name_count &&
+                 (!dir_count || (excluded[dir_count] == L'\\' &&
+                                 CompareStringOrdinal(dir, (int)dir_count, excluded, (int)dir_count, TRUE) == CSTR_EQUAL)) &&
+                 CompareStringOrdinal(name, (int)name_count, excluded + count - name_count, (int)name_count, TRUE) == CSTR_EQUAL)
+        {
+            //
+            // The entry itself
+            //
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool _is_excluded_path(const _dirwatcher_target_impl_t* target, const wchar_t* path, uint32_t path_count)
+{
+    uint32_t dir_count = path_count;
+
+    while (dir_count && path[dir_count - 1] != L'\\')
+    {
+        dir_count--;
+    }
+
+    if (!dir_count)
+    {
+        return _is_excluded(target, path, 0, path, path_count);
+    }
+
+    return _is_excluded(target, path, dir_count - 1, path + dir_count, path_count - dir_count);
+}
+
+/*
+    Refreshes the ignore rules the records made stale, then marks the records
+    that are ignored or excluded. Records of an extra directory are relative
+    to it; they match its own ignore files, and no exclusion, which all lie
+    below the root.
+*/
+static void _match_filtered(_dirwatcher_target_impl_t* target, _dirwatcher_subpath_t* subpath /* NULLABLE: the root */, _dirwatcher_notify_t* notifies, int count)
+{
+    _dirwatcher_ignore_t* ignore = subpath ? subpath->ignore : target->ignore;
+
+    for (int i = 0; ignore && i < count; i++)
+    {
+        bool removed = notifies[i].action == FILE_ACTION_REMOVED || notifies[i].action == FILE_ACTION_RENAMED_OLD_NAME;
+
+        _dirwatcher_ignore_notify(ignore, notifies[i].name, (uint32_t)notifies[i].name_count, removed);
+    }
+
+    AcquireSRWLockShared(&target->paths_lock);
+
+    for (int i = 0; i < count; i++)
+    {
+        notifies[i].ignored = (!subpath && _is_excluded_path(target, notifies[i].name, (uint32_t)notifies[i].name_count)) ||
+                              (ignore &&
+                               _dirwatcher_ignore_match(ignore,
+                                                        notifies[i].name,
+                                                        (uint32_t)notifies[i].name_count,
+                                                        (notifies[i].attributes & FILE_ATTRIBUTE_DIRECTORY) != 0));
+    }
+
+    ReleaseSRWLockShared(&target->paths_lock);
+}
+
+/*
+    Merges both halves of a rename into the record of its new name.
+*/
+static void _pair_renames(_dirwatcher_notify_t* notifies, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        _dirwatcher_notify_t* from = &notifies[i];
+
+        if (from->merged)
+        {
+            continue;
+        }
+
+        if (from->action == FILE_ACTION_RENAMED_OLD_NAME)
+        {
+            //
+            // Renames within a directory: the new name immediately follows the old one
+            //
+
+            if (i + 1 < count && notifies[i + 1].action == FILE_ACTION_RENAMED_NEW_NAME)
+            {
+                notifies[i + 1].pair = i;
+                from->merged         = true;
+            }
+        }
+        else if (from->action == FILE_ACTION_REMOVED && from->file_id)
+        {
+            //
+            // Moves between directories: removed + added of the same file id
+            //
+
+            for (int j = i + 1; j < count; j++)
+            {
+                _dirwatcher_notify_t* to = &notifies[j];
+
+                if (to->file_id != from->file_id)
+                {
+                    continue;
+                }
+
+                if (to->action == FILE_ACTION_ADDED && to->pair < 0)
+                {
+                    to->pair     = i;
+                    from->merged = true;
+                }
+
+                break;
+            }
+        }
+    }
+}
+
+static void _cleanup_events(dirwatcher_event_info_t* p_events_arr, int events_count)
+{
+    for (int i = 0; i < events_count; i++)
+    {
+        free(p_events_arr[i].name);
+        free(p_events_arr[i].old_name);
+        p_events_arr[i].name     = NULL;
+        p_events_arr[i].old_name = NULL;
+    }
+}
+
+static bool _notifies_to_events(const BYTE*              buffer,
+                                bool                     extended,
+                                bool                     pair,          /* merge renames and moves into DIRWATCHER_EVENT_RENAMED */
+                                _dirwatcher_target_impl_t* target,      /* NULLABLE: no filtering */
+                                _dirwatcher_subpath_t*   subpath,       /* NULLABLE: the root */
                                 dirwatcher_event_info_t* p_events_arr,
                                 size_t                   arr_size,      /* byte-size */
                                 int*                     p_events_count /* returned events count */)
@@ -119,26 +447,67 @@ static bool _notifies_to_events(PFILE_NOTIFY_INFORMATION pnotify,
     {
         return false;
     }
-    
-    int events_arr_count = (int)(arr_size / sizeof(dirwatcher_event_info_t));
-    int events_count     = _get_notifies_count(pnotify);
-    
-    _get_notifies_count(pnotify);
+
+    _dirwatcher_notify_t notifies[DIRWATCHER_MAX_NOTIFIES];
+    int                  events_arr_count = (int)(arr_size / sizeof(dirwatcher_event_info_t));
+    int                  notifies_count   = _read_notifies(buffer, extended, notifies, min(events_arr_count, DIRWATCHER_MAX_NOTIFIES));
+    int                  events_count     = 0;
+
+    if (target)
+    {
+        _match_filtered(target, subpath, notifies, notifies_count);
+    }
+
+    if (pair)
+    {
+        _pair_renames(notifies, notifies_count);
+    }
 
     memset(p_events_arr, 0, arr_size);
 
-    for (int i = 0; i < events_arr_count; i++)
+    for (int i = 0; i < notifies_count; i++)
     {
-        int name_len = _get_cstr_count_from_wstrn(pnotify->FileName, pnotify->FileNameLength / sizeof(wchar_t));
+        _dirwatcher_notify_t*    notify = &notifies[i];
+        dirwatcher_event_info_t* event  = &p_events_arr[events_count];
 
-        p_events_arr[i].name = malloc(name_len);
+        const _dirwatcher_notify_t* from = notify->pair >= 0 ? &notifies[notify->pair] : NULL;
+
+        //
+        // Ignored paths are dropped before their names are converted
+        //
 
-        if (!p_events_arr[i].name)
+        if (notify->merged || (notify->ignored && (!from || from->ignored)))
         {
-            for (int j = 0; j < i; j++)
-            {
-                free(p_events_arr[j].name);
-            }
+            continue;
+        }
+
+        if (from && (notify->ignored || from->ignored))
+        {
+            //
+            // Renamed across the ignore boundary: only one side is visible
+            //
+
+            const _dirwatcher_notify_t* visible = notify->ignored ? from : notify;
+
+            event->name  = _wstrn_to_new_cstr(visible->name, visible->name_count);
+            event->event = notify->ignored ? DIRWATCHER_EVENT_REMOVED : DIRWATCHER_EVENT_ADDED;
+            from         = NULL;
+        }
+        else if (from)
+        {
+            event->name     = _wstrn_to_new_cstr(notify->name, notify->name_count);
+            event->old_name = _wstrn_to_new_cstr(from->name, from->name_count);
+            event->event    = DIRWATCHER_EVENT_RENAMED;
+        }
+        else
+        {
+            event->name  = _wstrn_to_new_cstr(notify->name, notify->name_count);
+            event->event = _action_to_event(notify->action);
+        }
+
+        if (!event->name || (from && !event->old_name))
+        {
+            _cleanup_events(p_events_arr, events_count + 1);
             memset(p_events_arr, 0, arr_size);
 
             *p_events_count = 0;
@@ -146,13 +515,7 @@ static bool _notifies_to_events(PFILE_NOTIFY_INFORMATION pnotify,
             return false;
         }
 
-        _wstrn_to_cstr(pnotify->FileName, pnotify->FileNameLength / sizeof(wchar_t), p_events_arr[i].name, name_len);
-        p_events_arr[i].event = _action_to_event(pnotify->Action);
-    
-        if (!_go_next_notify(&pnotify))
-        {
-            break;
-        }
+        events_count++;
     }
 
     *p_events_count = events_count;
@@ -160,258 +523,2651 @@ static bool _notifies_to_events(PFILE_NOTIFY_INFORMATION pnotify,
     return true;
 }
 
-static void _cleanup_events(dirwatcher_event_info_t* p_events_arr, int events_count)
+static uint64_t _get_current_filetime(void)
 {
-    for (int i = 0; i < events_count; i++)
+    FILETIME       ft = { 0 };
+    ULARGE_INTEGER ul = { 0 };
+
+    GetSystemTimePreciseAsFileTime(&ft);
+
+    ul.LowPart  = ft.dwLowDateTime;
+    ul.HighPart = ft.dwHighDateTime;
+
+    return ul.QuadPart;
+}
+
+/*
+    Puts the target into the permanent error state and notifies the callback.
+    The worker must return right after this.
+*/
+static void _set_worker_error(_dirwatcher_target_impl_t* target, DWORD error, dirwatcher_callback_t cb, void* cb_user_data)
+{
+    InterlockedExchange(&target->error_code, (LONG)error);
+    InterlockedExchange(&target->exit_flag, 1);
+    if (cb) cb(NULL, cb_user_data);
+}
+
+/*
+    Returns the notify filter that reads the changes behind the target's event mask.
+*/
+static DWORD _get_notify_filter(_dirwatcher_target_impl_t* target)
+{
+    LONG  mask   = InterlockedCompareExchange(&target->event_mask, 0, 0);
+    DWORD filter = 0;
+
+    //
+    // The write tracker follows renames and removals even when they are not delivered
+    //
+
+    if (mask & (DIRWATCHER_NAME_EVENTS | DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_CLOSED_WRITE)))
     {
-        free(p_events_arr[i].name);
-        p_events_arr[i].name = NULL;
+        filter |= DIRWATCHER_NOTIFY_NAMES;
+    }
+
+    if (mask & DIRWATCHER_WRITE_EVENTS)
+    {
+        filter |= DIRWATCHER_NOTIFY_WRITES;
     }
+
+    return filter;
 }
 
-static DWORD WINAPI _worker_thread_routine(PVOID data)
+/*
+    Returns whether renames are delivered as DIRWATCHER_EVENT_RENAMED; only if the event mask asks for it.
+*/
+static bool _pairs_renames(_dirwatcher_target_impl_t* target)
 {
-    /*
-        NOTE: This worker relies on CancelIoEx() or handle closure to unblock
-              ReadDirectoryChangesW during shutdown.
-    */
+    LONG mask = InterlockedCompareExchange(&target->event_mask, 0, 0);
 
-    _dirwatcher_target_impl_t* target              = data;
-    dirwatcher_event_info_t    events[256]         = { 0 };
-    int                        events_count        = 0;
-    __declspec(align(4)) BYTE  notify_buffer[4096] = { 0 };
-    DWORD                      bytes_returned      = 0;
-    bool                       success             = true;
-    dirwatcher_callback_t      cb                  = NULL;
-    void*                      cb_user_data        = NULL;
+    return (mask & (LONG)DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_RENAMED)) != 0;
+}
 
-    for (;;)
+/*
+    Queues one notify read on handle, preferring the extended layout that
+    carries file ids. *p_read_changes_ex is cleared once the file system
+    turns out not to support it.
+*/
+static BOOL _queue_notify_read(HANDLE                        handle,
+                               _read_directory_changes_ex_t* p_read_changes_ex,
+                               BYTE*                         buffer,
+                               DWORD                         buffer_size,
+                               DWORD                         notify_filter,
+                               OVERLAPPED*                   overlapped)
+{
+    if (*p_read_changes_ex)
     {
-        //
-        // Wait for enable
-        //
+        if ((*p_read_changes_ex)(handle,
+                                 buffer,
+                                 buffer_size,
+                                 TRUE,
+                                 notify_filter,
+                                 NULL,
+                                 overlapped,
+                                 NULL,
+                                 ReadDirectoryNotifyExtendedInformation))
+        {
+            return TRUE;
+        }
 
-        WaitForSingleObject(target->worker_control_event, INFINITE);
+        DWORD last_error = GetLastError();
 
-        /* If exit flag set then exit */
-        if (InterlockedCompareExchange(&target->exit_flag, 0, 0))
+        if (last_error != ERROR_INVALID_PARAMETER &&
+            last_error != ERROR_INVALID_FUNCTION  &&
+            last_error != ERROR_NOT_SUPPORTED)
         {
-            return 0;
+            return FALSE;
         }
 
         //
-        // Get directory events
+        // File system without extended notifications; use the basic layout from now on
         //
 
-        success = ReadDirectoryChangesW(target->dir_handle,
-                                        notify_buffer,
-                                        sizeof(notify_buffer),
-                                        TRUE,
-                                        FILE_NOTIFY_CHANGE_DIR_NAME   |
-                                        FILE_NOTIFY_CHANGE_FILE_NAME  |
-                                        FILE_NOTIFY_CHANGE_LAST_WRITE |
-                                        FILE_NOTIFY_CHANGE_SIZE,
-                                        &bytes_returned,
-                                        NULL,
-                                        NULL);
+        *p_read_changes_ex = NULL;
+    }
 
-        //
-        // Get callback function safely
-        //
+    return ReadDirectoryChangesW(handle,
+                                 buffer,
+                                 buffer_size,
+                                 TRUE,
+                                 notify_filter,
+                                 NULL,
+                                 overlapped,
+                                 NULL);
+}
+
+static BOOL _queue_read(_dirwatcher_target_impl_t* target, BYTE* buffer, DWORD buffer_size, OVERLAPPED* overlapped)
+{
+    return _queue_notify_read(target->dir_handle, &target->read_changes_ex, buffer, buffer_size, target->notify_filter, overlapped);
+}
 
-        AcquireSRWLockShared(&target->callback_lock);
-        cb           = target->callback;
-        cb_user_data = target->callback_user_data;
-        ReleaseSRWLockShared(&target->callback_lock);
+/*
+    Busy-waits up to the target's spin time for a queued read to complete,
+    saving the wake-up of a blocked thread when changes follow each other closely.
+*/
+static void _spin_for_read(_dirwatcher_target_impl_t* target, const OVERLAPPED* overlapped)
+{
+    LONG          spin_us = InterlockedCompareExchange(&target->spin_us, 0, 0);
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER now;
 
-        if (success)
-        {
-            _notifies_to_events((PFILE_NOTIFY_INFORMATION)notify_buffer, events, sizeof(events), &events_count);
+    if (!spin_us)
+    {
+        return;
+    }
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&now);
+
+    LONGLONG deadline = now.QuadPart + frequency.QuadPart * spin_us / 1000000;
+
+    while (!HasOverlappedIoCompleted(overlapped) && now.QuadPart < deadline)
+    {
+        YieldProcessor();
+        QueryPerformanceCounter(&now);
+    }
+}
+
+static BOOL _queue_subpath_read(_dirwatcher_subpath_t* subpath)
+{
+    ResetEvent(subpath->overlapped.hEvent);
+
+    subpath->pending = _queue_notify_read(subpath->handle,
+                                          &subpath->read_changes_ex,
+                                          subpath->buffer,
+                                          sizeof(subpath->buffer),
+                                          subpath->notify_filter,
+                                          &subpath->overlapped) != FALSE;
+
+    return subpath->pending;
+}
+
+/*
+    Opens an extra directory and queues its first read.
+    Returns NULL on failure.
+*/
+static _dirwatcher_subpath_t* _create_subpath(const wchar_t* full_path, DWORD notify_filter)
+{
+    _dirwatcher_subpath_t* subpath = calloc(1, sizeof(_dirwatcher_subpath_t));
+
+    if (!subpath)
+    {
+        return NULL;
+    }
+
+    int prefix_len = WideCharToMultiByte(CP_UTF8, 0, full_path, -1, NULL, 0, NULL, FALSE);
+
+    subpath->handle            = CreateFileW(full_path,
+                                             FILE_LIST_DIRECTORY,
+                                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                             NULL,
+                                             OPEN_EXISTING,
+                                             FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                                             NULL);
+    subpath->overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    subpath->read_changes_ex   = (_read_directory_changes_ex_t)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "ReadDirectoryChangesExW");
+    subpath->notify_filter     = notify_filter;
+    subpath->full_path         = _wcsdup(full_path);
+    subpath->prefix            = prefix_len > 0 ? malloc((size_t)prefix_len) : NULL;
+
+    if (subpath->handle == INVALID_HANDLE_VALUE ||
+        !subpath->overlapped.hEvent ||
+        !subpath->full_path ||
+        !subpath->prefix ||
+        !WideCharToMultiByte(CP_UTF8, 0, full_path, -1, subpath->prefix, prefix_len, NULL, FALSE) ||
+        !_queue_subpath_read(subpath))
+    {
+        if (subpath->handle != INVALID_HANDLE_VALUE) CloseHandle(subpath->handle);
+        if (subpath->overlapped.hEvent) CloseHandle(subpath->overlapped.hEvent);
+        free(subpath->full_path);
+        free(subpath->prefix);
+        free(subpath);
+        return NULL;
+    }
+
+    return subpath;
+}
+
+static void _destroy_subpath(_dirwatcher_subpath_t* subpath)
+{
+    DWORD bytes = 0;
+
+    if (subpath->pending)
+    {
+        CancelIoEx(subpath->handle, &subpath->overlapped);
+        GetOverlappedResult(subpath->handle, &subpath->overlapped, &bytes, TRUE);
+    }
+
+    CloseHandle(subpath->handle);
+    CloseHandle(subpath->overlapped.hEvent);
+    _dirwatcher_ignore_destroy(subpath->ignore);
+    free(subpath->full_path);
+    free(subpath->prefix);
+    free(subpath);
+}
+
+/*
+    Replaces the handle of an extra directory with a new one read with
+    notify_filter, dropping the changes the old one held.
+    Returns false, keeping the old handle, if the directory cannot be opened.
+*/
+static bool _reopen_subpath(_dirwatcher_subpath_t* subpath, DWORD notify_filter)
+{
+    DWORD  bytes  = 0;
+    HANDLE handle = CreateFileW(subpath->full_path,
+                                FILE_LIST_DIRECTORY,
+                                FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                NULL,
+                                OPEN_EXISTING,
+                                FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                                NULL);
+
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    if (subpath->pending)
+    {
+        CancelIoEx(subpath->handle, &subpath->overlapped);
+        GetOverlappedResult(subpath->handle, &subpath->overlapped, &bytes, TRUE);
+    }
+
+    CloseHandle(subpath->handle);
+
+    subpath->handle        = handle;
+    subpath->notify_filter = notify_filter;
+
+    return _queue_subpath_read(subpath);
+}
+
+/*
+    Cancels and frees the extra directories removed since the last call.
+*/
+static void _destroy_retired_subpaths(_dirwatcher_target_impl_t* target)
+{
+    AcquireSRWLockExclusive(&target->paths_lock);
+
+    _dirwatcher_subpath_t* subpath = target->retired_subpaths;
+    target->retired_subpaths = NULL;
+
+    ReleaseSRWLockExclusive(&target->paths_lock);
+
+    while (subpath)
+    {
+        _dirwatcher_subpath_t* next = subpath->next;
+
+        _destroy_subpath(subpath);
+        subpath = next;
+    }
+}
+
+/*
+    Fills handles with the root read event, paths_event and the read events
+    of the extra directories, which go to subpaths. Returns the handle count.
+*/
+static DWORD _get_wait_set(_dirwatcher_target_impl_t* target, HANDLE* handles, _dirwatcher_subpath_t** subpaths)
+{
+    AcquireSRWLockShared(&target->paths_lock);
+
+    DWORD count = 2 + target->subpath_count;
+
+    handles[0] = target->read_event;
+    handles[1] = target->paths_event;
+
+    for (uint32_t i = 0; i < target->subpath_count; i++)
+    {
+        handles[2 + i] = target->subpaths[i]->overlapped.hEvent;
+        subpaths[i]    = target->subpaths[i];
+    }
+
+    ReleaseSRWLockShared(&target->paths_lock);
+
+    return count;
+}
+
+/*
+    Waits for the next notify buffer of the root or of an extra directory.
+    The root read is overlapped so that it can be spun on; CancelIoEx() on
+    the directory handle still ends it with ERROR_OPERATION_ABORTED. A root
+    read still pending when an extra directory completes is kept for the next call.
+
+    *p_subpath receives the extra directory whose read completed, or NULL
+    for the root, whose buffer is read_buffer. Fails with WAIT_TIMEOUT if
+    nothing completes within timeout_ms.
+*/
+static BOOL _read_changes(_dirwatcher_target_impl_t* target, DWORD timeout_ms, DWORD* p_bytes_returned, _dirwatcher_subpath_t** p_subpath)
+{
+    HANDLE                 handles[2 + DIRWATCHER_MAX_TARGET_PATHS];
+    _dirwatcher_subpath_t* subpaths[DIRWATCHER_MAX_TARGET_PATHS];
+
+    *p_subpath = NULL;
+
+    if (!target->read_pending)
+    {
+        memset(&target->read_overlapped, 0, sizeof(target->read_overlapped));
+        target->read_overlapped.hEvent = target->read_event;
+        ResetEvent(target->read_event);
+
+        if (!_queue_read(target, target->read_buffer, sizeof(target->read_buffer), &target->read_overlapped))
+        {
+            return FALSE;
+        }
+
+        target->read_pending = true;
+        _spin_for_read(target, &target->read_overlapped);
+    }
+
+    for (;;)
+    {
+        DWORD count = _get_wait_set(target, handles, subpaths);
+
+        //
+        // Take turns with the root so that a busy root does not starve extra directories
+        //
+
+        if (target->subpath_turn)
+        {
+            target->subpath_turn = false;
+
+            for (DWORD i = 2; i < count; i++)
+            {
+                if (HasOverlappedIoCompleted(&subpaths[i - 2]->overlapped))
+                {
+                    *p_subpath = subpaths[i - 2];
+                    return TRUE;
+                }
+            }
+        }
+
+        DWORD wait = WaitForMultipleObjects(count, handles, FALSE, timeout_ms);
+
+        if (wait == WAIT_OBJECT_0)
+        {
+            target->read_pending = false;
+            target->subpath_turn = true;
+
+            return GetOverlappedResult(target->dir_handle, &target->read_overlapped, p_bytes_returned, FALSE);
+        }
+        else if (wait == WAIT_OBJECT_0 + 1)
+        {
+            _destroy_retired_subpaths(target);
+        }
+        else if (wait < WAIT_OBJECT_0 + count)
+        {
+            *p_subpath = subpaths[wait - WAIT_OBJECT_0 - 2];
+            return TRUE;
+        }
+        else if (wait == WAIT_TIMEOUT)
+        {
+            SetLastError(WAIT_TIMEOUT);
+            return FALSE;
+        }
+        else
+        {
+            return FALSE;
+        }
+    }
+}
+
+/*
+    Drops probe file events from events and completes the pending probe when
+    its change is among them. Returns the new count.
+*/
+static int _filter_probe_events(_dirwatcher_target_impl_t* target, dirwatcher_event_info_t* events, int events_count)
+{
+    LARGE_INTEGER now;
+    int           kept   = 0;
+    LONG          wanted = InterlockedCompareExchange(&target->probe_wanted, 0, 0);
+
+    QueryPerformanceCounter(&now);
+
+    for (int i = 0; i < events_count; i++)
+    {
+        if (!events[i].name || strncmp(events[i].name, DIRWATCHER_PROBE_PREFIX, sizeof(DIRWATCHER_PROBE_PREFIX) - 1) != 0)
+        {
+            events[kept++] = events[i];
+            continue;
+        }
+
+        if ((LONG)events[i].event == wanted ||
+            (wanted == DIRWATCHER_EVENT_RENAMED && events[i].event == DIRWATCHER_EVENT_RENAMED_TO))
+        {
+            LONG64 start = InterlockedExchange64(&target->probe_ticks, 0);
+
+            if (start)
+            {
+                InterlockedExchange64(&target->probe_latency, now.QuadPart - start);
+                SetEvent(target->probe_event);
+            }
+        }
+
+        _cleanup_events(&events[i], 1);
+    }
+
+    return kept;
+}
+
+/*
+    Refuses every change token issued so far; called where changes may have gone unseen.
+*/
+static void _expire_changes(_dirwatcher_target_impl_t* target)
+{
+    AcquireSRWLockExclusive(&target->index_lock);
+
+    if (target->change_index)
+    {
+        _dirwatcher_change_index_expire(target->change_index);
+    }
+
+    ReleaseSRWLockExclusive(&target->index_lock);
+}
+
+/*
+    Handles a notify buffer that overflowed: its records, and the writes and
+    renames they held, are lost.
+*/
+static void _overflow_changes(_dirwatcher_target_impl_t* target)
+{
+    _expire_changes(target);
+
+    if (target->write_tracker)
+    {
+        _dirwatcher_write_tracker_clear(target->write_tracker);
+    }
+}
+
+static void _get_callback(_dirwatcher_target_impl_t* target, dirwatcher_callback_t* p_cb, void** p_cb_user_data)
+{
+    AcquireSRWLockShared(&target->callback_lock);
+    *p_cb           = target->callback;
+    *p_cb_user_data = target->callback_user_data;
+    ReleaseSRWLockShared(&target->callback_lock);
+}
+
+/*
+    Tracks the files being written, then drops the events outside the
+    target's event mask. Returns the new count.
+*/
+static int _filter_masked_events(_dirwatcher_target_impl_t* target, dirwatcher_event_info_t* events, int events_count)
+{
+    LONG mask = InterlockedCompareExchange(&target->event_mask, 0, 0);
+    int  kept = 0;
+
+    for (int i = 0; i < events_count; i++)
+    {
+        //
+        // A file the tracker cannot hold for lack of memory goes without its CLOSED_WRITE
+        //
+
+        if (target->write_tracker)
+        {
+            _dirwatcher_write_tracker_update(target->write_tracker, &events[i]);
+        }
+
+        if (mask & (LONG)DIRWATCHER_EVENT_MASK(events[i].event))
+        {
+            events[kept++] = events[i];
+            continue;
+        }
+
+        _cleanup_events(&events[i], 1);
+    }
+
+    return kept;
+}
+
+/*
+    Stamps decoded events, publishes them to shared memory and the journal,
+    calls the callback and frees them. A journal that fails to append is
+    skipped from then on; delivery goes on without it.
+*/
+static void _dispatch_events(_dirwatcher_target_impl_t* target,
+                             dirwatcher_event_info_t*   events,
+                             int                        events_count,
+                             dirwatcher_callback_t      cb,
+                             void*                      cb_user_data)
+{
+    uint64_t timestamp = _get_current_filetime();
+
+    if (InterlockedCompareExchange(&target->probe_active, 0, 0))
+    {
+        events_count = _filter_probe_events(target, events, events_count);
+    }
+
+    events_count = _filter_masked_events(target, events, events_count);
+
+    for (int i = 0; i < events_count; i++)
+    {
+        events[i].target    = target;
+        events[i].timestamp = timestamp;
+    }
+
+    //
+    // Stamp the changed paths in the change index
+    //
+
+    AcquireSRWLockExclusive(&target->index_lock);
+
+    for (int i = 0; target->change_index && i < events_count; i++)
+    {
+        if (events[i].name)
+        {
+            _dirwatcher_change_index_record(target->change_index, events[i].name);
+        }
+
+        if (events[i].old_name)
+        {
+            _dirwatcher_change_index_record(target->change_index, events[i].old_name);
+        }
+    }
+
+    ReleaseSRWLockExclusive(&target->index_lock);
+
+    //
+    // Publish to shared memory and journal
+    //
+
+    AcquireSRWLockShared(&target->sink_lock);
+
+    for (int i = 0; i < events_count; i++)
+    {
+        if (target->publisher)
+        {
+            _dirwatcher_shm_publish(target->publisher, &events[i]);
+        }
+
+        if (target->journal &&
+            !InterlockedCompareExchange(&target->journal_error, 0, 0) &&
+            !_dirwatcher_journal_append(target->journal, &events[i]))
+        {
+            DWORD last_error = GetLastError();
+
+            InterlockedExchange(&target->journal_error, (LONG)(last_error ? last_error : ERROR_WRITE_FAULT));
+        }
+    }
+
+    if (target->publisher && events_count)
+    {
+        _dirwatcher_shm_wake_readers(target->publisher);
+    }
+
+    ReleaseSRWLockShared(&target->sink_lock);
+
+    //
+    // Call callback function
+    //
+
+    for (int i = 0; i < events_count; i++)
+    {
+        if (cb)
+        {
+            cb(&events[i], cb_user_data);
+        }
+    }
+
+    //
+    // Cleanup events
+    //
+
+    _cleanup_events(events, events_count);
+}
+
+static bool _prefix_name(char** p_name, const char* prefix)
+{
+    size_t prefix_len = strlen(prefix);
+    size_t name_len   = strlen(*p_name);
+    bool   separator  = prefix_len && prefix[prefix_len - 1] != '\\';
+    char*  name       = malloc(prefix_len + separator + name_len + 1);
+
+    if (!name)
+    {
+        return false;
+    }
+
+    memcpy(name, prefix, prefix_len);
+
+    if (separator)
+    {
+        name[prefix_len] = '\\';
+    }
+
+    memcpy(name + prefix_len + separator, *p_name, name_len + 1);
+
+    free(*p_name);
+    *p_name = name;
+
+    return true;
+}
+
+/*
+    Drops an extra directory that can no longer be read; its changes since the last read are lost.
+*/
+static void _drop_subpath(_dirwatcher_target_impl_t* target, _dirwatcher_subpath_t* subpath)
+{
+    bool found = false;
+
+    AcquireSRWLockExclusive(&target->paths_lock);
+
+    for (uint32_t i = 0; i < target->subpath_count; i++)
+    {
+        if (target->subpaths[i] == subpath)
+        {
+            target->subpaths[i] = target->subpaths[--target->subpath_count];
+            found               = true;
+            break;
+        }
+    }
+
+    ReleaseSRWLockExclusive(&target->paths_lock);
+
+    //
+    // Not found: already retired by dirwatcher_remove_target_path(), freed with the retired list
+    //
+
+    if (found)
+    {
+        _destroy_subpath(subpath);
+        _expire_changes(target);
+    }
+}
+
+/*
+    Creates or drops the ignore rule matcher of an extra directory to follow the root's.
+    Returns false if it cannot be created.
+*/
+static bool _sync_subpath_ignore(_dirwatcher_target_impl_t* target, _dirwatcher_subpath_t* subpath)
+{
+    if ((target->ignore != NULL) == (subpath->ignore != NULL))
+    {
+        return true;
+    }
+
+    if (!target->ignore)
+    {
+        _dirwatcher_ignore_destroy(subpath->ignore);
+        subpath->ignore = NULL;
+
+        return true;
+    }
+
+    subpath->ignore = _dirwatcher_ignore_create(subpath->full_path);
+
+    return subpath->ignore != NULL;
+}
+
+/*
+    Dispatches the completed read of an extra directory and queues the next one.
+*/
+static void _service_subpath(_dirwatcher_target_impl_t* target, _dirwatcher_subpath_t* subpath, dirwatcher_event_info_t* events)
+{
+    dirwatcher_callback_t cb           = NULL;
+    void*                 cb_user_data = NULL;
+    int                   events_count = 0;
+    DWORD                 bytes        = 0;
+
+    if (InterlockedCompareExchange(&subpath->retired, 0, 0))
+    {
+        return;
+    }
+
+    subpath->pending = false;
+
+    if (!GetOverlappedResult(subpath->handle, &subpath->overlapped, &bytes, FALSE) ||
+        !_sync_subpath_ignore(target, subpath))
+    {
+        _drop_subpath(target, subpath);
+        return;
+    }
+
+    if (bytes)
+    {
+        _notifies_to_events(subpath->buffer,
+                            subpath->read_changes_ex != NULL,
+                            _pairs_renames(target),
+                            target,
+                            subpath,
+                            events,
+                            DIRWATCHER_MAX_NOTIFIES * sizeof(dirwatcher_event_info_t),
+                            &events_count);
+
+        //
+        // Names below an extra directory follow its full path
+        //
+
+        for (int i = 0; i < events_count; i++)
+        {
+            if (!_prefix_name(&events[i].name, subpath->prefix) ||
+                (events[i].old_name && !_prefix_name(&events[i].old_name, subpath->prefix)))
+            {
+                _cleanup_events(events, events_count);
+                events_count = 0;
+                break;
+            }
+        }
+    }
+    else
+    {
+        _overflow_changes(target);
+    }
+
+    _queue_subpath_read(subpath);
+
+    _get_callback(target, &cb, &cb_user_data);
+
+    _dispatch_events(target, events, events_count, cb, cb_user_data);
+
+    if (!subpath->pending)
+    {
+        _drop_subpath(target, subpath);
+    }
+}
+
+/*
+    Serves the extra directories whose reads completed, without waiting; for targets that poll.
+*/
+static void _poll_subpaths(_dirwatcher_target_impl_t* target, dirwatcher_event_info_t* events)
+{
+    HANDLE                 handles[2 + DIRWATCHER_MAX_TARGET_PATHS];
+    _dirwatcher_subpath_t* subpaths[DIRWATCHER_MAX_TARGET_PATHS];
+
+    if (WaitForSingleObject(target->paths_event, 0) == WAIT_OBJECT_0)
+    {
+        _destroy_retired_subpaths(target);
+    }
+
+    DWORD count = _get_wait_set(target, handles, subpaths);
+
+    for (DWORD i = 2; i < count; i++)
+    {
+        if (HasOverlappedIoCompleted(&subpaths[i - 2]->overlapped))
+        {
+            _service_subpath(target, subpaths[i - 2], events);
+        }
+    }
+}
+
+/*
+    Collects the changes of a poll pass into batches for _dispatch_events.
+*/
+typedef struct _dirwatcher_poll_sink
+{
+    _dirwatcher_target_impl_t* target;
+    dirwatcher_event_info_t*   events;              // DIRWATCHER_MAX_NOTIFIES entries
+    int                        events_count;
+} _dirwatcher_poll_sink_t;
+
+static void _flush_poll_sink(_dirwatcher_poll_sink_t* sink)
+{
+    dirwatcher_callback_t cb           = NULL;
+    void*                 cb_user_data = NULL;
+
+    _get_callback(sink->target, &cb, &cb_user_data);
+
+    int events_count = sink->events_count;
+
+    sink->events_count = 0;
+
+    _dispatch_events(sink->target, sink->events, events_count, cb, cb_user_data);
+}
+
+/*
+    Passes a polled change to the ignore rule matcher, which drops the rules it made stale.
+*/
+static void _notify_ignore(_dirwatcher_ignore_t* ignore, const char* path, bool removed)
+{
+    int      count = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+    wchar_t* wpath = count > 0 ? malloc((size_t)count * sizeof(wchar_t)) : NULL;
+
+    if (wpath && MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, count))
+    {
+        _dirwatcher_ignore_notify(ignore, wpath, (uint32_t)(count - 1), removed);
+    }
+
+    free(wpath);
+}
+
+static bool _poll_filter(void* context, const wchar_t* dir, uint32_t dir_count, const wchar_t* name, uint32_t name_count, bool is_dir)
+{
+    _dirwatcher_target_impl_t* target = context;
+
+    AcquireSRWLockShared(&target->paths_lock);
+
+    bool excluded = _is_excluded(target, dir, dir_count, name, name_count);
+
+    ReleaseSRWLockShared(&target->paths_lock);
+
+    return excluded || (target->ignore && _dirwatcher_ignore_match_child(target->ignore, dir, dir_count, name, name_count, is_dir));
+}
+
+static bool _push_poll_event(_dirwatcher_poll_sink_t* sink, dirwatcher_event_t event, const char* name, const char* old_name /* NULLABLE */)
+{
+    if (sink->events_count == DIRWATCHER_MAX_NOTIFIES)
+    {
+        _flush_poll_sink(sink);
+    }
+
+    dirwatcher_event_info_t* info = &sink->events[sink->events_count];
+
+    memset(info, 0, sizeof(*info));
+    info->event    = event;
+    info->name     = _strdup(name);
+    info->old_name = old_name ? _strdup(old_name) : NULL;
+
+    if (!info->name || (old_name && !info->old_name))
+    {
+        free(info->name);
+        free(info->old_name);
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return false;
+    }
+
+    sink->events_count++;
+    return true;
+}
+
+static bool _poll_emit(void* context, dirwatcher_event_t event, const char* name, const char* old_name /* NULLABLE */)
+{
+    _dirwatcher_poll_sink_t* sink = context;
+
+    if (sink->target->ignore)
+    {
+        if (old_name)
+        {
+            _notify_ignore(sink->target->ignore, old_name, true);
+        }
+
+        _notify_ignore(sink->target->ignore, name, event == DIRWATCHER_EVENT_REMOVED);
+    }
+
+    //
+    // Without DIRWATCHER_EVENT_RENAMED in the mask, renames keep the halves native reads deliver
+    //
+
+    if (event == DIRWATCHER_EVENT_RENAMED && !_pairs_renames(sink->target))
+    {
+        return _push_poll_event(sink, DIRWATCHER_EVENT_RENAMED_FROM, old_name, NULL) &&
+               _push_poll_event(sink, DIRWATCHER_EVENT_RENAMED_TO, name, NULL);
+    }
+
+    return _push_poll_event(sink, event, name, old_name);
+}
+
+static bool _write_emit(void* context, const char* name)
+{
+    return _poll_emit(context, DIRWATCHER_EVENT_CLOSED_WRITE, name, NULL);
+}
+
+/*
+    Returns the milliseconds until the next probe of the files being
+    written, INFINITE while none are tracked.
+*/
+static DWORD _get_write_probe_timeout(_dirwatcher_target_impl_t* target)
+{
+    if (!target->write_tracker || !_dirwatcher_write_tracker_get_count(target->write_tracker))
+    {
+        return INFINITE;
+    }
+
+    ULONGLONG now = GetTickCount64();
+
+    return now >= target->next_probe_tick ? 0 : (DWORD)(target->next_probe_tick - now);
+}
+
+/*
+    Once the probe interval has passed, dispatches DIRWATCHER_EVENT_CLOSED_WRITE
+    for the tracked files that are no longer open for writing.
+    Returns false after setting a worker error.
+*/
+static bool _probe_writes(_dirwatcher_target_impl_t* target, dirwatcher_event_info_t* events)
+{
+    _dirwatcher_poll_sink_t sink = { target, events, 0 };
+
+    if (_get_write_probe_timeout(target) != 0)
+    {
+        return true;
+    }
+
+    target->next_probe_tick = GetTickCount64() + DIRWATCHER_CLOSED_WRITE_PROBE_INTERVAL;
+
+    if (!_dirwatcher_write_tracker_probe(target->write_tracker, _write_emit, &sink))
+    {
+        DWORD                 last_error   = GetLastError();
+        dirwatcher_callback_t cb           = NULL;
+        void*                 cb_user_data = NULL;
+
+        _cleanup_events(events, sink.events_count);
+        _get_callback(target, &cb, &cb_user_data);
+        _set_worker_error(target, last_error ? last_error : ERROR_NOT_ENOUGH_MEMORY, cb, cb_user_data);
+
+        return false;
+    }
+
+    _flush_poll_sink(&sink);
+
+    return true;
+}
+
+static wchar_t* _get_root_wpath(_dirwatcher_target_impl_t* target)
+{
+    DWORD    cch  = GetFinalPathNameByHandleW(target->root_handle, NULL, 0, FILE_NAME_NORMALIZED | VOLUME_NAME_DOS);
+    wchar_t* path = cch ? malloc(cch * sizeof(wchar_t)) : NULL;
+
+    if (path && !GetFinalPathNameByHandleW(target->root_handle, path, cch, FILE_NAME_NORMALIZED | VOLUME_NAME_DOS))
+    {
+        free(path);
+        path = NULL;
+    }
+
+    return path;
+}
+
+/*
+    Runs one polling pass and adapts the interval to the next one: back to
+    the minimum after a change, doubled up to the maximum while idle. A
+    target demoted by the watch budget polls at the cold interval.
+    Returns false after setting a worker error.
+*/
+static bool _poll_target(_dirwatcher_target_impl_t* target, dirwatcher_event_info_t* events, DWORD* p_interval, bool* p_changed)
+{
+    _dirwatcher_poll_sink_t sink    = { target, events, 0 };
+    bool                    changed = false;
+    bool                    success = true;
+
+    if (!target->poller)
+    {
+        wchar_t* root_path = _get_root_wpath(target);
+
+        target->poller = root_path ? _dirwatcher_poller_create(root_path) : NULL;
+        success        = target->poller != NULL;
+
+        free(root_path);
+
+        if (success)
+        {
+            _dirwatcher_poller_set_filter(target->poller, _poll_filter, target);
+        }
+    }
+
+    bool baseline = success && _dirwatcher_poller_has_baseline(target->poller);
+
+    success = success && _dirwatcher_poller_scan(target->poller, _poll_emit, &sink, &target->interrupt_flag, &changed);
+
+    if (!success)
+    {
+        DWORD                 last_error   = GetLastError();
+        dirwatcher_callback_t cb           = NULL;
+        void*                 cb_user_data = NULL;
+
+        _cleanup_events(events, sink.events_count);
+        _get_callback(target, &cb, &cb_user_data);
+        _set_worker_error(target, last_error ? last_error : ERROR_NOT_ENOUGH_MEMORY, cb, cb_user_data);
+
+        return false;
+    }
+
+    _flush_poll_sink(&sink);
+
+    //
+    // Passes until the baseline only record the tree; changes during them are not seen
+    //
+
+    if (!baseline)
+    {
+        _expire_changes(target);
+    }
+
+    InterlockedExchange(&target->polled_directories, (LONG)_dirwatcher_poller_get_directory_count(target->poller));
+
+    DWORD min_interval = (DWORD)InterlockedCompareExchange(&target->poll_min_interval, 0, 0);
+    DWORD max_interval = (DWORD)InterlockedCompareExchange(&target->poll_max_interval, 0, 0);
+
+    if (InterlockedCompareExchange(&target->demoted, 0, 0))
+    {
+        min_interval = _dirwatcher_budget_get_cold_interval();
+        max_interval = min_interval;
+    }
+
+    *p_interval = changed ? min_interval : min(max(*p_interval * 2, min_interval), max_interval);
+    *p_changed  = changed;
+
+    return true;
+}
+
+/*
+    Opens a handle of its own on the target directory for notify reads;
+    closing it frees the kernel notify buffer and keeps root_handle.
+    Returns NULL on failure.
+*/
+static HANDLE _reopen_target_dir(HANDLE root_handle)
+{
+    HANDLE h = ReOpenFile(root_handle,
+                          FILE_LIST_DIRECTORY,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                          FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED);
+
+    return h != INVALID_HANDLE_VALUE ? h : NULL;
+}
+
+/*
+    Cancels the pending notify read, if any, so the worker wakes; callable from any thread.
+*/
+static void _cancel_dir_read(_dirwatcher_target_impl_t* target)
+{
+    AcquireSRWLockShared(&target->dir_lock);
+
+    if (target->dir_handle)
+    {
+        CancelIoEx(target->dir_handle, NULL);
+    }
+
+    ReleaseSRWLockShared(&target->dir_lock);
+}
+
+/*
+    Waits for the pending root read to end; it writes into the target until then.
+*/
+static void _cancel_root_read(_dirwatcher_target_impl_t* target)
+{
+    DWORD bytes = 0;
+
+    if (target->read_pending)
+    {
+        CancelIoEx(target->dir_handle, &target->read_overlapped);
+        GetOverlappedResult(target->dir_handle, &target->read_overlapped, &bytes, TRUE);
+
+        target->read_pending = false;
+    }
+}
+
+/*
+    Closes dir_handle once the target polls, freeing its kernel notify buffer
+    and the changes it would collect.
+*/
+static void _close_dir_handle(_dirwatcher_target_impl_t* target)
+{
+    _cancel_root_read(target);
+
+    AcquireSRWLockExclusive(&target->dir_lock);
+
+    HANDLE dir_handle = target->dir_handle;
+    target->dir_handle = NULL;
+
+    ReleaseSRWLockExclusive(&target->dir_lock);
+
+    CloseHandle(dir_handle);
+}
+
+/*
+    Called by the watch budget, under its lock, to move the target to polling.
+*/
+static void _demote_target(void* owner)
+{
+    _dirwatcher_target_impl_t* target = owner;
+
+    InterlockedExchange(&target->demoted, 1);
+    InterlockedIncrement64(&target->demotions);
+
+    //
+    // Unblock a pending read so the worker switches now
+    //
+
+    _cancel_dir_read(target);
+}
+
+/*
+    Moves a demoted target back to native notifications once the watch budget allows it.
+*/
+static bool _try_promote_target(_dirwatcher_target_impl_t* target)
+{
+    //
+    // A fresh handle holds none of the changes made while polling, which the polls reported
+    //
+
+    HANDLE dir_handle = _reopen_target_dir(target->root_handle);
+
+    if (!dir_handle)
+    {
+        return false;
+    }
+
+    AcquireSRWLockExclusive(&target->dir_lock);
+    target->dir_handle = dir_handle;
+    ReleaseSRWLockExclusive(&target->dir_lock);
+
+    target->notify_filter = _get_notify_filter(target);
+
+    //
+    // Cleared before the budget counts the target as native: from then on
+    // it may demote the target again, and that must not be overwritten
+    //
+
+    InterlockedExchange(&target->demoted, 0);
+
+    if (!_dirwatcher_budget_promote(&target->budget_entry))
+    {
+        InterlockedExchange(&target->demoted, 1);
+        _close_dir_handle(target);
+
+        return false;
+    }
+
+    _dirwatcher_poller_destroy(target->poller);
+    target->poller = NULL;
+
+    _expire_changes(target);
+
+    InterlockedExchange(&target->polled_directories, 0);
+    InterlockedIncrement64(&target->promotions);
+
+    return true;
+}
+
+/*
+    Reopens the directory handles whose notify filter no longer follows the
+    event mask; the kernel keeps the filter of a handle's first read.
+    Changes in between are lost, so change tokens expire.
+    Returns false after setting a worker error.
+*/
+static bool _sync_notify_filter(_dirwatcher_target_impl_t* target)
+{
+    HANDLE                 handles[2 + DIRWATCHER_MAX_TARGET_PATHS];
+    _dirwatcher_subpath_t* subpaths[DIRWATCHER_MAX_TARGET_PATHS];
+    DWORD                  filter = _get_notify_filter(target);
+    bool                   stale  = false;
+
+    if (target->dir_handle && target->notify_filter != filter)
+    {
+        _close_dir_handle(target);
+
+        HANDLE dir_handle = _reopen_target_dir(target->root_handle);
+
+        if (!dir_handle)
+        {
+            dirwatcher_callback_t cb           = NULL;
+            void*                 cb_user_data = NULL;
+            DWORD                 error        = GetLastError();
+
+            _get_callback(target, &cb, &cb_user_data);
+            _set_worker_error(target, error, cb, cb_user_data);
+
+            return false;
+        }
+
+        AcquireSRWLockExclusive(&target->dir_lock);
+        target->dir_handle = dir_handle;
+        ReleaseSRWLockExclusive(&target->dir_lock);
+
+        target->notify_filter = filter;
+        stale                 = true;
+    }
+
+    //
+    // Extra directories added with an older mask are caught here as well
+    //
+
+    DWORD count = _get_wait_set(target, handles, subpaths);
+
+    for (DWORD i = 2; i < count; i++)
+    {
+        _dirwatcher_subpath_t* subpath = subpaths[i - 2];
+
+        if (subpath->notify_filter == filter || InterlockedCompareExchange(&subpath->retired, 0, 0))
+        {
+            continue;
+        }
+
+        if (!_reopen_subpath(subpath, filter))
+        {
+            _drop_subpath(target, subpath);
+        }
+
+        stale = true;
+    }
+
+    if (stale)
+    {
+        _expire_changes(target);
+    }
+
+    return true;
+}
+
+/*
+    Creates or drops the ignore rule matcher to follow dirwatcher_set_target_ignore_files().
+    Returns false after setting a worker error.
+*/
+static bool _sync_ignore(_dirwatcher_target_impl_t* target)
+{
+    bool enabled = InterlockedCompareExchange(&target->ignore_files, 0, 0) != 0;
+
+    if (enabled == (target->ignore != NULL))
+    {
+        return true;
+    }
+
+    if (!enabled)
+    {
+        _dirwatcher_ignore_destroy(target->ignore);
+        target->ignore = NULL;
+
+        return true;
+    }
+
+    wchar_t* root_path = _get_root_wpath(target);
+    DWORD    error     = root_path ? ERROR_NOT_ENOUGH_MEMORY : GetLastError();
+
+    target->ignore = root_path ? _dirwatcher_ignore_create(root_path) : NULL;
+
+    free(root_path);
+
+    if (!target->ignore)
+    {
+        dirwatcher_callback_t cb           = NULL;
+        void*                 cb_user_data = NULL;
+
+        _get_callback(target, &cb, &cb_user_data);
+        _set_worker_error(target, error, cb, cb_user_data);
+
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Creates or drops the tracker of files being written to follow the
+    DIRWATCHER_EVENT_CLOSED_WRITE bit of the event mask.
+    Returns false after setting a worker error.
+*/
+static bool _sync_write_tracker(_dirwatcher_target_impl_t* target)
+{
+    LONG mask    = InterlockedCompareExchange(&target->event_mask, 0, 0);
+    bool enabled = (mask & (LONG)DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_CLOSED_WRITE)) != 0;
+
+    if (enabled == (target->write_tracker != NULL))
+    {
+        return true;
+    }
+
+    if (!enabled)
+    {
+        _dirwatcher_write_tracker_destroy(target->write_tracker);
+        target->write_tracker = NULL;
+
+        return true;
+    }
+
+    wchar_t* root_path = _get_root_wpath(target);
+    DWORD    error     = root_path ? ERROR_NOT_ENOUGH_MEMORY : GetLastError();
+
+    target->write_tracker = root_path ? _dirwatcher_write_tracker_create(root_path) : NULL;
+
+    free(root_path);
+
+    if (!target->write_tracker)
+    {
+        dirwatcher_callback_t cb           = NULL;
+        void*                 cb_user_data = NULL;
+
+        _get_callback(target, &cb, &cb_user_data);
+        _set_worker_error(target, error, cb, cb_user_data);
+
+        return false;
+    }
+
+    return true;
+}
+
+/*
+    Decodes and dispatches one generated notify buffer.
+*/
+static void _synthesize(_dirwatcher_target_impl_t* target,
+                        BYTE*                      notify_buffer,
+                        DWORD                      buffer_size,
+                        dirwatcher_event_info_t*   events,
+                        DWORD*                     p_wait_ms)
+{
+    dirwatcher_callback_t cb           = NULL;
+    void*                 cb_user_data = NULL;
+    int                   events_count = 0;
+    DWORD                 bytes        = _dirwatcher_synthetic_fill(target->synthetic, notify_buffer, buffer_size, DIRWATCHER_MAX_NOTIFIES, p_wait_ms);
+
+    if (!bytes)
+    {
+        return;
+    }
+
+    _get_callback(target, &cb, &cb_user_data);
+
+    _notifies_to_events(notify_buffer, true, _pairs_renames(target), NULL, NULL, events, DIRWATCHER_MAX_NOTIFIES * sizeof(dirwatcher_event_info_t), &events_count);
+
+    _dispatch_events(target, events, events_count, cb, cb_user_data);
+}
+
+static DWORD WINAPI _worker_thread_routine(PVOID data)
+{
+    /*
+        NOTE: This worker relies on CancelIoEx() or handle closure to unblock
+              ReadDirectoryChangesW during shutdown.
+    */
+
+    _dirwatcher_target_impl_t* target                          = data;
+    dirwatcher_event_info_t    events[DIRWATCHER_MAX_NOTIFIES] = { 0 };
+    int                        events_count                    = 0;
+    __declspec(align(8)) BYTE  notify_buffer[4096]             = { 0 };
+    DWORD                      bytes_returned                  = 0;
+    bool                       success                         = true;
+    dirwatcher_callback_t      cb                              = NULL;
+    void*                      cb_user_data                    = NULL;
+    DWORD                      poll_interval                   = 0;
+    _dirwatcher_subpath_t*     subpath                         = NULL;
+
+    for (;;)
+    {
+        //
+        // Wait for enable
+        //
+
+        InterlockedExchange(&target->interrupt_flag, 0);
+
+        WaitForSingleObject(target->worker_control_event, INFINITE);
+
+        /* If exit flag set then exit */
+        if (InterlockedCompareExchange(&target->exit_flag, 0, 0))
+        {
+            return 0;
+        }
+
+        //
+        // Synthetic backend: one generated buffer, waiting only to keep the configured rate
+        //
+
+        if (target->synthetic)
+        {
+            DWORD wait_ms = 0;
+
+            _synthesize(target, notify_buffer, sizeof(notify_buffer), events, &wait_ms);
+
+            if (wait_ms)
+            {
+                WaitForSingleObject(target->worker_wake_event, wait_ms);
+            }
+
+            continue;
+        }
+
+        //
+        // Follow the ignore files setting before matching anything against it,
+        // and the event mask before tracking files being written or reading changes
+        //
+
+        if (!_sync_ignore(target) || !_sync_write_tracker(target) || !_sync_notify_filter(target))
+        {
+            return (DWORD)-1;
+        }
+
+        //
+        // Report the files whose writers closed them since the last probe
+        //
+
+        if (!_probe_writes(target, events))
+        {
+            return (DWORD)-1;
+        }
+
+        //
+        // Polling backend, or demoted by the watch budget: one pass, then
+        // sleep until the next one or a pause
+        //
+
+        if (InterlockedCompareExchange(&target->polling, 0, 0) ||
+            InterlockedCompareExchange(&target->demoted, 0, 0))
+        {
+            bool changed = false;
+
+            if (target->dir_handle)
+            {
+                _close_dir_handle(target);
+            }
+
+            if (!_poll_target(target, events, &poll_interval, &changed))
+            {
+                return (DWORD)-1;
+            }
+
+            _poll_subpaths(target, events);
+
+            //
+            // Activity on a demoted target asks for its native watch back
+            //
+
+            if (changed &&
+                InterlockedCompareExchange(&target->demoted, 0, 0) &&
+                !InterlockedCompareExchange(&target->polling, 0, 0) &&
+                _try_promote_target(target))
+            {
+                continue;
+            }
+
+            WaitForSingleObject(target->worker_wake_event, min(poll_interval, _get_write_probe_timeout(target)));
+            continue;
+        }
+
+        //
+        // Get directory events
+        //
+
+        success = _read_changes(target, _get_write_probe_timeout(target), &bytes_returned, &subpath);
+
+        if (success && subpath)
+        {
+            _service_subpath(target, subpath, events);
+            continue;
+        }
+
+        //
+        // Get callback function safely
+        //
+
+        _get_callback(target, &cb, &cb_user_data);
+
+        if (success)
+        {
+            //
+            // Zero bytes means the kernel buffer overflowed and the records were lost
+            //
+
+            events_count = 0;
+
+            if (!_sync_ignore(target))
+            {
+                return (DWORD)-1;
+            }
+
+            if (bytes_returned)
+            {
+                _notifies_to_events(target->read_buffer, target->read_changes_ex != NULL, _pairs_renames(target), target, NULL, events, sizeof(events), &events_count);
+            }
+            else
+            {
+                _overflow_changes(target);
+            }
+
+            _dispatch_events(target, events, events_count, cb, cb_user_data);
+
+            _dirwatcher_budget_touch(&target->budget_entry);
+        }
+        else
+        {
+            DWORD last_error = GetLastError();
+
+            if (last_error == ERROR_OPERATION_ABORTED || last_error == WAIT_TIMEOUT)
+            {
+                continue;
+            }
+            else if (target->backend == DIRWATCHER_BACKEND_AUTO &&
+                     (last_error == ERROR_INVALID_FUNCTION || last_error == ERROR_NOT_SUPPORTED))
+            {
+                //
+                // The file system has no change notifications; poll it instead
+                // and give the place in the watch budget to another target
+                //
+
+                _dirwatcher_budget_unregister(&target->budget_entry);
+
+                InterlockedExchange(&target->polling, 1);
+                InterlockedExchange(&target->demoted, 0);
+                continue;
+            }
+            else
+            {
+                _set_worker_error(target, last_error, cb, cb_user_data);
+                return (DWORD)-1;
+            }
+        }
+    }
+}
+
+static void _trim_separator(wchar_t* path)
+{
+    size_t count = wcslen(path);
+
+    //
+    // Keep the separator of a drive root ("C:\")
+    //
+
+    if (count > 1 && path[count - 1] == L'\\' && path[count - 2] != L':')
+    {
+        path[count - 1] = L'\0';
+    }
+}
+
+/*
+    Returns path (in the ANSI code page, like target names) as a full path
+    without a trailing separator. Returns NULL on failure.
+*/
+static wchar_t* _get_full_wpath(const char* path)
+{
+    int      count = MultiByteToWideChar(CP_ACP, 0, path, -1, NULL, 0);
+    wchar_t* wpath = count > 0 ? malloc((size_t)count * sizeof(wchar_t)) : NULL;
+    wchar_t* full  = NULL;
+
+    if (wpath && MultiByteToWideChar(CP_ACP, 0, path, -1, wpath, count))
+    {
+        DWORD full_count = GetFullPathNameW(wpath, 0, NULL, NULL);
+
+        full = full_count ? malloc(full_count * sizeof(wchar_t)) : NULL;
+
+        if (full && !GetFullPathNameW(wpath, full_count, full, NULL))
+        {
+            free(full);
+            full = NULL;
+        }
+    }
+
+    free(wpath);
+
+    if (full)
+    {
+        _trim_separator(full);
+    }
+
+    return full;
+}
+
+/*
+    Returns the root in the form of _get_full_wpath: without the \\?\ prefix.
+*/
+static wchar_t* _get_root_full_wpath(_dirwatcher_target_impl_t* target)
+{
+    wchar_t* path = _get_root_wpath(target);
+
+    if (!path)
+    {
+        return NULL;
+    }
+
+    const wchar_t* src = path;
+
+    if (wcsncmp(path, L"\\\\?\\UNC\\", 8) == 0)
+    {
+        path[6] = L'\\';    // \\?\UNC\server -> \\server
+        src     = path + 6;
+    }
+    else if (wcsncmp(path, L"\\\\?\\", 4) == 0)
+    {
+        src = path + 4;
+    }
+
+    memmove(path, src, (wcslen(src) + 1) * sizeof(wchar_t));
+    _trim_separator(path);
+
+    return path;
+}
+
+/*
+    Returns the part of path below base ("" for base itself), or NULL if
+    path is neither. Case-insensitive.
+*/
+static const wchar_t* _path_below(const wchar_t* base, const wchar_t* path)
+{
+    size_t base_count = wcslen(base);
+
+    if (!base_count)
+    {
+        return path;
+    }
+
+    if (wcslen(path) < base_count ||
+        CompareStringOrdinal(base, (int)base_count, path, (int)base_count, TRUE) != CSTR_EQUAL)
+    {
+        return NULL;
+    }
+
+    if (!path[base_count] || base[base_count - 1] == L'\\')
+    {
+        return path + base_count;
+    }
+
+    return path[base_count] == L'\\' ? path + base_count + 1 : NULL;
+}
+
+/*
+    Lifts the exclusions at or below rel_path (relative to the root).
+    Fails if an exclusion above rel_path would still hide it.
+*/
+static bool _include_path(_dirwatcher_target_impl_t* target, const wchar_t* rel_path)
+{
+    bool success = true;
+
+    AcquireSRWLockExclusive(&target->paths_lock);
+
+    for (uint32_t i = 0; i < target->excluded_count; i++)
+    {
+        const wchar_t* below = _path_below(target->excluded[i], rel_path);
+
+        if (below && *below)
+        {
+            success = false;
+            break;
+        }
+    }
+
+    for (uint32_t i = 0; success && i < target->excluded_count; )
+    {
+        if (_path_below(rel_path, target->excluded[i]))
+        {
+            free(target->excluded[i]);
+            target->excluded[i] = target->excluded[--target->excluded_count];
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    ReleaseSRWLockExclusive(&target->paths_lock);
+
+    return success;
+}
+
+/*
+    Stops reporting rel_path (relative to the root, not the root itself) and everything below it.
+*/
+static bool _exclude_path(_dirwatcher_target_impl_t* target, const wchar_t* rel_path)
+{
+    bool success = true;
+
+    AcquireSRWLockExclusive(&target->paths_lock);
+
+    for (uint32_t i = 0; i < target->excluded_count; i++)
+    {
+        if (_path_below(target->excluded[i], rel_path))
+        {
+            //
+            // Already covered
+            //
+
+            ReleaseSRWLockExclusive(&target->paths_lock);
+            return true;
+        }
+    }
+
+    wchar_t** excluded = realloc(target->excluded, (target->excluded_count + 1) * sizeof(wchar_t*));
+    wchar_t*  copy     = _wcsdup(rel_path);
+
+    if (excluded)
+    {
+        target->excluded = excluded;
+    }
+
+    if (!excluded || !copy)
+    {
+        free(copy);
+        success = false;
+    }
+    else
+    {
+        //
+        // Exclusions below the new one are subsumed by it
+        //
+
+        for (uint32_t i = 0; i < target->excluded_count; )
+        {
+            if (_path_below(rel_path, target->excluded[i]))
+            {
+                free(target->excluded[i]);
+                target->excluded[i] = target->excluded[--target->excluded_count];
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        target->excluded[target->excluded_count++] = copy;
+    }
+
+    ReleaseSRWLockExclusive(&target->paths_lock);
+
+    return success;
+}
+
+/*
+    Moves an extra directory to the retired list; the worker cancels its read. Caller holds paths_lock.
+*/
+static void _retire_subpath(_dirwatcher_target_impl_t* target, uint32_t index)
+{
+    _dirwatcher_subpath_t* subpath = target->subpaths[index];
+
+    target->subpaths[index] = target->subpaths[--target->subpath_count];
+
+    InterlockedExchange(&subpath->retired, 1);
+    subpath->next            = target->retired_subpaths;
+    target->retired_subpaths = subpath;
+}
+
+/*
+    Returns whether full_path lies at or below an extra directory. Caller holds paths_lock.
+*/
+static bool _is_subpath_covered(_dirwatcher_target_impl_t* target, const wchar_t* full_path)
+{
+    for (uint32_t i = 0; i < target->subpath_count; i++)
+    {
+        if (_path_below(target->subpaths[i]->full_path, full_path))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+    Watches full_path, outside the root, as an extra directory. A path at or
+    below an extra directory is already covered; extra directories below
+    full_path are replaced by it. An ancestor of root_path is refused: its
+    watch would deliver every change of the root a second time.
+*/
+static bool _add_subpath(_dirwatcher_target_impl_t* target, const wchar_t* root_path, const wchar_t* full_path)
+{
+    if (_path_below(full_path, root_path))
+    {
+        return false;
+    }
+
+    AcquireSRWLockShared(&target->paths_lock);
+
+    bool covered = _is_subpath_covered(target, full_path);
+
+    ReleaseSRWLockShared(&target->paths_lock);
+
+    if (covered)
+    {
+        return true;
+    }
+
+    //
+    // Opened without paths_lock, which the worker takes on every read;
+    // opening a remote directory may take long
+    //
+
+    _dirwatcher_subpath_t* subpath = _create_subpath(full_path, _get_notify_filter(target));
+
+    if (!subpath)
+    {
+        return false;
+    }
+
+    AcquireSRWLockExclusive(&target->paths_lock);
+
+    //
+    // Another call may have covered the path meanwhile
+    //
+
+    covered = _is_subpath_covered(target, full_path);
+
+    for (uint32_t i = 0; !covered && i < target->subpath_count; )
+    {
+        if (_path_below(full_path, target->subpaths[i]->full_path))
+        {
+            _retire_subpath(target, i);
+        }
+        else
+        {
+            i++;
+        }
+    }
+
+    bool added = !covered && target->subpath_count < DIRWATCHER_MAX_TARGET_PATHS;
+
+    if (added)
+    {
+        target->subpaths[target->subpath_count++] = subpath;
+    }
+
+    ReleaseSRWLockExclusive(&target->paths_lock);
+
+    if (!added)
+    {
+        _destroy_subpath(subpath);
+        return covered;
+    }
+
+    //
+    // Have the worker wait on the new read and cancel the retired ones
+    //
+
+    SetEvent(target->paths_event);
+
+    return true;
+}
+
+static bool _remove_subpath(_dirwatcher_target_impl_t* target, const wchar_t* full_path)
+{
+    bool found = false;
+
+    AcquireSRWLockExclusive(&target->paths_lock);
+
+    for (uint32_t i = 0; i < target->subpath_count; i++)
+    {
+        if (CompareStringOrdinal(target->subpaths[i]->full_path, -1, full_path, -1, TRUE) == CSTR_EQUAL)
+        {
+            _retire_subpath(target, i);
+            found = true;
+            break;
+        }
+    }
+
+    ReleaseSRWLockExclusive(&target->paths_lock);
+
+    if (found)
+    {
+        SetEvent(target->paths_event);
+    }
+
+    return found;
+}
+
+static HANDLE _create_worker_thread(_dirwatcher_target_impl_t* target)
+{
+    return CreateThread(NULL,
+                        0,
+                        _worker_thread_routine,
+                        target,
+                        0,
+                        NULL);
+}
+
+static HANDLE _open_target_dir(const char* name)
+{
+    HANDLE h = CreateFileA(name,
+                           FILE_LIST_DIRECTORY,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                           NULL,
+                           OPEN_EXISTING,
+                           FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                           NULL);
+
+    return h != INVALID_HANDLE_VALUE ? h : NULL;
+}
+
+static HANDLE _create_working_event(void)
+{
+    return CreateEventW(NULL, TRUE, FALSE, NULL);
+}
+
+static bool _is_valid_target_ptr(_dirwatcher_target_impl_t* target)
+{
+    return ((target) && (target->magic == DIRWATCHER_TARGET_MAGIC_NUMBER));
+}
+
+static _dirwatcher_target_impl_t* _create_target(const char* name, dirwatcher_backend_t backend, _dirwatcher_synthetic_t* synthetic /* NULLABLE, owned on success */)
+{
+    _dirwatcher_target_impl_t* target = calloc(1, sizeof(_dirwatcher_target_impl_t));
+
+    if (!target)
+    {
+        return NULL;
+    }
+
+    target->root_handle = _open_target_dir(name);
+    
+    if (!target->root_handle)
+    {
+        free(target);
+        return NULL;
+    }
+
+    target->dir_handle = _reopen_target_dir(target->root_handle);
+
+    if (!target->dir_handle)
+    {
+        CloseHandle(target->root_handle);
+        free(target);
+        return NULL;
+    }
+
+    target->read_changes_ex = (_read_directory_changes_ex_t)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "ReadDirectoryChangesExW");
+
+    target->backend           = backend;
+    target->synthetic         = synthetic;
+    target->polling           = backend == DIRWATCHER_BACKEND_POLLING;
+    target->poll_min_interval = DIRWATCHER_POLL_DEFAULT_MIN_INTERVAL;
+    target->poll_max_interval = DIRWATCHER_POLL_DEFAULT_MAX_INTERVAL;
+    target->event_mask        = DIRWATCHER_EVENT_MASK_DEFAULT;
+    target->notify_filter     = _get_notify_filter(target);
+
+    target->worker_control_event = _create_working_event();
+
+if (!target->worker_control_event)
+{
+    CloseHandle(target->dir_handle);
+    CloseHandle(target->root_handle);
+    free(target);
+    return NULL;
+}
+
+target->worker_wake_event = CreateEventW(NULL, FALSE, FALSE, NULL);
+target->read_event        = CreateEventW(NULL, TRUE, FALSE, NULL);
+target->probe_event       = CreateEventW(NULL, FALSE, FALSE, NULL);
+target->paths_event       = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+if (!target->worker_wake_event || !target->read_event || !target->probe_event || !target->paths_event)
+{
+    CloseHandle(target->dir_handle);
+    CloseHandle(target->root_handle);
+    CloseHandle(target->worker_control_event);
+    if (target->worker_wake_event) CloseHandle(target->worker_wake_event);
+    if (target->read_event) CloseHandle(target->read_event);
+    if (target->probe_event) CloseHandle(target->probe_event);
+    if (target->paths_event) CloseHandle(target->paths_event);
+    free(target);
+    return NULL;
+}
+
+target->worker_thread_handle = _create_worker_thread(target);
+
+if (!target->worker_thread_handle)
+{
+    CloseHandle(target->dir_handle);
+    CloseHandle(target->root_handle);
+    CloseHandle(target->worker_control_event);
+    CloseHandle(target->worker_wake_event);
+    CloseHandle(target->read_event);
+    CloseHandle(target->probe_event);
+    CloseHandle(target->paths_event);
+    free(target);
+    return NULL;
+}
+
+target->magic = DIRWATCHER_TARGET_MAGIC_NUMBER;
+target->exit_flag = 0;
+target->error_code = 0;
+target->callback = NULL;
+target->callback_user_data = NULL;
+
+InitializeSRWLock(&target->callback_lock);
+InitializeSRWLock(&target->sink_lock);
+InitializeSRWLock(&target->probe_lock);
+InitializeSRWLock(&target->index_lock);
+InitializeSRWLock(&target->paths_lock);
+InitializeSRWLock(&target->dir_lock);
+
+//
+// Targets reading native notifications take a place in the watch budget;
+// only those opened with DIRWATCHER_BACKEND_AUTO may be moved to polling.
+// One that starts out polling is demoted by the budget itself
+//
+
+if (!synthetic && backend != DIRWATCHER_BACKEND_POLLING)
+{
+    _dirwatcher_budget_register(&target->budget_entry, _demote_target, target, backend == DIRWATCHER_BACKEND_AUTO);
+}
+
+return target;
+}
+
+static void _delete_target(_dirwatcher_target_impl_t* target)
+{
+    //
+    // Leave the watch budget first so it no longer calls back into the target
+    //
+
+    _dirwatcher_budget_unregister(&target->budget_entry);
+
+    //
+    // Stop worker and set exit flag
+    //
+
+    ResetEvent(target->worker_control_event);
+
+    InterlockedExchange(&target->exit_flag, 1);
+
+    //
+    // Cancle `ReadDirectoryChangesW`, or cut a poll pass and interval short
+    //
+
+    _cancel_dir_read(target);
+
+    InterlockedExchange(&target->interrupt_flag, 1);
+    SetEvent(target->worker_wake_event);
+
+    //
+    // Resume worker and wait for it ends
+    //
+
+    SetEvent(target->worker_control_event);
+
+    WaitForSingleObject(target->worker_thread_handle, INFINITE);
+
+    //
+    // Cleanup resources; reads still pending write into the target until they end
+    //
+
+    _cancel_root_read(target);
+
+    for (uint32_t i = 0; i < target->subpath_count; i++)
+    {
+        _destroy_subpath(target->subpaths[i]);
+    }
+
+    _destroy_retired_subpaths(target);
+
+    for (uint32_t i = 0; i < target->excluded_count; i++)
+    {
+        free(target->excluded[i]);
+    }
+
+    free(target->excluded);
+
+    if (target->dir_handle)
+    {
+        CloseHandle(target->dir_handle);
+    }
+
+    CloseHandle(target->root_handle);
+    CloseHandle(target->worker_thread_handle);
+    CloseHandle(target->worker_control_event);
+    CloseHandle(target->worker_wake_event);
+    CloseHandle(target->read_event);
+    CloseHandle(target->probe_event);
+    CloseHandle(target->paths_event);
+
+    _dirwatcher_poller_destroy(target->poller);
+    _dirwatcher_synthetic_destroy(target->synthetic);
+    _dirwatcher_shm_destroy_publisher(target->publisher);
+    _dirwatcher_journal_close(target->journal);
+    _dirwatcher_change_index_destroy(target->change_index);
+    _dirwatcher_ignore_destroy(target->ignore);
+    _dirwatcher_write_tracker_destroy(target->write_tracker);
+
+    //
+    // Initialize magic for safe
+    //
+
+    target->magic = 0;
+
+    free(target);
+}
+
+static void _pause_target(_dirwatcher_target_impl_t* target)
+{
+    ResetEvent(target->worker_control_event);
+    _cancel_dir_read(target);
+
+    InterlockedExchange(&target->interrupt_flag, 1);
+    SetEvent(target->worker_wake_event);
+}
+
+static void _resume_target(_dirwatcher_target_impl_t* target)
+{
+    SetEvent(target->worker_control_event);
+}
+
+static bool _create_probe_file(const wchar_t* path)
+{
+    HANDLE h = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY, NULL);
+
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    CloseHandle(h);
+    return true;
+}
+
+/*
+    Creates (from NULL), renames or deletes (to NULL) the probe file and waits
+    for the worker to dispatch the wanted event.
+    *p_latency_us receives the latency, or UINT64_MAX if the probe was lost.
+    Returns false if the file operation fails.
+*/
+static bool _run_probe(_dirwatcher_target_impl_t* target,
+                       dirwatcher_event_t         wanted,
+                       const wchar_t*             from /* NULLABLE */,
+                       const wchar_t*             to   /* NULLABLE */,
+                       uint64_t*                  p_latency_us)
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER start;
+    bool          done;
+
+    QueryPerformanceFrequency(&frequency);
+
+    InterlockedExchange(&target->probe_wanted, (LONG)wanted);
+
+    QueryPerformanceCounter(&start);
+    InterlockedExchange64(&target->probe_ticks, start.QuadPart);
+
+    if (!from)
+    {
+        done = _create_probe_file(to);
+    }
+    else if (!to)
+    {
+        done = DeleteFileW(from) != FALSE;
+    }
+    else
+    {
+        done = MoveFileExW(from, to, 0) != FALSE;
+    }
+
+    if (!done)
+    {
+        InterlockedExchange64(&target->probe_ticks, 0);
+        return false;
+    }
+
+    if (WaitForSingleObject(target->probe_event, DIRWATCHER_PROBE_TIMEOUT) != WAIT_OBJECT_0)
+    {
+        if (InterlockedExchange64(&target->probe_ticks, 0))
+        {
+            *p_latency_us = UINT64_MAX;
+            return true;
+        }
+
+        //
+        // Dispatched right after the timeout
+        //
+
+        WaitForSingleObject(target->probe_event, INFINITE);
+    }
+
+    *p_latency_us = (uint64_t)InterlockedCompareExchange64(&target->probe_latency, 0, 0) * 1000000 / (uint64_t)frequency.QuadPart;
+    return true;
+}
+
+static void _record_latency(dirwatcher_latency_histogram_t* histogram, uint64_t latency_us)
+{
+    int bucket = 0;
+
+    if (latency_us == UINT64_MAX)
+    {
+        histogram->lost++;
+        return;
+    }
+
+    while (bucket + 1 < DIRWATCHER_LATENCY_BUCKETS && latency_us >> (bucket + 1))
+    {
+        bucket++;
+    }
+
+    histogram->min_us = histogram->count ? min(histogram->min_us, latency_us) : latency_us;
+    histogram->max_us = histogram->count ? max(histogram->max_us, latency_us) : latency_us;
+    histogram->count++;
+    histogram->buckets[bucket]++;
+}
+
+/* Public functions ***********************************/
+
+dirwatcher_target_t dirwatcher_open_target(const char* name)
+{
+    return dirwatcher_open_target_with_backend(name, DIRWATCHER_BACKEND_AUTO);
+}
+
+dirwatcher_target_t dirwatcher_open_target_with_backend(const char* name, dirwatcher_backend_t backend)
+{
+    DWORD attr = GetFileAttributesA(name);
+
+    if (!name ||
+        attr == INVALID_FILE_ATTRIBUTES ||
+        !(attr & FILE_ATTRIBUTE_DIRECTORY) ||
+        backend < DIRWATCHER_BACKEND_AUTO ||
+        backend > DIRWATCHER_BACKEND_SYNTHETIC)
+    {
+        return NULL;
+    }
+
+    if (backend == DIRWATCHER_BACKEND_SYNTHETIC)
+    {
+        return dirwatcher_open_synthetic_target(name, NULL);
+    }
+
+    return (dirwatcher_target_t)_create_target(name, backend, NULL);
+}
+
+dirwatcher_target_t dirwatcher_open_synthetic_target(const char* name, const dirwatcher_synthetic_config_t* config /* NULLABLE */)
+{
+    DWORD attr = GetFileAttributesA(name);
+
+    if (!name ||
+        attr == INVALID_FILE_ATTRIBUTES ||
+        !(attr & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        return NULL;
+    }
+
+    _dirwatcher_synthetic_t*   synthetic = _dirwatcher_synthetic_create(config);
+    _dirwatcher_target_impl_t* target    = synthetic ? _create_target(name, DIRWATCHER_BACKEND_SYNTHETIC, synthetic) : NULL;
+
+    if (!target)
+    {
+        _dirwatcher_synthetic_destroy(synthetic);
+    }
+
+    return (dirwatcher_target_t)target;
+}
+
+dirwatcher_backend_t dirwatcher_get_target_backend(dirwatcher_target_t target)
+{
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target))
+    {
+        return DIRWATCHER_BACKEND_INVALID;
+    }
+
+    _dirwatcher_target_impl_t* target_impl = target;
+
+    if (target_impl->synthetic)
+    {
+        return DIRWATCHER_BACKEND_SYNTHETIC;
+    }
+
+    return InterlockedCompareExchange(&target_impl->polling, 0, 0) ||
+           InterlockedCompareExchange(&target_impl->demoted, 0, 0)
+               ? DIRWATCHER_BACKEND_POLLING
+               : DIRWATCHER_BACKEND_NATIVE;
+}
+
+bool dirwatcher_set_target_poll_interval(dirwatcher_target_t target, uint32_t min_interval_ms, uint32_t max_interval_ms)
+{
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target) ||
+        !min_interval_ms ||
+        min_interval_ms > max_interval_ms ||
+        (LONG)max_interval_ms < 0)
+    {
+        return false;
+    }
+
+    _dirwatcher_target_impl_t* target_impl = target;
+
+    InterlockedExchange(&target_impl->poll_min_interval, (LONG)min_interval_ms);
+    InterlockedExchange(&target_impl->poll_max_interval, (LONG)max_interval_ms);
+
+    return true;
+}
+
+bool dirwatcher_set_watch_budget(uint32_t max_native_targets, uint32_t cold_interval_ms)
+{
+    if ((LONG)cold_interval_ms < 0)
+    {
+        return false;
+    }
+
+    _dirwatcher_budget_set(max_native_targets, cold_interval_ms ? cold_interval_ms : DIRWATCHER_POLL_DEFAULT_COLD_INTERVAL);
+    return true;
+}
+
+void dirwatcher_get_watch_budget_usage(uint32_t* native_targets, uint32_t* max_native_targets)
+{
+    uint32_t native     = 0;
+    uint32_t max_native = 0;
+
+    _dirwatcher_budget_get_usage(&native, &max_native);
+
+    if (native_targets)
+    {
+        *native_targets = native;
+    }
+
+    if (max_native_targets)
+    {
+        *max_native_targets = max_native;
+    }
+}
+
+bool dirwatcher_get_target_watch_stats(dirwatcher_target_t target, dirwatcher_watch_stats_t* stats)
+{
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target) || !stats)
+    {
+        return false;
+    }
+
+    _dirwatcher_target_impl_t* target_impl = target;
+
+    bool native = !target_impl->synthetic &&
+                  !InterlockedCompareExchange(&target_impl->polling, 0, 0) &&
+                  !InterlockedCompareExchange(&target_impl->demoted, 0, 0);
+
+    stats->native_watches     = native ? 1 : 0;
+    stats->polled_directories = native ? 0 : (uint32_t)InterlockedCompareExchange(&target_impl->polled_directories, 0, 0);
+    stats->demotions          = (uint64_t)InterlockedCompareExchange64(&target_impl->demotions, 0, 0);
+    stats->promotions         = (uint64_t)InterlockedCompareExchange64(&target_impl->promotions, 0, 0);
+
+    return true;
+}
+
+bool dirwatcher_set_target_low_latency(dirwatcher_target_t target, const dirwatcher_low_latency_config_t* config /* NULLABLE */)
+{
+    dirwatcher_low_latency_config_t defaults = { -1, false, 0 };
+    DWORD_PTR                       process_mask;
+    DWORD_PTR                       system_mask;
+
+    if (!config)
+    {
+        config = &defaults;
+    }
+
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target) ||
+        config->cpu < -1 ||
+        config->cpu >= (int32_t)(sizeof(DWORD_PTR) * 8) ||
+        config->spin_us > DIRWATCHER_LOW_LATENCY_MAX_SPIN ||
+        !GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+    {
+        return false;
+    }
+
+    _dirwatcher_target_impl_t* target_impl = target;
+    DWORD_PTR                  mask        = config->cpu >= 0 ? (DWORD_PTR)1 << config->cpu : process_mask;
+
+    if (!(mask & process_mask) ||
+        !SetThreadAffinityMask(target_impl->worker_thread_handle, mask) ||
+        !SetThreadPriority(target_impl->worker_thread_handle, config->time_critical ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_NORMAL))
+    {
+        return false;
+    }
+
+    InterlockedExchange(&target_impl->spin_us, (LONG)config->spin_us);
+
+    return true;
+}
+
+bool dirwatcher_probe_target_latency(dirwatcher_target_t target, uint32_t count, dirwatcher_latency_histogram_t* histogram)
+{
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target) || !histogram ||
+        InterlockedCompareExchange(&((_dirwatcher_target_impl_t*)target)->error_code, 0, 0) != ERROR_SUCCESS)
+    {
+        return false;
+    }
+
+    _dirwatcher_target_impl_t* target_impl = target;
+    wchar_t*                   root_path   = _get_root_wpath(target_impl);
+    size_t                     cch_path    = root_path ? wcslen(root_path) + 64 : 0;
+    wchar_t*                   paths[2]    = { NULL, NULL };
+    uint64_t                   latency_us  = 0;
+    bool                       success     = false;
+
+    if (root_path)
+    {
+        paths[0] = malloc(cch_path * sizeof(wchar_t));
+        paths[1] = malloc(cch_path * sizeof(wchar_t));
+    }
+
+    if (!paths[0] || !paths[1] ||
+        FAILED(StringCchPrintfW(paths[0], cch_path, L"%s\\" DIRWATCHER_PROBE_PREFIX L"%lu-a", root_path, GetCurrentProcessId())) ||
+        FAILED(StringCchPrintfW(paths[1], cch_path, L"%s\\" DIRWATCHER_PROBE_PREFIX L"%lu-b", root_path, GetCurrentProcessId())))
+    {
+        free(paths[0]);
+        free(paths[1]);
+        free(root_path);
+        return false;
+    }
+
+    AcquireSRWLockExclusive(&target_impl->probe_lock);
+    InterlockedExchange(&target_impl->probe_active, 1);
+
+    //
+    // Only the renames are measured; creating and deleting the probe file
+    // are waited for so that their events are not mistaken for a rename's
+    //
+
+    success = _run_probe(target_impl, DIRWATCHER_EVENT_ADDED, NULL, paths[0], &latency_us);
+
+    for (uint32_t i = 0; success && i < count; i++)
+    {
+        success = _run_probe(target_impl, DIRWATCHER_EVENT_RENAMED, paths[i % 2], paths[(i + 1) % 2], &latency_us);
+
+        if (success)
+        {
+            _record_latency(histogram, latency_us);
+        }
+    }
+
+    if (success)
+    {
+        success = _run_probe(target_impl, DIRWATCHER_EVENT_REMOVED, paths[count % 2], NULL, &latency_us);
+    }
+    else
+    {
+        DeleteFileW(paths[0]);
+        DeleteFileW(paths[1]);
+    }
+
+    InterlockedExchange(&target_impl->probe_active, 0);
+    ReleaseSRWLockExclusive(&target_impl->probe_lock);
+
+    free(paths[0]);
+    free(paths[1]);
+    free(root_path);
+
+    return success;
+}
 
-            //
-            // Call callback function
-            //
+uint64_t dirwatcher_get_latency_percentile(const dirwatcher_latency_histogram_t* histogram, double percentile)
+{
+    if (!histogram || !histogram->count)
+    {
+        return 0;
+    }
 
-            for (int i = 0; i < events_count; i++)
-            {
-                if (cb)
-                {
-                    events[i].target = target;
-                    cb(&events[i], cb_user_data);
-                }
-            }
+    uint64_t rank = (uint64_t)(min(max(percentile, 0.0), 100.0) / 100.0 * (double)histogram->count + 0.5);
+    uint64_t seen = 0;
 
-            //
-            // Cleanup events
-            //
+    for (int bucket = 0; bucket < DIRWATCHER_LATENCY_BUCKETS; bucket++)
+    {
+        seen += histogram->buckets[bucket];
 
-            _cleanup_events(events, events_count);
-        }
-        else
+        if (seen >= max(rank, 1))
         {
-            DWORD last_error = GetLastError();
-
-            if (last_error == ERROR_OPERATION_ABORTED)
-            {
-                continue;
-            }
-            else
-            {
-                InterlockedExchange(&target->error_code, last_error);
-                InterlockedExchange(&target->exit_flag, 1);
-                if (cb) cb(NULL, cb_user_data);
-                return (DWORD)-1;
-            }
+            return min(((uint64_t)2 << bucket) - 1, histogram->max_us);
         }
     }
-}
 
-static HANDLE _create_worker_thread(_dirwatcher_target_impl_t* target)
-{
-    return CreateThread(NULL,
-                        0,
-                        _worker_thread_routine,
-                        target,
-                        0,
-                        NULL);
+    return histogram->max_us;
 }
 
-static HANDLE _open_target_dir(const char* name)
+bool dirwatcher_set_target_ignore_files(dirwatcher_target_t target, bool enable)
 {
-    HANDLE h = CreateFileA(name,
-                           FILE_LIST_DIRECTORY,
-                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
-                           NULL,
-                           OPEN_EXISTING,
-                           FILE_FLAG_BACKUP_SEMANTICS,
-                           NULL);
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target))
+    {
+        return false;
+    }
 
-    return h != INVALID_HANDLE_VALUE ? h : NULL;
-}
+    _dirwatcher_target_impl_t* target_impl = target;
 
-static HANDLE _create_working_event(void)
-{
-    return CreateEventW(NULL, TRUE, FALSE, NULL);
-}
+    //
+    // The worker picks the setting up before it matches its next batch
+    //
 
-static bool _is_valid_target_ptr(_dirwatcher_target_impl_t* target)
-{
-    return ((target) && (target->magic == DIRWATCHER_TARGET_MAGIC_NUMBER));
+    InterlockedExchange(&target_impl->ignore_files, enable ? 1 : 0);
+
+    return true;
 }
 
-static _dirwatcher_target_impl_t* _create_target(const char* name)
+bool dirwatcher_add_target_path(dirwatcher_target_t target, const char* path)
 {
-    _dirwatcher_target_impl_t* target = calloc(1, sizeof(_dirwatcher_target_impl_t));
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target) || !path)
+    {
+        return false;
+    }
 
-    if (!target)
+    _dirwatcher_target_impl_t* target_impl = target;
+
+    if (target_impl->synthetic)
     {
-        return NULL;
+        return false;
     }
 
-    target->dir_handle = _open_target_dir(name);
-    
-    if (!target->dir_handle)
+    wchar_t* root_path = _get_root_full_wpath(target_impl);
+    wchar_t* full_path = _get_full_wpath(path);
+    bool     success   = false;
+
+    if (root_path && full_path)
     {
-        free(target);
-        return NULL;
+        const wchar_t* rel_path = _path_below(root_path, full_path);
+
+        success = rel_path ? _include_path(target_impl, rel_path) : _add_subpath(target_impl, root_path, full_path);
     }
 
-    target->worker_control_event = _create_working_event();
+    free(root_path);
+    free(full_path);
 
-if (!target->worker_control_event)
-{
-    CloseHandle(target->dir_handle);
-    free(target);
-    return NULL;
+    return success;
 }
 
-target->worker_thread_handle = _create_worker_thread(target);
-
-if (!target->worker_thread_handle)
+bool dirwatcher_remove_target_path(dirwatcher_target_t target, const char* path)
 {
-    CloseHandle(target->dir_handle);
-    CloseHandle(target->worker_control_event);
-    free(target);
-    return NULL;
-}
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target) || !path)
+    {
+        return false;
+    }
 
-target->magic = DIRWATCHER_TARGET_MAGIC_NUMBER;
-target->exit_flag = 0;
-target->error_code = 0;
-target->callback = NULL;
-target->callback_user_data = NULL;
+    _dirwatcher_target_impl_t* target_impl = target;
 
-InitializeSRWLock(&target->callback_lock);
+    if (target_impl->synthetic)
+    {
+        return false;
+    }
 
-return target;
+    wchar_t* root_path = _get_root_full_wpath(target_impl);
+    wchar_t* full_path = _get_full_wpath(path);
+    bool     success   = false;
+
+    if (root_path && full_path)
+    {
+        const wchar_t* rel_path = _path_below(root_path, full_path);
+
+        success = rel_path ? *rel_path && _exclude_path(target_impl, rel_path) : _remove_subpath(target_impl, full_path);
+    }
+
+    free(root_path);
+    free(full_path);
+
+    return success;
 }
 
-static void _delete_target(_dirwatcher_target_impl_t* target)
+bool dirwatcher_set_target_event_mask(dirwatcher_target_t target, uint32_t mask)
 {
-    //
-    // Stop worker and set exit flag
-    //
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target) ||
+        !(mask & DIRWATCHER_EVENT_MASK_ALL & ~DIRWATCHER_EVENT_MASK(DIRWATCHER_EVENT_NULL)))
+    {
+        return false;
+    }
 
-    ResetEvent(target->worker_control_event);
+    _dirwatcher_target_impl_t* target_impl = target;
 
-    InterlockedExchange(&target->exit_flag, 1);
+    InterlockedExchange(&target_impl->event_mask, (LONG)(mask & DIRWATCHER_EVENT_MASK_ALL));
 
     //
-    // Cancle `ReadDirectoryChangesW`
+    // Wake the worker, which reopens the directory handles if the notify filter changed
     //
 
-    CancelIoEx(target->dir_handle, NULL);
+    _cancel_dir_read(target_impl);
 
-    //
-    // Resume worker and wait for it ends
-    //
+    return true;
+}
 
-    SetEvent(target->worker_control_event);
+bool dirwatcher_set_target_change_index(dirwatcher_target_t target, uint32_t max_paths)
+{
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target))
+    {
+        return false;
+    }
 
-    WaitForSingleObject(target->worker_thread_handle, INFINITE);
+    _dirwatcher_target_impl_t*  target_impl = target;
+    _dirwatcher_change_index_t* index       = NULL;
 
-    //
-    // Cleanup resources
-    //
+    if (max_paths)
+    {
+        //
+        // A tag per index, so that tokens of another target or an earlier run are refused
+        //
 
-    CloseHandle(target->dir_handle);
-    CloseHandle(target->worker_thread_handle);
-    CloseHandle(target->worker_control_event);
+        LARGE_INTEGER now;
 
-    //
-    // Initialize magic for safe
-    //
+        QueryPerformanceCounter(&now);
 
-    target->magic = 0;
+        uint32_t tag = ((uint32_t)InterlockedIncrement(&_change_tag_counter) * 0x9E3779B1u) ^
+                       (GetCurrentProcessId() * 0x85EBCA6Bu) ^
+                       (uint32_t)now.QuadPart;
 
-    free(target);
+        index = _dirwatcher_change_index_create(max_paths, (tag & 0xFFFFFF) ? tag : 1);
+
+        if (!index)
+        {
+            return false;
+        }
+    }
+
+    AcquireSRWLockExclusive(&target_impl->index_lock);
+
+    _dirwatcher_change_index_t* old_index = target_impl->change_index;
+    target_impl->change_index = index;
+
+    ReleaseSRWLockExclusive(&target_impl->index_lock);
+
+    _dirwatcher_change_index_destroy(old_index);
+
+    return true;
 }
 
-static void _pause_target(_dirwatcher_target_impl_t* target)
+uint64_t dirwatcher_get_target_change_token(dirwatcher_target_t target)
 {
-    ResetEvent(target->worker_control_event);
-    CancelIoEx(target->dir_handle, NULL);
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target))
+    {
+        return 0;
+    }
+
+    _dirwatcher_target_impl_t* target_impl = target;
+    uint64_t                   token       = 0;
+
+    AcquireSRWLockShared(&target_impl->index_lock);
+
+    if (target_impl->change_index)
+    {
+        token = _dirwatcher_change_index_token(target_impl->change_index);
+    }
+
+    ReleaseSRWLockShared(&target_impl->index_lock);
+
+    return token;
 }
 
-static void _resume_target(_dirwatcher_target_impl_t* target)
+dirwatcher_changes_result_t dirwatcher_changes_since(dirwatcher_target_t        target,
+                                                     uint64_t                   token,
+                                                     dirwatcher_path_callback_t callback,
+                                                     void*                      user_data,
+                                                     uint64_t*                  new_token /* NULLABLE */)
 {
-    SetEvent(target->worker_control_event);
-}
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target) || !callback)
+    {
+        return DIRWATCHER_CHANGES_INVALID;
+    }
 
-/* Public functions ***********************************/
+    _dirwatcher_target_impl_t*  target_impl = target;
+    dirwatcher_changes_result_t result      = DIRWATCHER_CHANGES_INVALID;
+    uint64_t                    next_token  = 0;
 
-dirwatcher_target_t dirwatcher_open_target(const char* name)
-{
-    DWORD attr = GetFileAttributesA(name);
+    //
+    // Shared: queries only read the index, and the worker waits for them
+    //
 
-    if (!name ||
-        attr == INVALID_FILE_ATTRIBUTES ||
-        !(attr & FILE_ATTRIBUTE_DIRECTORY))
+    AcquireSRWLockShared(&target_impl->index_lock);
+
+    if (target_impl->change_index)
     {
-        return NULL;
+        result = _dirwatcher_change_index_since(target_impl->change_index, token, callback, user_data, &next_token);
+    }
+
+    ReleaseSRWLockShared(&target_impl->index_lock);
+
+    if (new_token && result != DIRWATCHER_CHANGES_INVALID)
+    {
+        *new_token = next_token;
     }
 
-    return (dirwatcher_target_t)_create_target(name);
+    return result;
 }
 
 bool dirwatcher_close_target(dirwatcher_target_t target)
@@ -500,6 +3256,16 @@ long dirwatcher_get_target_win32_error(dirwatcher_target_t target)
     return ((_dirwatcher_target_impl_t*)target)->error_code;
 }
 
+long dirwatcher_get_target_journal_win32_error(dirwatcher_target_t target)
+{
+    if (!_is_valid_target_ptr(target))
+    {
+        return DIRWATCHER_INVALID_TARGET;
+    }
+
+    return InterlockedCompareExchange(&((_dirwatcher_target_impl_t*)target)->journal_error, 0, 0);
+}
+
 size_t dirwatcher_get_full_path_from_target(dirwatcher_target_t target, const char* path, char* buf, size_t buf_len)
 {
     if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target))
@@ -510,7 +3276,7 @@ size_t dirwatcher_get_full_path_from_target(dirwatcher_target_t target, const ch
     wchar_t* wbuffer       = NULL;
     size_t   cb_wbuffer    = 0;
     int      cch_wbuffer   = 0;
-    HANDLE   handle        = ((_dirwatcher_target_impl_t*)target)->dir_handle;
+    HANDLE   handle        = ((_dirwatcher_target_impl_t*)target)->root_handle;
     wchar_t* w_rel_path    = NULL;
     size_t   cb_w_rel_path = 0;
 
@@ -603,3 +3369,101 @@ size_t dirwatcher_get_full_path_from_event_info(const dirwatcher_event_info_t* e
     if (!event_info) return 0;
     return dirwatcher_get_full_path_from_target(event_info->target, event_info->name, buf, buf_len);
 }
+
+static char* _get_root_path(dirwatcher_target_t target)
+{
+    size_t root_len  = dirwatcher_get_full_path_from_target(target, "", NULL, 0);
+    char*  root_path = root_len ? malloc(root_len) : NULL;
+
+    if (root_path)
+    {
+        dirwatcher_get_full_path_from_target(target, "", root_path, root_len);
+    }
+
+    return root_path;
+}
+
+bool dirwatcher_publish_target(dirwatcher_target_t target, const char* name /* NULLABLE */, uint32_t capacity)
+{
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target))
+    {
+        return false;
+    }
+
+    _dirwatcher_target_impl_t*   target_impl   = target;
+    _dirwatcher_shm_publisher_t* new_publisher = NULL;
+    _dirwatcher_shm_publisher_t* old_publisher = NULL;
+
+    if (name)
+    {
+        //
+        // Readers get the root path from the ring header
+        //
+
+        char* root_path = _get_root_path(target);
+
+        if (!root_path)
+        {
+            return false;
+        }
+
+        new_publisher = _dirwatcher_shm_create_publisher(name, capacity, root_path);
+
+        free(root_path);
+
+        if (!new_publisher)
+        {
+            return false;
+        }
+    }
+
+    AcquireSRWLockExclusive(&target_impl->sink_lock);
+    old_publisher          = target_impl->publisher;
+    target_impl->publisher = new_publisher;
+    ReleaseSRWLockExclusive(&target_impl->sink_lock);
+
+    _dirwatcher_shm_destroy_publisher(old_publisher);
+
+    return true;
+}
+
+bool dirwatcher_set_target_journal(dirwatcher_target_t target, const char* dir /* NULLABLE */, size_t segment_size)
+{
+    if (!_is_valid_target_ptr((_dirwatcher_target_impl_t*)target))
+    {
+        return false;
+    }
+
+    _dirwatcher_target_impl_t* target_impl = target;
+    _dirwatcher_journal_t*     new_journal = NULL;
+    _dirwatcher_journal_t*     old_journal = NULL;
+
+    if (dir)
+    {
+        char* root_path = _get_root_path(target);
+
+        if (!root_path)
+        {
+            return false;
+        }
+
+        new_journal = _dirwatcher_journal_open(dir, segment_size, root_path);
+
+        free(root_path);
+
+        if (!new_journal)
+        {
+            return false;
+        }
+    }
+
+    AcquireSRWLockExclusive(&target_impl->sink_lock);
+    old_journal          = target_impl->journal;
+    target_impl->journal = new_journal;
+    InterlockedExchange(&target_impl->journal_error, ERROR_SUCCESS);
+    ReleaseSRWLockExclusive(&target_impl->sink_lock);
+
+    _dirwatcher_journal_close(old_journal);
+
+    return true;
+}
@@ -0,0 +1,394 @@
+/* Includes *******************************************/
+
+#include <dirwatcher.h>
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "dirwatcher_write_tracker_win32.h"
+
+/* Defines ********************************************/
+
+#define DIRWATCHER_WRITE_NONE        UINT32_MAX
+#define DIRWATCHER_WRITE_MIN_SLOTS   64
+#define DIRWATCHER_WRITE_PROBE_BATCH 256     // Files opened by one probe; bounds its cost when many files are written at once
+
+/*
+    Slot of the open-addressing table of tracked names. Removed names leave
+    a tombstone so that a probe can drop names while it walks the table.
+
+    A reported file stays for one more probe: closing a file often updates
+    its last write time, and the MODIFIED that follows must not report the
+    same close twice.
+*/
+typedef struct _dirwatcher_write_slot
+{
+    char*    name;              // NULL: empty or tombstone
+    uint32_t hash;
+    bool     tombstone;
+    bool     reported;          // Reported closed and not modified since
+    uint64_t write_time;        // Last write time when last reported, 0 if never
+} _dirwatcher_write_slot_t;
+
+struct _dirwatcher_write_tracker
+{
+    wchar_t*                  root_path;
+    _dirwatcher_write_slot_t* slots;
+    uint32_t                  mask;
+    uint32_t                  count;    // Tracked names
+    uint32_t                  used;     // Tracked names and tombstones
+    uint32_t                  cursor;   // Slot the next probe starts at
+};
+
+/* Private functions **********************************/
+
+static uint32_t _hash_name(const char* name)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+
+    for (const unsigned char* c = (const unsigned char*)name; *c; c++)
+    {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static uint32_t _find(const _dirwatcher_write_tracker_t* tracker, const char* name, uint32_t hash)
+{
+    for (uint32_t i = hash & tracker->mask; ; i = (i + 1) & tracker->mask)
+    {
+        const _dirwatcher_write_slot_t* slot = &tracker->slots[i];
+
+        if (!slot->name && !slot->tombstone)
+        {
+            return DIRWATCHER_WRITE_NONE;
+        }
+
+        if (slot->name && slot->hash == hash && strcmp(slot->name, name) == 0)
+        {
+            return i;
+        }
+    }
+}
+
+/*
+    Moves the tracked names to a table of slot_count slots, dropping tombstones.
+*/
+static bool _rehash(_dirwatcher_write_tracker_t* tracker, uint32_t slot_count)
+{
+    _dirwatcher_write_slot_t* slots = calloc(slot_count, sizeof(_dirwatcher_write_slot_t));
+
+    if (!slots)
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i <= tracker->mask; i++)
+    {
+        if (!tracker->slots[i].name)
+        {
+            continue;
+        }
+
+        uint32_t j = tracker->slots[i].hash & (slot_count - 1);
+
+        while (slots[j].name)
+        {
+            j = (j + 1) & (slot_count - 1);
+        }
+
+        slots[j] = tracker->slots[i];
+    }
+
+    free(tracker->slots);
+
+    tracker->slots  = slots;
+    tracker->mask   = slot_count - 1;
+    tracker->used   = tracker->count;
+    tracker->cursor = 0;
+
+    return true;
+}
+
+static bool _track(_dirwatcher_write_tracker_t* tracker, const char* name)
+{
+    uint32_t hash  = _hash_name(name);
+    uint32_t index = _find(tracker, name, hash);
+
+    if (index != DIRWATCHER_WRITE_NONE)
+    {
+        tracker->slots[index].reported = false;
+        return true;
+    }
+
+    //
+    // Keep at least half of the slots empty, so that lookups end quickly
+    //
+
+    if ((tracker->used + 1) * 2 > tracker->mask + 1)
+    {
+        uint32_t slot_count = tracker->mask + 1;
+
+        while ((tracker->count + 1) * 2 > slot_count / 2)
+        {
+            slot_count *= 2;
+        }
+
+        if (!_rehash(tracker, slot_count))
+        {
+            return false;
+        }
+    }
+
+    char* copy = _strdup(name);
+
+    if (!copy)
+    {
+        return false;
+    }
+
+    uint32_t i = hash & tracker->mask;
+
+    while (tracker->slots[i].name)
+    {
+        i = (i + 1) & tracker->mask;
+    }
+
+    if (!tracker->slots[i].tombstone)
+    {
+        tracker->used++;
+    }
+
+    tracker->slots[i].name      = copy;
+    tracker->slots[i].hash      = hash;
+    tracker->slots[i].tombstone  = false;
+    tracker->slots[i].reported   = false;
+    tracker->slots[i].write_time = 0;
+    tracker->count++;
+
+    return true;
+}
+
+static void _untrack_slot(_dirwatcher_write_tracker_t* tracker, uint32_t index)
+{
+    _dirwatcher_write_slot_t* slot = &tracker->slots[index];
+
+    free(slot->name);
+
+    slot->name      = NULL;
+    slot->tombstone = true;
+    tracker->count--;
+}
+
+static bool _untrack(_dirwatcher_write_tracker_t* tracker, const char* name)
+{
+    uint32_t index = _find(tracker, name, _hash_name(name));
+
+    if (index == DIRWATCHER_WRITE_NONE)
+    {
+        return false;
+    }
+
+    _untrack_slot(tracker, index);
+    return true;
+}
+
+/*
+    Returns the full path of a tracked name. Returns NULL on failure.
+*/
+static wchar_t* _build_full_path(const _dirwatcher_write_tracker_t* tracker, const char* name)
+{
+    bool     absolute   = (name[0] && name[1] == ':' && name[2] == '\\') || (name[0] == '\\' && name[1] == '\\');
+    size_t   root_count = absolute ? 0 : wcslen(tracker->root_path);
+    int      name_count = MultiByteToWideChar(CP_UTF8, 0, name, -1, NULL, 0);
+    wchar_t* path       = name_count > 0 ? malloc((root_count + 1 + (size_t)name_count) * sizeof(wchar_t)) : NULL;
+
+    if (!path)
+    {
+        return NULL;
+    }
+
+    wchar_t* cur = path;
+
+    if (!absolute)
+    {
+        wmemcpy(cur, tracker->root_path, root_count);
+        cur += root_count;
+        *cur++ = L'\\';
+    }
+
+    MultiByteToWideChar(CP_UTF8, 0, name, -1, cur, name_count);
+    return path;
+}
+
+/* Public functions ***********************************/
+
+_dirwatcher_write_tracker_t* _dirwatcher_write_tracker_create(const wchar_t* root_path)
+{
+    _dirwatcher_write_tracker_t* tracker = calloc(1, sizeof(_dirwatcher_write_tracker_t));
+
+    if (!tracker)
+    {
+        return NULL;
+    }
+
+    tracker->root_path = _wcsdup(root_path);
+    tracker->slots     = calloc(DIRWATCHER_WRITE_MIN_SLOTS, sizeof(_dirwatcher_write_slot_t));
+    tracker->mask      = DIRWATCHER_WRITE_MIN_SLOTS - 1;
+
+    if (!tracker->root_path || !tracker->slots)
+    {
+        _dirwatcher_write_tracker_destroy(tracker);
+        return NULL;
+    }
+
+    return tracker;
+}
+
+void _dirwatcher_write_tracker_destroy(_dirwatcher_write_tracker_t* tracker)
+{
+    if (!tracker)
+    {
+        return;
+    }
+
+    if (tracker->slots)
+    {
+        _dirwatcher_write_tracker_clear(tracker);
+    }
+
+    free(tracker->root_path);
+    free(tracker->slots);
+    free(tracker);
+}
+
+bool _dirwatcher_write_tracker_update(_dirwatcher_write_tracker_t* tracker, const dirwatcher_event_info_t* event)
+{
+    switch (event->event)
+    {
+    case DIRWATCHER_EVENT_ADDED:
+    case DIRWATCHER_EVENT_MODIFIED:
+        return _track(tracker, event->name);
+
+    case DIRWATCHER_EVENT_REMOVED:
+    case DIRWATCHER_EVENT_RENAMED_FROM:
+        _untrack(tracker, event->name);
+        return true;
+
+    case DIRWATCHER_EVENT_RENAMED:
+        return !_untrack(tracker, event->old_name) || _track(tracker, event->name);
+
+    default:
+        return true;
+    }
+}
+
+uint32_t _dirwatcher_write_tracker_get_count(const _dirwatcher_write_tracker_t* tracker)
+{
+    return tracker->count;
+}
+
+bool _dirwatcher_write_tracker_probe(_dirwatcher_write_tracker_t* tracker, _dirwatcher_write_emit_t emit, void* context)
+{
+    uint32_t probed = 0;
+
+    for (uint32_t n = 0; n <= tracker->mask && probed < DIRWATCHER_WRITE_PROBE_BATCH; n++)
+    {
+        uint32_t index = tracker->cursor;
+
+        tracker->cursor = (tracker->cursor + 1) & tracker->mask;
+
+        _dirwatcher_write_slot_t* slot = &tracker->slots[index];
+
+        if (!slot->name)
+        {
+            continue;
+        }
+
+        if (slot->reported)
+        {
+            _untrack_slot(tracker, index);
+            continue;
+        }
+
+        probed++;
+
+        //
+        // Opening without write sharing fails while a writer still holds the file
+        //
+
+        wchar_t* path   = _build_full_path(tracker, slot->name);
+        HANDLE   handle = path ? CreateFileW(path,
+                                             GENERIC_READ,
+                                             FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                             NULL,
+                                             OPEN_EXISTING,
+                                             FILE_ATTRIBUTE_NORMAL,
+                                             NULL)
+                               : INVALID_HANDLE_VALUE;
+        DWORD    error  = handle == INVALID_HANDLE_VALUE ? (path ? GetLastError() : ERROR_NOT_ENOUGH_MEMORY) : ERROR_SUCCESS;
+
+        free(path);
+
+        if (error == ERROR_SHARING_VIOLATION || error == ERROR_NOT_ENOUGH_MEMORY)
+        {
+            continue;
+        }
+
+        if (error != ERROR_SUCCESS)
+        {
+            //
+            // Gone: removed, a directory, or not accessible
+            //
+
+            _untrack_slot(tracker, index);
+            continue;
+        }
+
+        FILETIME write_time = { 0 };
+        GetFileTime(handle, NULL, NULL, &write_time);
+        CloseHandle(handle);
+
+        uint64_t time = ((uint64_t)write_time.dwHighDateTime << 32) | write_time.dwLowDateTime;
+
+        //
+        // A MODIFIED that only carried the time stamp of the reported close
+        //
+
+        if (time == slot->write_time)
+        {
+            _untrack_slot(tracker, index);
+            continue;
+        }
+
+        slot->reported   = true;
+        slot->write_time = time;
+
+        if (!emit(context, slot->name))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void _dirwatcher_write_tracker_clear(_dirwatcher_write_tracker_t* tracker)
+{
+    for (uint32_t i = 0; i <= tracker->mask; i++)
+    {
+        free(tracker->slots[i].name);
+    }
+
+    memset(tracker->slots, 0, ((size_t)tracker->mask + 1) * sizeof(_dirwatcher_write_slot_t));
+
+    tracker->count  = 0;
+    tracker->used   = 0;
+    tracker->cursor = 0;
+}
@@ -0,0 +1,66 @@
+/*
+    DIRWATCHER_WRITE_TRACKER_WIN32.H
+      Private tracker of files being written, for DIRWATCHER_EVENT_CLOSED_WRITE
+
+    Windows reports writes but not the close that ends them. Files that were
+    added or modified are tracked by name until a probe can open them without
+    sharing write access, which fails while any handle with write access is
+    still open. A probe holds the file open only for that moment.
+
+    Names are those of the dispatched events: relative to the root, or full
+    paths for extra directories.
+
+    Not thread-safe; the owner serializes access.
+*/
+
+#ifndef DIRWATCHER_WRITE_TRACKER_WIN32_H
+#define DIRWATCHER_WRITE_TRACKER_WIN32_H
+
+#include <dirwatcher.h>
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct _dirwatcher_write_tracker _dirwatcher_write_tracker_t;
+
+/*
+    Receives the name of a file that is no longer open for writing.
+    Returns false to stop the probe; GetLastError() must hold the reason.
+*/
+typedef bool (*_dirwatcher_write_emit_t)(void* context, const char* name);
+
+/*
+    Creates a tracker for the tree at root_path (full path).
+    Returns NULL on failure.
+*/
+_dirwatcher_write_tracker_t* _dirwatcher_write_tracker_create(const wchar_t* root_path);
+
+void _dirwatcher_write_tracker_destroy(_dirwatcher_write_tracker_t* tracker);
+
+/*
+    Starts or stops tracking the file of one dispatched event: added and
+    modified files are tracked, removed ones dropped, renamed ones follow
+    their new name. Returns false on allocation failure.
+*/
+bool _dirwatcher_write_tracker_update(_dirwatcher_write_tracker_t* tracker, const dirwatcher_event_info_t* event);
+
+/*
+    Returns the number of tracked files; none need probing while it is 0.
+*/
+uint32_t _dirwatcher_write_tracker_get_count(const _dirwatcher_write_tracker_t* tracker);
+
+/*
+    Probes a batch of tracked files, resuming where the last probe stopped.
+    Files no longer open for writing are passed to emit, and dropped by the
+    next probe unless modified again; files that are gone are dropped quietly.
+    Returns false if emit fails.
+*/
+bool _dirwatcher_write_tracker_probe(_dirwatcher_write_tracker_t* tracker, _dirwatcher_write_emit_t emit, void* context);
+
+/*
+    Stops tracking every file; for changes that were lost.
+*/
+void _dirwatcher_write_tracker_clear(_dirwatcher_write_tracker_t* tracker);
+
+#endif
@@ -0,0 +1,672 @@
+#include <dirwatcher.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dirwatcher_path_table.h"
+#include "dirwatcher_change_index.h"
+
+/*
+    Runs random operations on the path table and the change index next to
+    a plain model of each and compares them after every step. Covers moves,
+    names merged by case folding, and tokens the index must refuse.
+
+    Usage: model_check [seed] [steps]
+    Returns 0 if the structures agree with their models.
+*/
+
+#define MY_MAX_PATH    512
+#define MY_MAX_NAME    16
+#define MY_MAX_NODES   4096
+#define MY_MAX_CHANGES 256
+#define MY_MAX_TOKENS  64
+
+#define CHECK(cond)                                                              \
+    do                                                                           \
+    {                                                                            \
+        if (!(cond))                                                             \
+        {                                                                        \
+            fprintf(stderr, "FAILED: %s (line %d, step %lu)\n", #cond, __LINE__, \
+                    step);                                                       \
+            return false;                                                        \
+        }                                                                        \
+    } while (0)
+
+static const char* base_names[] = { "a", "b", "src", "Build", "x.txt", "\xC3\xA9t\xC3\xA9", "\xC3\x89T\xC3\x89" };
+
+static uint64_t      rng_state = 0x9E3779B97F4A7C15ull;
+static unsigned long step      = 0;
+
+static uint32_t next_random(void)
+{
+    rng_state ^= rng_state << 13; // xorshift64
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+
+    return (uint32_t)(rng_state >> 32);
+}
+
+static uint32_t random_below(uint32_t bound)
+{
+    return next_random() % bound;
+}
+
+static char fold_char(char c, bool ignore_case)
+{
+    return ignore_case && c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+}
+
+static void fold(char* dst, const char* src, bool ignore_case)
+{
+    while (*src)
+    {
+        *dst++ = fold_char(*src++, ignore_case);
+    }
+
+    *dst = '\0';
+}
+
+/*
+    A vocabulary name with the case of its ASCII letters flipped at random.
+*/
+static void random_name(char* name)
+{
+    const char* base = base_names[random_below(sizeof(base_names) / sizeof(base_names[0]))];
+    size_t      i    = 0;
+
+    for (; base[i]; i++)
+    {
+        char c = base[i];
+
+        if (random_below(4) == 0 && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')))
+        {
+            c = (char)(c ^ 0x20);
+        }
+
+        name[i] = c;
+    }
+
+    name[i] = '\0';
+}
+
+/* Path table *****************************************/
+
+/*
+    Model of the interned components: one entry per folded name in use,
+    holding the case it was first stored with.
+*/
+typedef struct model_component
+{
+    char     folded[MY_MAX_NAME];
+    char     stored[MY_MAX_NAME];
+    uint32_t refs;
+} model_component_t;
+
+typedef struct model_node
+{
+    bool     alive;
+    uint32_t parent;
+    char     folded[MY_MAX_NAME];
+} model_node_t;
+
+typedef struct table_model
+{
+    bool              ignore_case;
+    model_node_t      nodes[MY_MAX_NODES];
+    model_component_t components[MY_MAX_NODES];
+    uint32_t          component_count;
+    uint32_t          count;
+} table_model_t;
+
+static model_component_t* find_component(table_model_t* model, const char* folded)
+{
+    for (uint32_t i = 0; i < model->component_count; i++)
+    {
+        if (strcmp(model->components[i].folded, folded) == 0)
+        {
+            return &model->components[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void acquire_component(table_model_t* model, const char* name)
+{
+    char folded[MY_MAX_NAME];
+
+    fold(folded, name, model->ignore_case);
+
+    model_component_t* component = find_component(model, folded);
+
+    if (!component)
+    {
+        component = &model->components[model->component_count++];
+        strcpy(component->folded, folded);
+        strcpy(component->stored, name);
+        component->refs = 0;
+    }
+
+    component->refs++;
+}
+
+static void release_component(table_model_t* model, const char* folded)
+{
+    model_component_t* component = find_component(model, folded);
+
+    if (--component->refs == 0)
+    {
+        *component = model->components[--model->component_count];
+    }
+}
+
+static uint32_t model_child(const table_model_t* model, uint32_t parent, const char* folded)
+{
+    for (uint32_t i = 0; i < MY_MAX_NODES; i++)
+    {
+        if (model->nodes[i].alive && i != DIRWATCHER_PATH_ROOT && model->nodes[i].parent == parent && strcmp(model->nodes[i].folded, folded) == 0)
+        {
+            return i;
+        }
+    }
+
+    return DIRWATCHER_PATH_NONE;
+}
+
+static bool model_is_below(const table_model_t* model, uint32_t node, uint32_t ancestor)
+{
+    for (uint32_t p = node; p != DIRWATCHER_PATH_NONE; p = p == DIRWATCHER_PATH_ROOT ? DIRWATCHER_PATH_NONE : model->nodes[p].parent)
+    {
+        if (p == ancestor)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static uint32_t random_alive(const table_model_t* model, bool allow_root)
+{
+    for (;;)
+    {
+        uint32_t node = random_below(MY_MAX_NODES);
+
+        if (model->nodes[node].alive && (allow_root || node != DIRWATCHER_PATH_ROOT))
+        {
+            return node;
+        }
+
+        if (model->count == 1 && !allow_root)
+        {
+            return DIRWATCHER_PATH_NONE;
+        }
+    }
+}
+
+/*
+    Writes the path the table should build for node, in the stored case of its components.
+*/
+static void model_path(table_model_t* model, uint32_t node, char* path)
+{
+    uint32_t chain[MY_MAX_NODES];
+    uint32_t depth = 0;
+
+    for (uint32_t p = node; p != DIRWATCHER_PATH_ROOT; p = model->nodes[p].parent)
+    {
+        chain[depth++] = p;
+    }
+
+    *path = '\0';
+
+    while (depth--)
+    {
+        strcat(path, find_component(model, model->nodes[chain[depth]].folded)->stored);
+
+        if (depth)
+        {
+            strcat(path, "\\");
+        }
+    }
+}
+
+static bool verify_table(const _dirwatcher_path_table_t* table, table_model_t* model)
+{
+    char     path[MY_MAX_PATH];
+    char     built[MY_MAX_PATH];
+    uint32_t bound = _dirwatcher_path_table_id_bound(table);
+
+    CHECK(bound <= MY_MAX_NODES);
+    CHECK(_dirwatcher_path_table_count(table) == model->count);
+
+    for (uint32_t node = 0; node < MY_MAX_NODES; node++)
+    {
+        const model_node_t* expected = &model->nodes[node];
+
+        CHECK(_dirwatcher_path_table_is_valid(table, node) == expected->alive);
+
+        if (!expected->alive)
+        {
+            continue;
+        }
+
+        model_path(model, node, path);
+
+        CHECK(_dirwatcher_path_table_build_path(table, node, NULL, 0) == strlen(path) + 1);
+        CHECK(_dirwatcher_path_table_build_path(table, node, built, sizeof(built)) != 0);
+        CHECK(strcmp(built, path) == 0);
+        CHECK(_dirwatcher_path_table_find(table, path) == node);
+
+        //
+        // Lookups ignore case only where the table does
+        //
+
+        for (char* c = path; *c; c++)
+        {
+            if ((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z'))
+            {
+                *c = (char)(*c ^ 0x20);
+                CHECK((_dirwatcher_path_table_find(table, path) == node) == model->ignore_case);
+                break;
+            }
+        }
+
+        uint32_t children = 0;
+
+        for (uint32_t child = _dirwatcher_path_table_first_child(table, node);
+             child != DIRWATCHER_PATH_NONE;
+             child = _dirwatcher_path_table_next_sibling(table, child))
+        {
+            CHECK(child < MY_MAX_NODES && model->nodes[child].alive && model->nodes[child].parent == node);
+            children++;
+        }
+
+        for (uint32_t i = 1; i < MY_MAX_NODES; i++)
+        {
+            children -= model->nodes[i].alive && model->nodes[i].parent == node ? 1 : 0;
+        }
+
+        CHECK(children == 0);
+
+        if (node != DIRWATCHER_PATH_ROOT)
+        {
+            CHECK(_dirwatcher_path_table_parent(table, node) == expected->parent);
+        }
+    }
+
+    return true;
+}
+
+static bool check_table(bool ignore_case, unsigned long steps)
+{
+    table_model_t*            model = calloc(1, sizeof(table_model_t));
+    _dirwatcher_path_table_t* table = _dirwatcher_path_table_create(ignore_case);
+    char                      name[MY_MAX_NAME];
+    char                      folded[MY_MAX_NAME];
+    bool                      ok    = model && table;
+
+    if (!ok)
+    {
+        fputs("ERROR: Out of memory.\n", stderr);
+    }
+
+    if (ok)
+    {
+        model->ignore_case                       = ignore_case;
+        model->nodes[DIRWATCHER_PATH_ROOT].alive = true;
+        model->count                             = 1;
+    }
+
+    for (step = 0; ok && step < steps; step++)
+    {
+        uint32_t op = random_below(10);
+
+        //
+        // Keep the tree small enough that names collide and moves meet occupied destinations
+        //
+
+        if (model->count > 300 && op < 6)
+        {
+            op = 6;
+        }
+
+        random_name(name);
+        fold(folded, name, ignore_case);
+
+        if (op < 6)
+        {
+            uint32_t parent   = random_alive(model, true);
+            uint32_t existing = model_child(model, parent, folded);
+            uint32_t node     = _dirwatcher_path_table_insert(table, parent, name, strlen(name));
+
+            if (existing != DIRWATCHER_PATH_NONE)
+            {
+                ok = node == existing;
+            }
+            else
+            {
+                ok = node < MY_MAX_NODES && !model->nodes[node].alive;
+
+                if (ok)
+                {
+                    model->nodes[node].alive  = true;
+                    model->nodes[node].parent = parent;
+                    strcpy(model->nodes[node].folded, folded);
+                    acquire_component(model, name);
+                    model->count++;
+                }
+            }
+
+            if (!ok)
+            {
+                fprintf(stderr, "FAILED: insert (step %lu)\n", step);
+            }
+        }
+        else if (op < 8)
+        {
+            uint32_t node       = random_alive(model, false);
+            uint32_t new_parent = random_alive(model, true);
+
+            if (node == DIRWATCHER_PATH_NONE)
+            {
+                continue;
+            }
+
+            bool expected = !model_is_below(model, new_parent, node) && model_child(model, new_parent, folded) == DIRWATCHER_PATH_NONE;
+            bool moved    = _dirwatcher_path_table_move(table, node, new_parent, name, strlen(name));
+
+            ok = moved == expected;
+
+            if (ok && moved)
+            {
+                acquire_component(model, name);
+                release_component(model, model->nodes[node].folded);
+
+                model->nodes[node].parent = new_parent;
+                strcpy(model->nodes[node].folded, folded);
+            }
+
+            if (!ok)
+            {
+                fprintf(stderr, "FAILED: move (step %lu)\n", step);
+            }
+        }
+        else
+        {
+            uint32_t node = random_alive(model, false);
+
+            if (node == DIRWATCHER_PATH_NONE)
+            {
+                continue;
+            }
+
+            _dirwatcher_path_table_remove(table, node);
+
+            for (uint32_t i = 1; i < MY_MAX_NODES; i++)
+            {
+                if (model->nodes[i].alive && model_is_below(model, i, node))
+                {
+                    release_component(model, model->nodes[i].folded);
+
+                    model->nodes[i].alive = false;
+                    model->count--;
+                }
+            }
+        }
+
+        ok = ok && verify_table(table, model);
+    }
+
+    _dirwatcher_path_table_destroy(table);
+    free(model);
+
+    return ok;
+}
+
+/* Change index ***************************************/
+
+typedef struct model_change
+{
+    char     folded[MY_MAX_PATH];
+    uint64_t clock;
+} model_change_t;
+
+/*
+    Model of the index: changed paths oldest first, with the clock state
+    that decides which tokens are refused.
+*/
+typedef struct index_model
+{
+    model_change_t changes[MY_MAX_CHANGES + 1];
+    uint32_t       count;
+    uint32_t       max_paths;
+    uint64_t       now;
+    uint64_t       horizon;
+} index_model_t;
+
+typedef struct listed
+{
+    char     paths[MY_MAX_CHANGES][MY_MAX_PATH];
+    uint32_t count;
+    bool     overflow;
+} listed_t;
+
+static void collect(const char* path, void* user_data)
+{
+    listed_t* listed = user_data;
+
+    if (listed->count == MY_MAX_CHANGES || strlen(path) >= MY_MAX_PATH)
+    {
+        listed->overflow = true;
+        return;
+    }
+
+    strcpy(listed->paths[listed->count++], path);
+}
+
+static void model_drop_oldest(index_model_t* model)
+{
+    if (model->changes[0].clock > model->horizon)
+    {
+        model->horizon = model->changes[0].clock;
+    }
+
+    memmove(&model->changes[0], &model->changes[1], (model->count - 1) * sizeof(model_change_t));
+    model->count--;
+}
+
+static void model_record(index_model_t* model, const char* folded)
+{
+    for (uint32_t i = 0; i < model->count; i++)
+    {
+        if (strcmp(model->changes[i].folded, folded) == 0)
+        {
+            memmove(&model->changes[i], &model->changes[i + 1], (model->count - i - 1) * sizeof(model_change_t));
+            model->count--;
+            break;
+        }
+    }
+
+    strcpy(model->changes[model->count].folded, folded);
+    model->changes[model->count++].clock = ++model->now;
+
+    while (model->count > model->max_paths)
+    {
+        model_drop_oldest(model);
+    }
+}
+
+static void model_expire(index_model_t* model)
+{
+    model->count   = 0;
+    model->horizon = ++model->now;
+}
+
+static bool verify_since(const _dirwatcher_change_index_t* index, index_model_t* model, listed_t* listed, uint64_t token, uint64_t tag)
+{
+    uint64_t clock     = token & ((1ull << 40) - 1);
+    bool     refused   = (token & ~((1ull << 40) - 1)) != tag || clock < model->horizon || clock > model->now;
+    uint64_t new_token = 0;
+    char     folded[MY_MAX_PATH];
+
+    listed->count    = 0;
+    listed->overflow = false;
+
+    dirwatcher_changes_result_t result = _dirwatcher_change_index_since(index, token, collect, listed, &new_token);
+
+    CHECK(new_token == (tag | model->now));
+    CHECK(result == (refused ? DIRWATCHER_CHANGES_EXPIRED : DIRWATCHER_CHANGES_OK));
+    CHECK(!listed->overflow);
+
+    if (refused)
+    {
+        CHECK(listed->count == 0);
+        return true;
+    }
+
+    //
+    // Newest first, each path once, in any case of its letters
+    //
+
+    uint32_t expected = 0;
+
+    for (uint32_t i = model->count; i-- > 0 && model->changes[i].clock > clock; )
+    {
+        CHECK(expected < listed->count);
+
+        fold(folded, listed->paths[expected++], true);
+        CHECK(strcmp(folded, model->changes[i].folded) == 0);
+    }
+
+    CHECK(expected == listed->count);
+
+    return true;
+}
+
+static bool check_index(uint32_t max_paths, unsigned long steps)
+{
+    const uint64_t              tag    = 0x5Aull << 40;
+    index_model_t*              model  = calloc(1, sizeof(index_model_t));
+    listed_t*                   listed = malloc(sizeof(listed_t));
+    _dirwatcher_change_index_t* index  = _dirwatcher_change_index_create(max_paths, 0x5A);
+    uint64_t                    tokens[MY_MAX_TOKENS];
+    uint32_t                    token_count = 0;
+    bool                        ok          = model && listed && index;
+
+    if (!ok)
+    {
+        fputs("ERROR: Out of memory.\n", stderr);
+    }
+
+    if (ok)
+    {
+        model->max_paths = max_paths;
+    }
+
+    for (step = 0; ok && step < steps; step++)
+    {
+        uint32_t op = random_below(20);
+
+        if (op < 16)
+        {
+            //
+            // Short paths from a small vocabulary: the same path recurs in other cases
+            //
+
+            char     path[MY_MAX_PATH] = "";
+            char     name[MY_MAX_NAME];
+            char     folded[MY_MAX_PATH];
+            uint32_t depth = 1 + random_below(3);
+
+            for (uint32_t i = 0; i < depth; i++)
+            {
+                random_name(name);
+
+                if (i)
+                {
+                    strcat(path, "\\");
+                }
+
+                strcat(path, name);
+            }
+
+            fold(folded, path, true);
+
+            _dirwatcher_change_index_record(index, path);
+            model_record(model, folded);
+        }
+        else if (op < 17)
+        {
+            _dirwatcher_change_index_expire(index);
+            model_expire(model);
+        }
+        else
+        {
+            //
+            // Replay a token issued earlier, some of them refused by now, or a forged one
+            //
+
+            uint64_t token;
+
+            switch (random_below(4))
+            {
+            case 0:
+                token = (0x5Bull << 40) | (model->now ? random_below((uint32_t)model->now + 1) : 0);
+                break;
+
+            case 1:
+                token = tag | (model->now + 1 + random_below(4));
+                break;
+
+            default:
+                token = token_count ? tokens[random_below(token_count)] : _dirwatcher_change_index_token(index);
+                break;
+            }
+
+            ok = verify_since(index, model, listed, token, tag);
+        }
+
+        uint64_t token = _dirwatcher_change_index_token(index);
+
+        if (ok && token != (tag | model->now))
+        {
+            fprintf(stderr, "FAILED: token (step %lu)\n", step);
+            ok = false;
+        }
+
+        if (random_below(4) == 0)
+        {
+            tokens[token_count < MY_MAX_TOKENS ? token_count++ : random_below(MY_MAX_TOKENS)] = token;
+        }
+    }
+
+    _dirwatcher_change_index_destroy(index);
+    free(listed);
+    free(model);
+
+    return ok;
+}
+
+/* Main ***********************************************/
+
+int main(int argc, char** argv)
+{
+    unsigned long seed  = argc > 1 ? strtoul(argv[1], NULL, 0) : 1;
+    unsigned long steps = argc > 2 ? strtoul(argv[2], NULL, 0) : 20000;
+
+    if (seed)
+    {
+        rng_state ^= (uint64_t)seed * 0xBF58476D1CE4E5B9ull;
+    }
+
+    bool ok = check_table(true, steps) &&
+              check_table(false, steps) &&
+              check_index(8, steps) &&
+              check_index(MY_MAX_CHANGES, steps);
+
+    puts(ok ? "model_check: OK" : "model_check: FAILED");
+
+    return ok ? 0 : -1;
+}
@@ -16,6 +16,8 @@ static char* event_names[] = {
     "Modified",
     "Renamed from",
     "Renamed to",
+    "Renamed",
+    "Closed write",
     "<ERROR>"
 };
 static char* error_names[] = {
@@ -51,10 +53,16 @@ static void callback(const dirwatcher_event_info_t* event, void* user_data)
 
     printf("+---------------------------------------------------------\n"
            "| Event: %s\n"
-           "| Name:  %s\n"
-           "+---------------------------------------------------------\n",
+           "| Name:  %s\n",
            event_names[event->event], buffer);
 
+    if (event->old_name)
+    {
+        printf("| From:  %s\n", event->old_name);
+    }
+
+    printf("+---------------------------------------------------------\n");
+
     free(buffer);
 }
 
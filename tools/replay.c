@@ -0,0 +1,120 @@
+#include <dirwatcher.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#define MY_UNREFERENCED_PARAMETER(x) (void)(x)
+
+static char* event_names[] = {
+    "<ERROR>",
+    "Added",
+    "Removed",
+    "Modified",
+    "Renamed from",
+    "Renamed to",
+    "Renamed",
+    "Closed write",
+    "<ERROR>"
+};
+
+static bool quiet = false;
+
+static void callback(const dirwatcher_event_info_t* event, void* user_data)
+{
+    MY_UNREFERENCED_PARAMETER(user_data);
+
+    if (quiet)
+    {
+        return;
+    }
+
+    printf("%llu\t%s\t%s\t%s\n",
+           (unsigned long long)event->timestamp,
+           event_names[event->event < DIRWATCHER_EVENT_COUNT ? event->event : DIRWATCHER_EVENT_COUNT],
+           event->name,
+           event->old_name ? event->old_name : "");
+}
+
+static void usage(void)
+{
+    fputs("Usage: dirwatcher_replay <journal-dir> [options]\n"
+          "  --from-seq N    first sequence number (inclusive)\n"
+          "  --to-seq N      last sequence number (inclusive)\n"
+          "  --from-time T   first FILETIME (inclusive)\n"
+          "  --to-time T     last FILETIME (inclusive)\n"
+          "  --stats         do not print events, only report throughput\n",
+          stderr);
+}
+
+int main(int argc, char** argv)
+{
+    dirwatcher_journal_range_t range    = { 0, UINT64_MAX, 0, UINT64_MAX };
+    uint64_t                   replayed = 0;
+    LARGE_INTEGER              freq, begin, end;
+
+    if (argc < 2)
+    {
+        usage();
+        return -1;
+    }
+
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--stats") == 0)
+        {
+            quiet = true;
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--from-seq") == 0)
+        {
+            range.first_seq = strtoull(argv[++i], NULL, 0);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--to-seq") == 0)
+        {
+            range.last_seq = strtoull(argv[++i], NULL, 0);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--from-time") == 0)
+        {
+            range.first_time = strtoull(argv[++i], NULL, 0);
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--to-time") == 0)
+        {
+            range.last_time = strtoull(argv[++i], NULL, 0);
+        }
+        else
+        {
+            usage();
+            return -1;
+        }
+    }
+
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&begin);
+
+    bool success = dirwatcher_replay_journal(argv[1], &range, NULL, callback, NULL, &replayed);
+
+    QueryPerformanceCounter(&end);
+
+    if (!success)
+    {
+        fputs("ERROR: Failed to replay journal.\n", stderr);
+    }
+
+    if (quiet)
+    {
+        double seconds = (double)(end.QuadPart - begin.QuadPart) / (double)freq.QuadPart;
+
+        printf("Replayed %llu events in %.3f s (%.0f events/s)\n",
+               (unsigned long long)replayed,
+               seconds,
+               seconds > 0.0 ? (double)replayed / seconds : 0.0);
+    }
+
+    return success ? 0 : -1;
+}